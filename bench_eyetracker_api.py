@@ -0,0 +1,347 @@
+#! /usr/bin/env python
+""" A benchmark of the EyeTrackerGaze Python API's overhead, i.e. of each
+    method's call through ctypes into the .so, as Python callers feel it.
+
+    Runs against a synthetic backend: the lib built against the stubbed
+    stream engine (see lib/cpp/tobii_stub.h), streaming synthetic samples at
+    90 Hz, so no eyetracker device is needed. An X display is, for the gaze
+    marker, e.g. run w/ xvfb-run.
+
+    Each method is called back to back for a fixed time, first alone
+    ('solo'), then concurrently w/ the HUD's own callers ('concurrent'): a Tk
+    thread polling the gaze point and key from its event loop, and a watcher
+    thread waiting on gaze events and polling the user position. Calls per
+    second and latency percentiles are reported, for each method and for the
+    concurrent callers themselves, and written as JSON for tracking between
+    releases. Lifecycle methods (open, close, start, stop) are timed over a
+    few cycles instead.
+
+    Not benchmarked: write_calibration() and apply_calibration(), as they
+    write the calibration store or device, nor (w/o --inject) inject_text()
+    and inject_keysym(), as they type into the focused window.
+"""
+
+__author__ = 'Dustin Fast <dustin.fast@outlook.com>'
+
+import argparse
+import json
+import os
+import sys
+import tempfile
+import time
+import tkinter as tk
+from select import select
+from subprocess import run, PIPE
+from threading import Event, Thread
+
+import numpy as np
+
+import pyximport; pyximport.install()
+
+import lib.py.eyetracker_gaze as eyetracker_gaze
+from lib.py.app import config, info, warn
+from lib.py.eyetracker_gaze import EyeTrackerGaze
+
+_conf = config()
+HUD_KEYB_JSON = _conf['HUD_KEYB_JSON']
+del _conf
+
+STUB_PREP_PATH = 'lib/sh/prep_eyetracker_gaze_stub.sh'
+STUB_LIB_PATH = 'lib/so/eyetracker_gaze_stub.so'
+BENCH_JSON_PATH = 'eyetracker_api_bench.json'
+BENCH_FORMAT_VER = 1
+BENCH_SECONDS = 1.0         # Per method, per scenario
+BENCH_WARMUP_S = 1.0        # For the buffer to fill, before timing
+BENCH_LIFECYCLE_N = 5       # Open/close and start/stop cycles timed
+BENCH_PCTS = (50, 99, 99.9)
+TK_POLL_MS = 5              # Tk thread's gaze poll interval
+WATCH_TIMEOUT_S = .5        # As the HUD's ASYNC_DWELL_TIMEOUT
+WATCH_POS_DELAY_S = .1      # As the HUD's ASYNC_POS_DELAY
+AOI_RECT = (100, 100, 400, 300)
+TRIE_N_WORDS = 1000
+
+
+class StubEyeTrackerGaze(EyeTrackerGaze):
+    """ An EyeTrackerGaze w/ the synthetic backend.
+    """
+    _prep_path = STUB_PREP_PATH
+    _lib_path = STUB_LIB_PATH
+
+
+def _latency_stats(latencies_ns, elapsed_ns):
+    """ Returns a dict of the given call latencies' rate and percentiles, in
+        microseconds.
+    """
+    lat_us = np.array(latencies_ns, dtype=np.float64) / 1000
+    pcts = np.percentile(lat_us, BENCH_PCTS) if len(lat_us) else [0] * 3
+
+    return {'n_calls': len(lat_us),
+            'calls_s': len(lat_us) / (elapsed_ns / 1e9) if elapsed_ns else 0,
+            'p50_us': pcts[0],
+            'p99_us': pcts[1],
+            'p999_us': pcts[2],
+            'max_us': lat_us.max() if len(lat_us) else 0}
+
+
+def _time_calls(fn, seconds):
+    """ Calls fn back to back for the given number of seconds. Returns a dict
+        of its call rate and latencies.
+    """
+    latencies_ns = []
+    t_start = time.perf_counter_ns()
+    t_end = t_start + int(seconds * 1e9)
+    t = t_start
+
+    while t < t_end:
+        t_call = time.perf_counter_ns()
+        fn()
+        t = time.perf_counter_ns()
+        latencies_ns.append(t - t_call)
+
+    return _latency_stats(latencies_ns, t - t_start)
+
+
+def _tk_caller(gaze, is_stopped, latencies_ns):
+    """ Polls the gaze point and key every TK_POLL_MS from a Tk event loop,
+        recording each poll's latency. Intended to be run as a thread.
+    """
+    root = tk.Tk()
+    root.withdraw()
+
+    def poll():
+        if is_stopped.is_set():
+            root.quit()
+            return
+
+        t_call = time.perf_counter_ns()
+        gaze.gaze_coords()
+        gaze.gaze_key()
+        latencies_ns.append(time.perf_counter_ns() - t_call)
+
+        root.after(TK_POLL_MS, poll)
+
+    root.after(TK_POLL_MS, poll)
+    root.mainloop()
+    root.destroy()
+
+
+def _watcher_caller(gaze, is_stopped, latencies_ns):
+    """ Waits on gaze events and polls the user position, as the HUD's
+        watcher threads do, recording each call's latency. Intended to be run
+        as a thread.
+    """
+    fd = gaze.event_fd()
+    t_pos = 0
+
+    while not is_stopped.is_set():
+        if select([fd], [], [], WATCH_POS_DELAY_S)[0]:
+            t_call = time.perf_counter_ns()
+            gaze.events()
+            latencies_ns.append(time.perf_counter_ns() - t_call)
+
+        if time.monotonic() - t_pos >= WATCH_POS_DELAY_S:
+            t_pos = time.monotonic()
+            t_call = time.perf_counter_ns()
+            gaze.user_position()
+            latencies_ns.append(time.perf_counter_ns() - t_call)
+
+
+def _api_calls(gaze, tmp_dir, is_inject):
+    """ Returns a list of (name, fn) of calls of each of the given
+        EyeTrackerGaze's (non-lifecycle) methods, w/ representative args.
+    """
+    wordlist_path = os.path.join(tmp_dir, 'words.txt')
+    trie_path = os.path.join(tmp_dir, 'words.trie')
+    csv_path = os.path.join(tmp_dir, 'gaze.csv')
+    log_path = os.path.join(tmp_dir, 'gaze.glog')
+    trace_path = os.path.join(tmp_dir, 'trace.json')
+
+    # A synthetic word list, for the completion trie
+    with open(wordlist_path, 'w') as f:
+        for i in range(TRIE_N_WORDS):
+            f.write(f'th{chr(97 + i % 26)}{chr(97 + i // 26 % 26)}w{i} {i}\n')
+
+    gaze.build_completions(wordlist_path, trie_path)
+    gaze.load_completions(trie_path)
+    gaze.load_keymap(HUD_KEYB_JSON)
+    gaze.add_aoi(*AOI_RECT)
+
+    def add_remove_aoi():
+        gaze.remove_aoi(gaze.add_aoi(*AOI_RECT))
+
+    def history():
+        now_us = int(time.time() * 1e6)
+        gaze.history(now_us - 1000000, now_us)
+
+    calls = [
+        ('gaze_coords', gaze.gaze_coords),
+        ('gaze_key', gaze.gaze_key),
+        ('user_position', gaze.user_position),
+        ('gaze_data_sz', gaze.gaze_data_sz),
+        ('event_fd', gaze.event_fd),
+        ('events', gaze.events),
+        ('set_cursor_cap', gaze.set_cursor_cap),
+        ('calibration_profiles', gaze.calibration_profiles),
+        ('remove_calibration', lambda: gaze.remove_calibration('_bench')),
+        ('load_keymap', lambda: gaze.load_keymap(HUD_KEYB_JSON)),
+        ('set_dwell', lambda: gaze.set_dwell(0)),
+        ('build_completions',
+            lambda: gaze.build_completions(wordlist_path, trie_path)),
+        ('load_completions', lambda: gaze.load_completions(trie_path)),
+        ('completions', lambda: gaze.completions('th')),
+        ('set_heatmap', gaze.set_heatmap),
+        ('heatmap', gaze.heatmap),
+        ('add_aoi+remove_aoi', add_remove_aoi),
+        ('aoi_stats', gaze.aoi_stats),
+        ('reset_aoi_stats', gaze.reset_aoi_stats),
+        ('history', history),
+        ('cold_history_stats', gaze.cold_history_stats),
+        ('quality', gaze.quality),
+        ('reset_quality', gaze.reset_quality),
+        ('validity_counts', gaze.validity_counts),
+        ('blink_count', gaze.blink_count),
+        ('connection_stats', gaze.connection_stats),
+        ('startup_timeline', gaze.startup_timeline),
+        ('gap_log', gaze.gap_log),
+        ('lost_count', gaze.lost_count),
+        ('to_csv', lambda: gaze.to_csv(csv_path)),
+        ('to_log', lambda: gaze.to_log(log_path)),
+        ('trace', lambda: gaze.trace(False)),
+        ('trace_dump', lambda: gaze.trace_dump(trace_path))]
+
+    if is_inject:
+        calls += [('inject_text', lambda: gaze.inject_text('a')),
+                  ('inject_keysym', lambda: gaze.inject_keysym(0x61))]
+
+    return calls
+
+
+def _time_lifecycle(gaze):
+    """ Returns a list of (name, stats) of the given (closed) EyeTrackerGaze's
+        lifecycle methods, each timed over BENCH_LIFECYCLE_N cycles. Leaves it
+        open and started.
+    """
+    latencies_ns = {'open': [], 'start': [], 'stop': [], 'close': []}
+
+    def timed(name, fn):
+        t_call = time.perf_counter_ns()
+        fn()
+        latencies_ns[name].append(time.perf_counter_ns() - t_call)
+
+    for _ in range(BENCH_LIFECYCLE_N):
+        timed('open', gaze.open)
+        timed('close', gaze.close)
+
+    gaze.open()
+
+    for _ in range(BENCH_LIFECYCLE_N):
+        timed('start', gaze.start)
+        timed('stop', gaze.stop)
+
+    gaze.start()
+
+    return [(name, _latency_stats(lat, sum(lat)))
+            for name, lat in latencies_ns.items()]
+
+
+def _print_row(name, scenario, stats):
+    print(f'{name:<22} {scenario:<11} {stats["calls_s"]:>11.0f} '
+          f'{stats["p50_us"]:>9.1f} {stats["p99_us"]:>9.1f} '
+          f'{stats["p999_us"]:>9.1f} {stats["max_us"]:>10.1f}')
+
+
+def _source_rev():
+    """ Returns the source tree's git revision, or '' if unknown.
+    """
+    proc = run(['git', 'rev-parse', '--short', 'HEAD'], stdout=PIPE, stderr=PIPE)
+    return proc.stdout.decode().strip() if proc.returncode == 0 else ''
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--seconds',
+                        type=float,
+                        default=BENCH_SECONDS,
+                        help='Seconds each method is timed, per scenario.')
+    parser.add_argument('--json',
+                        default=BENCH_JSON_PATH,
+                        help='Path the JSON results are written to.')
+    parser.add_argument('--inject',
+                        action='store_true',
+                        default=False,
+                        help='Also time keystroke injection, which types '
+                             'into the focused window.')
+    args = parser.parse_args()
+
+    if not os.environ.get('DISPLAY'):
+        warn('No X display. Run under Xvfb, e.g. w/ xvfb-run.')
+        sys.exit(1)
+
+    # Zero-sample gaze point warnings are expected while the exports drain
+    # the buffer, so are silenced
+    eyetracker_gaze.warn = lambda *args, **kwargs: None
+
+    gaze = StubEyeTrackerGaze()
+    lifecycle = _time_lifecycle(gaze)
+    results = []
+
+    print(f'\n{"method":<22} {"scenario":<11} {"calls_s":>11} {"p50_us":>9} '
+          f'{"p99_us":>9} {"p999_us":>9} {"max_us":>10}')
+
+    for name, stats in lifecycle:
+        _print_row(name, 'lifecycle', stats)
+        results.append(dict(method=name, scenario='lifecycle', **stats))
+
+    time.sleep(BENCH_WARMUP_S)
+
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        calls = _api_calls(gaze, tmp_dir, args.inject)
+
+        for scenario in ('solo', 'concurrent'):
+            is_stopped = Event()
+            callers = []
+
+            if scenario == 'concurrent':
+                callers = [('tk_thread', _tk_caller, []),
+                           ('watcher_thread', _watcher_caller, [])]
+                threads = [Thread(target=fn, args=(gaze, is_stopped, lat))
+                           for _, fn, lat in callers]
+
+                for thread in threads:
+                    thread.start()
+
+            t_start = time.perf_counter_ns()
+
+            for name, fn in calls:
+                stats = _time_calls(fn, args.seconds)
+                _print_row(name, scenario, stats)
+                results.append(dict(method=name, scenario=scenario, **stats))
+
+            # The concurrent callers' own latencies, over the whole scenario
+            if callers:
+                is_stopped.set()
+                elapsed_ns = time.perf_counter_ns() - t_start
+
+                for thread in threads:
+                    thread.join()
+
+                for name, _, lat in callers:
+                    stats = _latency_stats(lat, elapsed_ns)
+                    _print_row(name, scenario, stats)
+                    results.append(
+                        dict(method=name, scenario=scenario, **stats))
+
+        # Also joins any export still writing to tmp_dir
+        gaze.stop()
+
+    gaze.close()
+
+    with open(args.json, 'w') as f:
+        json.dump({'format': BENCH_FORMAT_VER,
+                   'rev': _source_rev(),
+                   'unixtime': int(time.time()),
+                   'python': sys.version.split()[0],
+                   'seconds': args.seconds,
+                   'results': results}, f, indent=2)
+
+    info(f'Results written to {args.json}')
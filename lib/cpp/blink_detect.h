@@ -0,0 +1,77 @@
+/////////////////////////////////////////////////////////////////////////////
+// A streaming blink detector. A blink is a run of samples in which neither
+// eye is valid, bounded by valid samples on both sides, and lasting within
+// a plausible blink duration. Shorter runs are treated as noise and longer
+// ones as the user looking away or leaving. On a blink's end, a
+// GAZE_EVENT_BLINK event denoting its onset and duration is raised.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define BLINK_MIN_US 50000
+#define BLINK_MAX_US 500000
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class BlinkDetect {
+    public:
+        bool update(int64_t, uint8_t, gaze_event_t*);
+        int64_t blink_count();
+
+        BlinkDetect();
+
+    protected:
+        int64_t m_prev_valid_us;    // Time of the last sample w/ any eye valid
+        int64_t m_onset_us;         // Time of the first sample w/ none, or 0
+        int64_t m_n_blinks;
+};
+
+// Default constructor
+BlinkDetect::BlinkDetect() {
+    m_prev_valid_us = 0;
+    m_onset_us = 0;
+    m_n_blinks = 0;
+}
+
+// Updates blink state from a sample at time t_us having the given validity
+// bitmask (GAZE_VALID_LEFT | GAZE_VALID_RIGHT). If the sample ends a blink,
+// populates event and returns true.
+bool BlinkDetect::update(int64_t t_us, uint8_t validity, gaze_event_t *event) {
+    if (!validity) {
+        // Onset only counts if preceded by a valid sample
+        if (!m_onset_us && m_prev_valid_us)
+            m_onset_us = t_us;
+        return false;
+    }
+
+    int64_t onset_us = m_onset_us;
+    m_onset_us = 0;
+    m_prev_valid_us = t_us;
+
+    if (!onset_us)
+        return false;
+
+    int64_t duration_us = t_us - onset_us;
+    if (duration_us < BLINK_MIN_US || duration_us > BLINK_MAX_US)
+        return false;
+
+    event->type = GAZE_EVENT_BLINK;
+    event->key_idx = HUD_KEY_NONE;
+    event->unixtime_us = onset_us;
+    event->duration_us = duration_us;
+    m_n_blinks++;
+
+    return true;
+}
+
+// Returns the number of blinks detected.
+int64_t BlinkDetect::blink_count() {
+    return m_n_blinks;
+}
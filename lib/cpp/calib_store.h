@@ -0,0 +1,347 @@
+/////////////////////////////////////////////////////////////////////////////
+// A store of named eyetracker calibration profiles (e.g. one per user) held
+// in a single file. The file is memory-mapped, so a profile's calibration
+// blob may be handed to the device directly from the mapping, w/ no reading
+// or copying, making switching between profiles effectively instant.
+//
+// File format: A calib_store_header_t, followed by CALIB_STORE_MAX_PROFILES
+// calib_store_entry_t's (the index, in which unused entries have an empty
+// name), followed by the profiles' blobs. Writes are rare, so are done by
+// rewriting the file to a temp file, fsync'd, and renaming it over the
+// original, then fsync'ing the dir, so a crash leaves either the old store
+// or the new one.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define CALIB_STORE_MAGIC "AEYCALB1"
+#define CALIB_STORE_VERSION 1
+#define CALIB_STORE_MAX_PROFILES 64
+#define CALIB_STORE_MAX_NAME_LEN 63
+
+typedef struct calib_store_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t n_profiles;
+	    } calib_store_header_t;
+
+typedef struct calib_store_entry {
+        char name[CALIB_STORE_MAX_NAME_LEN + 1];
+        uint64_t offset;            // From the start of the file
+        uint64_t size;
+	    } calib_store_entry_t;
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class CalibrationStore {
+    public:
+        bool open(const char*);
+        bool find(const char*, const void**, size_t*);
+        bool put(const char*, const void*, size_t);
+        bool remove(const char*);
+        int list(char*, int);
+        int count();
+
+        CalibrationStore();
+        ~CalibrationStore();
+
+    protected:
+        string m_path;
+        void *m_map;
+        size_t m_map_sz;
+        const calib_store_header_t *m_header;
+        const calib_store_entry_t *m_entries;
+
+        const calib_store_entry_t* entry(const char*);
+        bool rewrite(const char*, const void*, size_t);
+
+    private:
+        void unmap();
+};
+
+// Default constructor. The store is empty until open().
+CalibrationStore::CalibrationStore() {
+    m_map = NULL;
+    m_map_sz = 0;
+    m_header = NULL;
+    m_entries = NULL;
+}
+
+// Destructor
+CalibrationStore::~CalibrationStore() {
+    unmap();
+}
+
+// Unmaps the store file, if mapped.
+void CalibrationStore::unmap() {
+    if (m_map)
+        munmap(m_map, m_map_sz);
+
+    m_map = NULL;
+    m_map_sz = 0;
+    m_header = NULL;
+    m_entries = NULL;
+}
+
+// Memory-maps the store file at the given path, which is also the path later
+// written to. Returns false if the file is missing or malformed, in which
+// case the store is empty.
+bool CalibrationStore::open(const char *store_path) {
+    unmap();
+    m_path = store_path;
+
+    int fd = ::open(store_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    size_t index_sz = sizeof(calib_store_header_t) +
+        CALIB_STORE_MAX_PROFILES * sizeof(calib_store_entry_t);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)index_sz) {
+        close(fd);
+        warn("Calibration store load failed (file too small).\n");
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        warn("Calibration store load failed (mmap failed).\n");
+        return false;
+    }
+
+    // Validate the header and every blob's bounds before trusting them. Bounds
+    // are compared as lens, so a corrupt offset can't wrap the sum, and the
+    // profile count must agree w/ the index, as count() trusts it
+    const calib_store_header_t *header = (const calib_store_header_t*)map;
+    const calib_store_entry_t *entries =
+        (const calib_store_entry_t*)(header + 1);
+    size_t file_sz = st.st_size;
+    uint32_t n_named = 0;
+    bool is_valid =
+        memcmp(header->magic, CALIB_STORE_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == CALIB_STORE_VERSION &&
+        header->n_profiles <= CALIB_STORE_MAX_PROFILES;
+
+    for (int i = 0; i < CALIB_STORE_MAX_PROFILES && is_valid; i++) {
+        is_valid = entries[i].name[CALIB_STORE_MAX_NAME_LEN] == '\0' && (
+            !entries[i].name[0] || (
+                entries[i].offset >= index_sz &&
+                entries[i].offset <= file_sz &&
+                entries[i].size <= file_sz - entries[i].offset));
+
+        if (entries[i].name[0])
+            n_named++;
+    }
+
+    is_valid = is_valid && header->n_profiles == n_named;
+
+    if (!is_valid) {
+        munmap(map, st.st_size);
+        warn("Calibration store load failed (invalid file).\n");
+        return false;
+    }
+
+    m_map = map;
+    m_map_sz = st.st_size;
+    m_header = header;
+    m_entries = entries;
+
+    return true;
+}
+
+// Returns the index entry of the given profile, or NULL if no such profile.
+const calib_store_entry_t* CalibrationStore::entry(const char *name) {
+    if (!m_entries)
+        return NULL;
+
+    for (int i = 0; i < CALIB_STORE_MAX_PROFILES; i++)
+        if (m_entries[i].name[0] && strcmp(m_entries[i].name, name) == 0)
+            return &m_entries[i];
+
+    return NULL;
+}
+
+// Populates data and size with the given profile's calibration blob, which
+// points directly into the mapped file and so remains valid only until the
+// next put() or remove(). Returns false if no such profile.
+bool CalibrationStore::find(const char *name, const void **data, size_t *size) {
+    const calib_store_entry_t *e = entry(name);
+
+    if (!e)
+        return false;
+
+    *data = (const char*)m_map + e->offset;
+    *size = e->size;
+
+    return true;
+}
+
+// Adds the given calibration blob as the given profile, replacing any
+// existing profile of that name. Returns false on failure.
+bool CalibrationStore::put(const char *name, const void *data, size_t size) {
+    if (!*name || strlen(name) > CALIB_STORE_MAX_NAME_LEN) {
+        error("Calibration store write failed (invalid profile name).\n");
+        return false;
+    }
+
+    if (!entry(name) && count() >= CALIB_STORE_MAX_PROFILES) {
+        error("Calibration store write failed (too many profiles).\n");
+        return false;
+    }
+
+    return rewrite(name, data, size);
+}
+
+// Removes the given profile. Returns false if no such profile or on failure.
+bool CalibrationStore::remove(const char *name) {
+    if (!entry(name))
+        return false;
+
+    return rewrite(name, NULL, 0);
+}
+
+// Rewrites the store file with all existing profiles, except that the given
+// profile is replaced by the given blob, or removed if data is NULL, then
+// remaps it. Returns false on failure, leaving the store unchanged.
+bool CalibrationStore::rewrite(const char *name, const void *data, size_t size) {
+    vector<calib_store_entry_t> entries(CALIB_STORE_MAX_PROFILES);
+    vector<const void*> blobs;
+    uint64_t offset = sizeof(calib_store_header_t) +
+        CALIB_STORE_MAX_PROFILES * sizeof(calib_store_entry_t);
+    int n_profiles = 0;
+
+    memset(entries.data(), 0, entries.size() * sizeof(calib_store_entry_t));
+
+    // Lay out the existing profiles (but the given one), then the given one
+    for (int i = 0; i < CALIB_STORE_MAX_PROFILES && m_entries; i++) {
+        const calib_store_entry_t *e = &m_entries[i];
+
+        if (!e->name[0] || strcmp(e->name, name) == 0)
+            continue;
+
+        entries[n_profiles] = *e;
+        entries[n_profiles].offset = offset;
+        blobs.push_back((const char*)m_map + e->offset);
+        offset += e->size;
+        n_profiles++;
+    }
+
+    if (data) {
+        strncpy(entries[n_profiles].name, name, CALIB_STORE_MAX_NAME_LEN);
+        entries[n_profiles].offset = offset;
+        entries[n_profiles].size = size;
+        blobs.push_back(data);
+        n_profiles++;
+    }
+
+    calib_store_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CALIB_STORE_MAGIC, sizeof(header.magic));
+    header.version = CALIB_STORE_VERSION;
+    header.n_profiles = n_profiles;
+
+    // Write to a temp file, synced so it's durable before it replaces the
+    // store, then atomically replace the store with it
+    string tmp_path = m_path + ".tmp";
+    int fd = ::open(
+        tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool is_ok = fd >= 0;
+
+    auto write_all = [fd, &is_ok](const void *data, size_t sz) {
+        const char *p = (const char*)data;
+
+        while (is_ok && sz > 0) {
+            ssize_t n = ::write(fd, p, sz);
+            if (n < 0 && errno == EINTR)
+                continue;
+
+            is_ok = n > 0;
+            p += n;
+            sz -= n;
+        }
+    };
+
+    write_all(&header, sizeof(header));
+    write_all(entries.data(), entries.size() * sizeof(calib_store_entry_t));
+    for (int i = 0; i < n_profiles; i++)
+        write_all(blobs[i], entries[i].size);
+
+    if (fd >= 0) {
+        is_ok = is_ok && fsync(fd) == 0;
+        is_ok = ::close(fd) == 0 && is_ok;
+    }
+
+    if (!is_ok || rename(tmp_path.c_str(), m_path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        error("Calibration store write failed (could not write file).\n");
+        return false;
+    }
+
+    // Sync the dir, so the rename itself survives a crash
+    size_t slash = m_path.find_last_of('/');
+    string dir_path = slash == string::npos ? "." :
+                      slash == 0 ? "/" : m_path.substr(0, slash);
+    int dir_fd = ::open(dir_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (dir_fd < 0 || fsync(dir_fd) != 0)
+        warn("Calibration store dir sync failed. May not survive a crash.\n");
+    if (dir_fd >= 0)
+        ::close(dir_fd);
+
+    return open(m_path.c_str());
+}
+
+// Writes the names of all profiles to out as a newline-separated,
+// null-terminated string of at most out_sz bytes. Returns the number of
+// names written.
+int CalibrationStore::list(char *out, int out_sz) {
+    int n_written = 0;
+    int n_names = 0;
+
+    if (out_sz <= 0)
+        return 0;
+    *out = '\0';
+
+    for (int i = 0; i < CALIB_STORE_MAX_PROFILES && m_entries; i++) {
+        const char *name = m_entries[i].name;
+        int len = strlen(name);
+        int sep = n_names > 0 ? 1 : 0;
+
+        if (!len)
+            continue;
+        if (n_written + sep + len + 1 > out_sz)
+            break;
+
+        if (sep)
+            out[n_written++] = '\n';
+        memcpy(out + n_written, name, len + 1);
+        n_written += len;
+        n_names++;
+    }
+
+    return n_names;
+}
+
+// Returns the number of profiles in the store.
+int CalibrationStore::count() {
+    return m_header ? m_header->n_profiles : 0;
+}
@@ -0,0 +1,198 @@
+/////////////////////////////////////////////////////////////////////////////
+// The eyetracker device's gaze stream loop, which survives connection loss.
+// When the device reports its connection lost (e.g. the USB link dropped),
+// reconnection is attempted under exponential backoff and the gaze stream
+// is resubscribed, all on the stream thread, so the stream's consumer (its
+// buffers, state, overlay, etc.) is untouched. Optional handlers are called
+// on loss and on restoration, e.g. to mark the resulting gap in samples, and
+// each time the device's queued callbacks are drained, e.g. to process the
+// samples they delivered as a batch.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <functional>
+
+#include <boost/thread.hpp>
+
+using namespace std;
+using namespace std::chrono;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define RECONNECT_BACKOFF_MIN_US 10000
+#define RECONNECT_BACKOFF_MAX_US 250000
+
+typedef function<void(int64_t)> stream_lost_handler_t;
+typedef function<void(int64_t, int64_t)> stream_restored_handler_t;
+typedef function<void()> stream_drained_handler_t;
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class DeviceStream {
+    public:
+        void run(tobii_device_t*, tobii_gaze_data_callback_t, void*);
+        void set_handlers(stream_lost_handler_t, stream_restored_handler_t);
+        void set_drained_handler(stream_drained_handler_t);
+        void stats(device_conn_stats_t*);
+
+        DeviceStream();
+
+    protected:
+        stream_lost_handler_t m_on_lost;
+        stream_restored_handler_t m_on_restored;
+        stream_drained_handler_t m_on_drained;
+        device_conn_stats_t m_stats;
+        boost::mutex m_stats_mutex;
+
+        void reconnect(tobii_device_t*, tobii_gaze_data_callback_t, void*);
+        static bool is_connection_lost(tobii_error_t);
+        static int64_t unixtime_us();
+};
+
+// Default constructor
+DeviceStream::DeviceStream() {
+    m_on_lost = NULL;
+    m_on_restored = NULL;
+    m_on_drained = NULL;
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_stats.is_connected = 1;
+}
+
+// Sets the handlers called (on the stream thread) on connection loss, w/ the
+// time of loss, and on its restoration, w/ the time of loss and the outage
+// duration, in microseconds. Must not be called while the stream is running.
+void DeviceStream::set_handlers(stream_lost_handler_t on_lost,
+                                stream_restored_handler_t on_restored) {
+    m_on_lost = on_lost;
+    m_on_restored = on_restored;
+}
+
+// Sets the handler called (on the stream thread) after each processing of
+// the device's queued callbacks, i.e. once the samples they delivered are
+// all in hand. Must not be called while the stream is running.
+void DeviceStream::set_drained_handler(stream_drained_handler_t on_drained) {
+    m_on_drained = on_drained;
+}
+
+// Returns the current system time, in microseconds since the epoch.
+int64_t DeviceStream::unixtime_us() {
+    return duration_cast<microseconds>(
+        system_clock::now().time_since_epoch()).count();
+}
+
+// Returns true iff the given error denotes the device connection was lost.
+bool DeviceStream::is_connection_lost(tobii_error_t error) {
+    return error == TOBII_ERROR_CONNECTION_FAILED ||
+           error == TOBII_ERROR_CONNECTION_FAILED_DRIVER;
+}
+
+// Subscribes the given callback to the device's gaze stream and processes
+// its callbacks until the calling thread is interrupted, reconnecting on
+// connection loss.
+void DeviceStream::run(tobii_device_t *device,
+                       tobii_gaze_data_callback_t callback,
+                       void *user_data) {
+    assert(tobii_gaze_data_subscribe(device, callback, user_data
+    ) == NO_ERROR);
+
+    g_gaze_trace.name_thread("gaze_stream");
+
+    try {
+        while (True) {
+            tobii_error_t error;
+
+            {
+                GazeTraceScope trace("stream_wait");
+                error = tobii_wait_for_callbacks(1, &device);
+            }
+
+            if (error == NO_ERROR || error == TOBII_ERROR_TIMED_OUT) {
+                GazeTraceScope trace("stream_process");
+                error = tobii_device_process_callbacks(device);
+
+                // Samples delivered before any loss precede its gap
+                if (m_on_drained)
+                    m_on_drained();
+            }
+
+            if (is_connection_lost(error))
+                reconnect(device, callback, user_data);
+            else
+                assert(error == NO_ERROR);
+
+            boost::this_thread::sleep_for(boost::chrono::microseconds{1});
+        }
+    } catch (boost::thread_interrupted&) {}
+
+    tobii_gaze_data_unsubscribe(device);  // Fails harmlessly if disconnected
+}
+
+// Reconnects to the device, retrying under exponential backoff, then
+// resubscribes the gaze stream. Blocks until done or the thread is
+// interrupted (in which case boost::thread_interrupted is thrown).
+void DeviceStream::reconnect(tobii_device_t *device,
+                             tobii_gaze_data_callback_t callback,
+                             void *user_data) {
+    GazeTraceScope trace("stream_reconnect");
+    int64_t lost_us = unixtime_us();
+    int64_t backoff_us = RECONNECT_BACKOFF_MIN_US;
+
+    {
+        boost::mutex::scoped_lock lock(m_stats_mutex);
+        m_stats.n_disconnects++;
+        m_stats.is_connected = 0;
+    }
+
+    warn("Eyetracker connection lost. Reconnecting...\n");
+    if (m_on_lost)
+        m_on_lost(lost_us);
+
+    while (True) {
+        tobii_error_t error = tobii_device_reconnect(device);
+
+        {
+            boost::mutex::scoped_lock lock(m_stats_mutex);
+            m_stats.n_attempts++;
+        }
+
+        if (error == NO_ERROR)
+            break;
+
+        // Device may still be settling, so back off before retrying
+        boost::this_thread::sleep_for(boost::chrono::microseconds{backoff_us});
+        backoff_us = min(backoff_us * 2, (int64_t)RECONNECT_BACKOFF_MAX_US);
+    }
+
+    // Subscriptions may or may not survive a reconnect
+    tobii_error_t error = tobii_gaze_data_subscribe(device, callback, user_data);
+    assert(error == NO_ERROR || error == TOBII_ERROR_ALREADY_SUBSCRIBED);
+
+    // The device clock may have restarted
+    tobii_update_timesync(device);
+
+    int64_t outage_us = unixtime_us() - lost_us;
+
+    {
+        boost::mutex::scoped_lock lock(m_stats_mutex);
+        m_stats.is_connected = 1;
+        m_stats.last_outage_us = outage_us;
+        m_stats.max_outage_us = max(m_stats.max_outage_us, outage_us);
+    }
+
+    info("Eyetracker reconnected ");
+    printf("(%.1f ms outage).\n", outage_us / 1000.0);
+
+    if (m_on_restored)
+        m_on_restored(lost_us, outage_us);
+}
+
+// Populates stats with the connection's statistics.
+void DeviceStream::stats(device_conn_stats_t *stats) {
+    boost::mutex::scoped_lock lock(m_stats_mutex);
+    *stats = m_stats;
+}
@@ -0,0 +1,99 @@
+/////////////////////////////////////////////////////////////////////////////
+// Measures the gaze stream loop's recovery from device disconnects, against
+// the stubbed stream engine. Disconnects of increasing duration are
+// injected while streaming, and for each the recovery latency (from the
+// link coming back up to the first sample after it) and the resulting gap
+// in samples are reported. Exits non-zero if any recovery takes >= 1s.
+//
+// Build and run with lib/sh/bench_device_stream.sh
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstring>
+#include <assert.h>
+
+#include <X11/Xlib.h>
+
+#include "app.h"
+#include "tobii_stub.h"
+#include "eyetracker_structdef.h"
+#include "gaze_trace.h"
+
+#define NO_ERROR TOBII_ERROR_NO_ERROR
+
+#include "device_stream.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define BENCH_N_DISCONNECTS 10
+#define BENCH_DOWN_STEP_US 50000        // Outage of the i'th disconnect * i
+#define BENCH_SETTLE_US 200000          // Streaming between disconnects
+#define BENCH_MAX_RECOVERY_US 1000000
+
+static atomic<int64_t> g_last_sample_us(0);
+static atomic<int64_t> g_n_samples(0);
+
+// Gaze data callback, denoting each sample's arrival time.
+static void cb_bench(tobii_gaze_data_t const*, void*) {
+    g_last_sample_us = tobii_stub_now_us();
+    g_n_samples++;
+}
+
+int main() {
+    DeviceStream stream;
+    tobii_device_t *device = tobii_stub_device();
+    int64_t max_recovery_us = 0;
+    int64_t sum_recovery_us = 0;
+
+    boost::thread streamer(
+        &DeviceStream::run, &stream, device, cb_bench, (void*)NULL);
+    boost::this_thread::sleep_for(boost::chrono::microseconds{BENCH_SETTLE_US});
+    assert(g_n_samples > 0);
+
+    printf("\n%10s %14s %14s\n", "down_ms", "recovery_ms", "gap_ms");
+
+    for (int i = 1; i <= BENCH_N_DISCONNECTS; i++) {
+        int64_t down_us = i * BENCH_DOWN_STEP_US;
+        int64_t last_before_us = g_last_sample_us;
+        int64_t link_up_us = tobii_stub_disconnect(down_us);
+
+        // Wait for the first sample after the link is back up
+        while (g_last_sample_us <= link_up_us &&
+               tobii_stub_now_us() < link_up_us + 10 * BENCH_MAX_RECOVERY_US)
+            boost::this_thread::sleep_for(boost::chrono::microseconds{100});
+
+        int64_t first_after_us = g_last_sample_us;
+        int64_t recovery_us = first_after_us - link_up_us;
+
+        printf("%10.1f %14.1f %14.1f\n",
+               down_us / 1000.0,
+               recovery_us / 1000.0,
+               (first_after_us - last_before_us) / 1000.0);
+
+        max_recovery_us = max(max_recovery_us, recovery_us);
+        sum_recovery_us += recovery_us;
+
+        boost::this_thread::sleep_for(
+            boost::chrono::microseconds{BENCH_SETTLE_US});
+    }
+
+    streamer.interrupt();
+    streamer.join();
+
+    device_conn_stats_t stats;
+    stream.stats(&stats);
+
+    printf("\nDisconnects: %ld, reconnect attempts: %ld\n",
+           (long)stats.n_disconnects, (long)stats.n_attempts);
+    printf("Recovery: mean %.1f ms, max %.1f ms\n",
+           sum_recovery_us / 1000.0 / BENCH_N_DISCONNECTS,
+           max_recovery_us / 1000.0);
+
+    return max_recovery_us < BENCH_MAX_RECOVERY_US ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+/////////////////////////////////////////////////////////////////////////////
+// A dwell-selection engine for the HUD's on-screen keyboard. Fed directly
+// by the gaze sample stream, it accumulates dwell time per key (by device
+// timestamp, so timing is accurate to the device's sample period) and
+// raises a GAZE_EVENT_KEY_SELECTED event once a key's dwell crosses the
+// configured threshold.
+//
+// Spatial hysteresis keeps the current key "held" while gaze remains within
+// its rect grown by the hysteresis margin, so jitter across a key border
+// does not reset dwell. Dwell on keys no longer looked at decays at the same
+// rate it accumulates, applied lazily on revisit, so per-sample cost is O(1)
+// regardless of key count. After a selection, no further selections occur
+// until the refractory period has elapsed.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define DWELL_MAX_SAMPLE_GAP_US 100000  // Dwell doesn't accrue over dropouts
+
+typedef struct dwell_key {
+        int64_t dwell_us;
+        int64_t last_seen_us;
+	    } dwell_key_t;
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class DwellSelect {
+    public:
+        void configure(int, int, int);
+        void reset(int);
+        bool is_enabled();
+        bool update(int64_t, int, int, int, HUDKeyMap*, gaze_event_t*);
+
+        DwellSelect();
+
+    protected:
+        int64_t m_dwell_us;
+        int64_t m_refractory_us;
+        int m_hysteresis_px;
+        int m_curr_key;
+        int64_t m_prev_us;
+        int64_t m_refractory_until_us;
+        vector<dwell_key_t> m_keys;
+};
+
+// Default constructor. Dwell selection is disabled until configure().
+DwellSelect::DwellSelect() {
+    m_dwell_us = 0;
+    m_refractory_us = 0;
+    m_hysteresis_px = 0;
+    reset(0);
+}
+
+// Sets the dwell threshold, hysteresis margin and refractory period. A
+// dwell_ms <= 0 disables dwell selection.
+void DwellSelect::configure(int dwell_ms, int hysteresis_px, int refractory_ms) {
+    m_dwell_us = (int64_t)dwell_ms * 1000;
+    m_hysteresis_px = max(0, hysteresis_px);
+    m_refractory_us = (int64_t)max(0, refractory_ms) * 1000;
+    reset(m_keys.size());
+}
+
+// Clears all dwell state, sized for the given number of keys.
+void DwellSelect::reset(int n_keys) {
+    m_curr_key = HUD_KEY_NONE;
+    m_prev_us = 0;
+    m_refractory_until_us = 0;
+    m_keys.assign(n_keys, dwell_key_t{0, 0});
+}
+
+// Returns true iff dwell selection is enabled.
+bool DwellSelect::is_enabled() {
+    return m_dwell_us > 0;
+}
+
+// Updates dwell state from a gaze sample at time t_us and display coords
+// (x, y), where key is the keymap's key under (x, y). If the sample
+// completes a selection, populates event and returns true.
+bool DwellSelect::update(int64_t t_us,
+                         int x,
+                         int y,
+                         int key,
+                         HUDKeyMap *keymap,
+                         gaze_event_t *event) {
+    if (!is_enabled())
+        return false;
+
+    // Resize state iff the keymap changed out from under us
+    if ((int)m_keys.size() != keymap->key_count())
+        reset(keymap->key_count());
+
+    // Apply hysteresis -- stay on the current key while near enough to it
+    hud_key_t rect;
+    if (key != m_curr_key && m_curr_key != HUD_KEY_NONE &&
+        keymap->key_rect(m_curr_key, &rect) &&
+        x >= rect.x - m_hysteresis_px &&
+        x < rect.x + rect.width + m_hysteresis_px &&
+        y >= rect.y - m_hysteresis_px &&
+        y < rect.y + rect.height + m_hysteresis_px)
+            key = m_curr_key;
+
+    // Time since prev sample, w/ dropouts not counting toward dwell
+    int64_t dt_us = m_prev_us > 0 ? t_us - m_prev_us : 0;
+    if (dt_us < 0 || dt_us > DWELL_MAX_SAMPLE_GAP_US)
+        dt_us = 0;
+    m_prev_us = t_us;
+
+    if (key == HUD_KEY_NONE) {
+        m_curr_key = HUD_KEY_NONE;
+        return false;
+    }
+
+    // On entering a key, lazily decay the dwell it held since last seen
+    dwell_key_t *k = &m_keys[key];
+    if (key != m_curr_key) {
+        k->dwell_us = max((int64_t)0, k->dwell_us - (t_us - k->last_seen_us));
+        m_curr_key = key;
+    } else {
+        k->dwell_us += dt_us;
+    }
+    k->last_seen_us = t_us;
+
+    if (k->dwell_us < m_dwell_us || t_us < m_refractory_until_us)
+        return false;
+
+    // Selection made
+    event->type = GAZE_EVENT_KEY_SELECTED;
+    event->key_idx = key;
+    event->unixtime_us = t_us;
+    event->duration_us = k->dwell_us;
+
+    k->dwell_us = 0;
+    m_refractory_until_us = t_us + m_refractory_us;
+
+    return true;
+}
@@ -21,6 +21,7 @@
 #include <boost/thread.hpp>
 
 #include "app.h"
+#include "calib_store.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -30,7 +31,9 @@ using namespace std::chrono;
 
 #define URL_MAX_LEN 256
 #define LIC_PATH "/opt/app/src/licenses/fast_aeye_typer_temp_se_license_key"
-#define CALIB_PATH "/opt/app/data/eyetracker.calib"
+#define CALIB_PATH "/opt/app/data/eyetracker.calib"   // Legacy, single-profile
+#define CALIB_STORE_PATH "/opt/app/data/eyetracker.calibs"
+#define CALIB_DEFAULT_PROFILE "default"
 #define CALIB_MAX_BYTES_SZ 400000
 #define NO_ERROR TOBII_ERROR_NO_ERROR
 
@@ -39,17 +42,27 @@ size_t read_license_file(uint16_t* license);
 void single_url_receiver(char const *url, void *user_data);
 void calibration_writer(void const* data, size_t size, void* user_data);
 
+typedef struct calib_write_ctx {
+        CalibrationStore *store;
+        const char *profile;
+        bool is_written;
+	    } calib_write_ctx_t;
+
 /////////////////////////////////////////////////////////////////////////////
 // Class
 
 class EyeTracker {
     public:
         EyeTracker();
+        EyeTracker(bool);
         ~EyeTracker();
         void sync_device_time();
         void print_device_info();
         void print_feature_group();
-        void calibration_write();
+        bool calibration_write(const char* = CALIB_DEFAULT_PROFILE);
+        bool calibration_apply(const char* = CALIB_DEFAULT_PROFILE);
+        bool calibration_remove(const char*);
+        int calibration_profiles(char*, int);
         int64_t devicetime_to_systime(int64_t);
 
     protected:
@@ -57,6 +70,9 @@ class EyeTracker {
         tobii_device_t *m_device;
         tobii_api_t *m_api;
         bool m_is_elevated;
+        CalibrationStore m_calibs;
+        shared_ptr<boost::mutex> m_calib_mutex;
+        void open_device();
         void set_display(float, float, float);
         void calibration_load();
     
@@ -65,7 +81,30 @@ class EyeTracker {
 };
 
 // Default constructor
-EyeTracker::EyeTracker() {
+EyeTracker::EyeTracker() : EyeTracker(True) {}
+
+// Constructor. If is_opened, the device is opened and its calibration loaded,
+// else the derived class is responsible for calling open_device() and
+// calibration_load(), e.g. concurrently w/ its own initialization.
+EyeTracker::EyeTracker(bool is_opened) {
+    // Set default states
+    m_device = NULL;
+    m_api = NULL;
+    m_is_elevated = False;
+    m_calib_mutex = make_shared<boost::mutex>();
+    m_async_time_syncer = NULL;
+    m_device_time_offset = 0;
+
+    if (is_opened) {
+        open_device();
+
+        // Load the default calibration profile -- if no exist, will warn
+        calibration_load();
+    }
+}
+
+// Opens the first eyetracker device found, elevated if licensed.
+void EyeTracker::open_device() {
     // Instantiate eyetracker api
     assert(tobii_api_create(&m_api, NULL, NULL) == NO_ERROR);
 
@@ -114,13 +153,6 @@ EyeTracker::EyeTracker() {
         info("Using elevated eyetracking device.\n");
         m_is_elevated = True;
     }
-
-    // Load calibration from file -- if no exist, will warn
-    calibration_load();
-    
-    // Set default states
-    m_async_time_syncer = NULL;
-    m_device_time_offset = 0;
 }
 
 // Destructor
@@ -269,64 +301,117 @@ void EyeTracker::set_display(float width_mm, float height_mm, float offset_x_mm)
     assert(error == NO_ERROR );
 }
 
-// Requests that the eyetracker's calibration be written to file
-void EyeTracker::calibration_write() {
-    tobii_error_t error;
-    void *v;
+// Requests that the eyetracker's calibration be written to the calibration
+// store as the given profile, replacing any existing profile of that name.
+// Returns false on failure.
+bool EyeTracker::calibration_write(const char *profile) {
+    boost::mutex::scoped_lock lock(*m_calib_mutex);
+    calib_write_ctx_t ctx = {&m_calibs, profile, False};
 
-    error = tobii_calibration_retrieve(m_device, calibration_writer, v);
+    tobii_error_t error = tobii_calibration_retrieve(
+        m_device, calibration_writer, &ctx);
     assert(error == NO_ERROR );
+
+    return ctx.is_written;
 }
 
-// Sets the eyetracker's calibration from file
-void EyeTracker::calibration_load() {
-    tobii_error_t error;
+// Sets the eyetracker's calibration from the given profile of the
+// calibration store. The profile's blob is handed to the device directly from
+// the store's mapping, so switching profiles (e.g. users) needs no file reads
+// or buffers. Returns false on failure.
+bool EyeTracker::calibration_apply(const char *profile) {
+    boost::mutex::scoped_lock lock(*m_calib_mutex);
+    const void *data;
     size_t size;
-    void *data[CALIB_MAX_BYTES_SZ];
 
-    // Load calibration data from file
-    fstream f(CALIB_PATH, ios::in | ios::binary);
-    
-    // Ensure file exists
-    if (!f) {
-        warn("Calibration load failed. Please calibrate your device with ");
+    if (!m_calibs.find(profile, &data, &size)) {
+        warn("Calibration load failed. ");
+        printf("No profile '%s'. Please calibrate your device with ", profile);
         printf("'./aeye_typer.py --calibrate'. This error may be ignored if ");
         printf("encountered during calibration.\n");
-        return;
+        return False;
     }
 
-    // Read up to max bytes
-    f.read((char*)data, CALIB_MAX_BYTES_SZ);
-    size = f.gcount();
-    f.close();
-
     // Apply the calibration data
-    error = tobii_calibration_apply(m_device, data, size);
+    auto t_start = steady_clock::now();
+    tobii_error_t error = tobii_calibration_apply(m_device, data, size);
+
     if (error != NO_ERROR) {
         if (error == TOBII_ERROR_INSUFFICIENT_LICENSE)
             warn("Calibration load failed (insufficient license).\n");
         else
             warn("Calibration load failed (unknown reason).\n");
-    } else {
-        info("Calibration loaded successfully.\n");
+        return False;
     }
+
+    info("Calibration loaded successfully ");
+    printf("(profile '%s', %.1f ms).\n",
+           profile,
+           duration_cast<microseconds>(steady_clock::now() - t_start).count() /
+              1000.0);
+
+    return True;
+}
+
+// Removes the given profile from the calibration store. Does not affect the
+// device's current calibration. Returns false if no such profile.
+bool EyeTracker::calibration_remove(const char *profile) {
+    boost::mutex::scoped_lock lock(*m_calib_mutex);
+
+    return m_calibs.remove(profile);
+}
+
+// Writes the calibration store's profile names to out, newline-separated, as
+// a null-terminated string of at most out_sz bytes. Returns the number of
+// names written.
+int EyeTracker::calibration_profiles(char *out, int out_sz) {
+    boost::mutex::scoped_lock lock(*m_calib_mutex);
+
+    return m_calibs.list(out, out_sz);
+}
+
+// Opens the calibration store, importing the legacy single-profile
+// calibration file as the default profile if the store doesn't have one,
+// then applies the default profile.
+void EyeTracker::calibration_load() {
+    {
+        boost::mutex::scoped_lock lock(*m_calib_mutex);
+        const void *data;
+        size_t size;
+
+        m_calibs.open(CALIB_STORE_PATH);
+
+        fstream f(CALIB_PATH, ios::in | ios::binary | ios::ate);
+
+        if (f && !m_calibs.find(CALIB_DEFAULT_PROFILE, &data, &size)) {
+            vector<char> legacy(f.tellg());
+            f.seekg(0);
+            f.read(legacy.data(), legacy.size());
+
+            if (f && m_calibs.put(
+                    CALIB_DEFAULT_PROFILE, legacy.data(), legacy.size()))
+                info("Imported legacy calibration file as default profile.\n");
+        }
+    }
+
+    calibration_apply(CALIB_DEFAULT_PROFILE);
 }
 
 /////////////////////////////////////////////////////////////////////////////
 // Misc Helpers
 
-// Callback for writing eyetracker device calibration to file
-void calibration_writer(void const* data, size_t size, void* _) {
+// Callback for writing eyetracker device calibration to the calibration
+// store, as denoted by user_data (a calib_write_ctx_t).
+void calibration_writer(void const* data, size_t size, void* user_data) {
+    calib_write_ctx_t *ctx = (calib_write_ctx_t*)user_data;
+
     // Ensure reasonable size
     if (size >= CALIB_MAX_BYTES_SZ) {
         error("Calibration write failed - Data sz outside expected bounds.\n");
         return;
     }
 
-    // Write calibration data to file
-    fstream f(CALIB_PATH, ios::out | ios::binary);
-    f.write((char*)data, size);
-    f.close();
+    ctx->is_written = ctx->store->put(ctx->profile, data, size);
 }
 
 // Syncs eyetracker device time w/ system clock every 30s until interrupted
@@ -10,6 +10,7 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <fstream>
+#include <set>
 
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
@@ -21,7 +22,31 @@
 
 #include "eyetracker.h"
 #include "eyetracker_structdef.h"
+#include "gaze_trace.h"
+#include "gaze_probes.h"
+#include "hud_keymap.h"
+#include "gaze_events.h"
+#include "dwell_select.h"
+#include "keystroke_inject.h"
+#include "word_trie.h"
+#include "gaze_heatmap.h"
+#include "gaze_aoi.h"
+#include "gaze_history.h"
+#include "gaze_gorilla.h"
+#include "gaze_quality.h"
+#include "blink_detect.h"
+#include "startup_exec.h"
+#include "device_stream.h"
+#include "gaze_pack.h"
+#include "gaze_ring.h"
+#include "gaze_log.h"
+#include "gaze_index.h"
+#include "gaze_gaps.h"
+#include "gaze_convert.h"
+#include "gaze_csv.h"
 #include "py_objs.cpp"
+#include "gaze_smooth.h"
+#include "gaze_replay.h"
 
 using namespace std;
 
@@ -33,10 +58,21 @@ using namespace std;
 #define GAZE_MARKER_BORDER 0
 #define GAZE_MARKER_BORDER 0
 #define MOUNT_OFFSET_MM 1.5  // TODO: Move to conf
-
-typedef boost::circular_buffer<shared_ptr<gaze_data_t>> circ_buff;
-
-void do_gazestream_subscribe(tobii_device_t*, void*);
+#define GAZE_FLAG_GAP 0x1   // Samples were lost before this one
+#define GAZE_MAX_LABELS 256 // Interned export labels, before they're reset
+
+// Ingest field modes. Timestamp, combined gaze point, validity and flags are
+// always ingested; each mode adds the field groups its consumers need.
+#define GAZE_FIELD_EYEPOS 0x1       // Eye positions, e.g. for the pos guide
+#define GAZE_FIELD_EYE_DETAIL 0x2   // All other per-eye fields
+#define GAZE_FIELD_PACKED 0x4       // Buffer all fields, packed (gaze_pack.h)
+#define GAZE_FIELDS_MINIMAL 0
+#define GAZE_FIELDS_HUD GAZE_FIELD_EYEPOS
+#define GAZE_FIELDS_ML (GAZE_FIELD_EYEPOS | GAZE_FIELD_EYE_DETAIL)
+#define GAZE_FIELDS_FULL (GAZE_FIELD_EYEPOS | GAZE_FIELD_EYE_DETAIL)
+#define GAZE_FIELDS_PACKED (GAZE_FIELDS_FULL | GAZE_FIELD_PACKED)
+
+size_t gaze_record_sz(int);
 static void cb_gaze_data(tobii_gaze_data_t const*, void*);
 XColor createXColorFromRGBA(void*, short, short, short, short);
 
@@ -56,16 +92,51 @@ class EyeTrackerGaze : public EyeTracker {
 
         void start();
         void stop();
-        int gaze_data_tocsv(const char*, int, boost::shared_ptr<char>);
+        const char* intern_label(const char*);
+        int gaze_data_tocsv(const char*, int, const char*);
+        int gaze_data_tolog(const char*, int, const char*);
         bool is_gaze_valid();
-        void enque_gaze_data(shared_ptr<gaze_data_t>);
+        void stage_gaze_data(tobii_gaze_data_t const*);
+        void ingest_staged_all();
+        void enque_gaze_data(gaze_data_t*);
+        void enque_gaze_invalid(int64_t);
         void print_gaze_data();
         int gaze_data_sz();
         int disp_x_from_normed_x(float);
         int disp_y_from_normed_y(float);
         gaze_point_t* get_gazepoint_smoothed(gaze_point_t *gp);
-        void set_gaze_marker(shared_ptr<gaze_data_t>);
+        void set_gaze_marker();
         void set_cursor_capture(bool);
+        bool set_fields(int);
+        int load_keymap(const char*, int, int, int, int);
+        int gaze_key();
+        void set_dwell(int, int, int);
+        int event_fd();
+        bool next_event(gaze_event_t*);
+        int64_t inject_text(const char*, unsigned int);
+        int64_t inject_keysym(unsigned long, unsigned int);
+        int load_completions(const char*);
+        int completions(const char*, int, char*, int);
+        void set_heatmap(int, float, int);
+        float* heatmap(int*, int*, int*);
+        int add_aoi(int, int, int, int);
+        bool remove_aoi(int);
+        int aoi_stats(aoi_stats_t*, int);
+        void reset_aoi_stats();
+        void set_history(size_t);
+        int gaze_history(int64_t, int64_t, gaze_agg_t*, int, int64_t*);
+        void set_cold_history(size_t, int);
+        bool cold_history_stats(gaze_cold_stats_t*);
+        void set_quality(int, float, float, float);
+        void quality(gaze_quality_t*);
+        void reset_quality();
+        void validity_counts(int64_t*);
+        int64_t blink_count();
+        int startup_timeline(startup_stage_t*, int, int64_t*);
+        void connection_stats(device_conn_stats_t*);
+        void set_sample_rate(float);
+        int gaps(gaze_gap_t*, int);
+        int64_t n_lost();
 
         EyeTrackerGaze(
             float, float, int, int, int, int, int, const char*, const char*);
@@ -78,13 +149,50 @@ class EyeTrackerGaze : public EyeTracker {
         int m_smooth_over;
         bool m_use_ml;
         bool m_capture_cursor;
-        shared_ptr<circ_buff> m_gaze_buff;
+        int m_gaze_key;
+        int m_fields;
+        shared_ptr<GazeRing> m_gaze_buff;
+        shared_ptr<HUDKeyMap> m_keymap;
+        shared_ptr<GazeEventQueue> m_events;
+        DwellSelect m_dwell;
+        GazeQuality m_quality;
+        BlinkDetect m_blinks;
+        int64_t m_validity_counts[GAZE_VALID_BOTH + 1];
+        shared_ptr<KeystrokeInject> m_keystrokes;
+        shared_ptr<WordTrie> m_trie;
+        shared_ptr<GazeHeatmap> m_heatmap;
+        shared_ptr<AOIRegistry> m_aois;
+        shared_ptr<GazeHistory> m_history;
+        shared_ptr<GazeColdStore> m_cold;
+        vector<startup_stage_t> m_startup_timeline;
+        int64_t m_startup_us;
+        shared_ptr<DeviceStream> m_stream;
+        bool m_is_gap_pending;
+        uint32_t m_seq;                         // The next sample's seq
+        shared_ptr<GazeGapLog> m_gaps;
+        vector<tobii_gaze_data_t> m_staged;     // Raw samples awaiting ingest
+        int m_n_staged;
+        gaze_points_t m_staged_pts;
+        gaze_convert_fn_t m_convert;
+        void (EyeTrackerGaze::*m_ingest)();     // Per the field mode
+
+        void init_overlay();
+        shared_ptr<GazeRing> take_gaze_buff();
+        bool lock_with_cold();
+        void drain_cold(shared_ptr<GazeColdStore> const&);
+        template <int Fields>
+        void ingest_staged();
 
     private:
         EyeTrackerCoordPredict *m_x_ml, *m_y_ml;
         shared_ptr<boost::thread> m_async_streamer;
-        shared_ptr<boost::thread> m_async_writer;
         shared_ptr<boost::mutex> m_async_mutex;
+        shared_ptr<boost::mutex> m_cold_mutex;  // Taken after m_async_mutex
+        vector<gaze_data_t> m_cold_pending;     // Evicted, w/ m_async_mutex
+        vector<gaze_data_t> m_cold_draining;    // Same, w/ m_cold_mutex
+        shared_ptr<boost::thread> m_async_writer;
+        set<string> m_labels;               // Interned export labels
+        shared_ptr<boost::mutex> m_writer_mutex;    // Guards the above two
 };
 
 // Default constructor
@@ -96,7 +204,8 @@ EyeTrackerGaze::EyeTrackerGaze(float disp_width_mm,
                                int buff_sz,
                                int smooth_over,
                                const char *ml_x_path=NULL,
-                               const char *ml_y_path=NULL) {
+                               const char *ml_y_path=NULL)
+                               : EyeTracker(False) {
         // Init members from args
         m_disp_width = disp_width_px;
         m_disp_height = disp_height_px;
@@ -104,15 +213,13 @@ EyeTrackerGaze::EyeTrackerGaze(float disp_width_mm,
         m_buff_sz = buff_sz;
         m_smooth_over = smooth_over;
 
-        // Calibrate gaze tracker's disp area
-        set_display(disp_width_mm, disp_height_mm, MOUNT_OFFSET_MM);
-
-        // Since we care about device timestamps, start time synchronization
-        sync_device_time();
-
         // Init circular gaze data buffer and mutex 
-        m_gaze_buff = make_shared<circ_buff>(buff_sz); 
+        m_fields = GAZE_FIELDS_FULL;
+        m_gaze_buff = make_shared<GazeRing>(
+            buff_sz, gaze_record_sz(m_fields), m_fields & GAZE_FIELD_PACKED);
         m_async_mutex = make_shared<boost::mutex>();
+        m_cold_mutex = make_shared<boost::mutex>();
+        m_writer_mutex = make_shared<boost::mutex>();
 
         // Set default tracker states
         m_mark_count = 0;
@@ -120,9 +227,118 @@ EyeTrackerGaze::EyeTrackerGaze(float disp_width_mm,
         m_pos_guide_y = 0.0;
         m_pos_guide_z = 0.0;
         m_capture_cursor = False;
+        m_gaze_key = HUD_KEY_NONE;
+        m_keymap = make_shared<HUDKeyMap>();
+        m_events = make_shared<GazeEventQueue>();
+        m_keystrokes = make_shared<KeystrokeInject>();
+        m_trie = make_shared<WordTrie>();
+        m_heatmap = NULL;
+        m_aois = make_shared<AOIRegistry>(disp_width_px, disp_height_px);
+        m_history = NULL;
+        memset(m_validity_counts, 0, sizeof(m_validity_counts));
+        m_cold = NULL;
         m_async_writer = NULL;
         m_async_streamer = NULL;
+        m_x_ml = NULL;
+        m_y_ml = NULL;
+        m_use_ml = False;
+        m_is_gap_pending = False;
+        m_seq = 0;
+        m_gaps = make_shared<GazeGapLog>();
+
+        // Raw samples are staged then converted in batches, by the fastest
+        // conversion kernel the CPU supports
+        m_staged.resize(GAZE_CONVERT_MAX);
+        m_n_staged = 0;
+        m_convert = gaze_convert_select();
+        m_ingest = &EyeTrackerGaze::ingest_staged<GAZE_FIELDS_FULL>;
+
+        // On device connection loss and restore, notify consumers and mark
+        // the gap on the next sample
+        m_stream = make_shared<DeviceStream>();
+        m_stream->set_handlers(
+            [this](int64_t lost_us) {
+                m_events->push(gaze_event_t{
+                    GAZE_EVENT_DISCONNECTED, HUD_KEY_NONE, lost_us, 0});
+            },
+            [this](int64_t lost_us, int64_t outage_us) {
+                m_gaps->disconnected(m_seq, lost_us, outage_us);
+
+                m_async_mutex->lock();
+                m_is_gap_pending = True;
+                m_async_mutex->unlock();
+
+                m_events->push(gaze_event_t{
+                    GAZE_EVENT_RECONNECTED, HUD_KEY_NONE, lost_us, outage_us});
+            });
+        m_stream->set_drained_handler([this]() { ingest_staged_all(); });
+
+        // The device chain, X11 overlay and ML models are independent of
+        // each other, so are initialized concurrently. Device calls are kept
+        // to a single chain, as the device API isn't thread-safe per device.
+        StartupExecutor startup;
+
+        int device = startup.add("device", [this]() {
+            open_device(); });
+
+        int calib = startup.add("calibration", [this]() {
+            calibration_load(); }, {device});
+
+        int disp_area = startup.add("display_area", [=]() {
+            set_display(disp_width_mm, disp_height_mm, MOUNT_OFFSET_MM);
+            }, {calib});
+
+        // Since we care about device timestamps, start time synchronization
+        startup.add("timesync", [this]() {
+            sync_device_time(); }, {disp_area});
 
+        startup.add("x11_overlay", [this]() {
+            init_overlay(); });
+
+        // Instantiate the gaze coord acc improvement models iff given. They
+        // are Python objs, so are created on the calling (Python's) thread
+        if (ml_x_path != NULL && ml_y_path != NULL) {
+            startup.add_on_caller("ml_models", [=]() {
+                m_x_ml = new EyeTrackerCoordPredict(ml_x_path);
+                m_y_ml = new EyeTrackerCoordPredict(ml_y_path);
+                m_use_ml = True;
+                info("Using ML gaze accuracy-assist.\n");
+            });
+        }
+
+        startup.run();
+
+        m_startup_timeline.resize(startup.timeline(NULL, 0));
+        startup.timeline(m_startup_timeline.data(), m_startup_timeline.size());
+        m_startup_us = startup.elapsed_us();
+}
+
+// Populates stats with the device connection's statistics, e.g. its
+// number of disconnects and the duration of its last outage.
+void EyeTrackerGaze::connection_stats(device_conn_stats_t *stats) {
+    m_stream->stats(stats);
+}
+
+// Sets the device's nominal sample rate, in Hz, against which samples lost
+// on the device side are detected from sample timestamps. If 0, they're not.
+void EyeTrackerGaze::set_sample_rate(float sample_hz) {
+    m_gaps->set_interval(sample_hz > 0 ? 1000000 / sample_hz : 0);
+}
+
+// Populates out w/ (at most) the n most recent gaps in samples (from device
+// side loss, connection outages or buffer overwrites), oldest first. Returns
+// the number populated, or if out is NULL the number of gaps logged.
+int EyeTrackerGaze::gaps(gaze_gap_t *out, int n) {
+    return m_gaps->gaps(out, n);
+}
+
+// Returns the number of samples lost, over all gaps.
+int64_t EyeTrackerGaze::n_lost() {
+    return m_gaps->n_lost();
+}
+
+// Opens the X11 display and creates the gaze marker overlay window on it.
+void EyeTrackerGaze::init_overlay() {
         // Init X11 display
         m_disp = XOpenDisplay(NULL);
         Window root_win = DefaultRootWindow(m_disp);
@@ -165,20 +381,32 @@ EyeTrackerGaze::EyeTrackerGaze(float disp_width_mm,
         );
 
         XMapWindow(m_disp, m_overlay);
+        XFlush(m_disp);
+}
 
-        // Instantiate the gaze coord acc improvement models iff given
-        if (ml_x_path != NULL && ml_y_path != NULL) {
-            m_x_ml = new EyeTrackerCoordPredict(ml_x_path);
-            m_y_ml = new EyeTrackerCoordPredict(ml_y_path);
-            m_use_ml = True;
-            info("Using ML gaze accuracy-assist.\n");
-        } else {
-            m_use_ml = False;
-        }
+// Copies to out (at most) n stages of the constructor's startup timeline,
+// and sets total_us to the startup's total wall time. Returns the total
+// number of stages.
+int EyeTrackerGaze::startup_timeline(startup_stage_t *out,
+                                     int n,
+                                     int64_t *total_us) {
+    int n_stages = m_startup_timeline.size();
+
+    for (int i = 0; i < min(n, n_stages); i++)
+        out[i] = m_startup_timeline[i];
+    *total_us = m_startup_us;
+
+    return n_stages;
 }
 
 // Destructor
 EyeTrackerGaze::~EyeTrackerGaze() {
+    // A pending export may reference an interned label
+    m_writer_mutex->lock();
+    if (m_async_writer)
+        m_async_writer->join();
+    m_writer_mutex->unlock();
+
     XUnmapWindow(m_disp, m_overlay);
     XFlush(m_disp);
     XCloseDisplay(m_disp);
@@ -189,8 +417,14 @@ void EyeTrackerGaze::start() {
     if (m_async_streamer) {
         warn("Gaze stream start attempted but already running.");
     } else {
+        m_n_staged = 0;
+        m_gaps->restart();
         m_async_streamer = make_shared<boost::thread>(
-            do_gazestream_subscribe, m_device, this
+            &DeviceStream::run,
+            m_stream.get(),
+            m_device,
+            cb_gaze_data,
+            this
         );
     }
 }
@@ -205,23 +439,104 @@ void EyeTrackerGaze::stop() {
     }
 
     // Wait for writer thread to finish its current write
+    m_writer_mutex->lock();
     if (m_async_writer) {
         m_async_writer->join();
         m_async_writer = NULL;
     }
+    m_writer_mutex->unlock();
+}
+
+// Returns the circ buff, replacing it with an empty one, for export.
+shared_ptr<GazeRing> EyeTrackerGaze::take_gaze_buff() {
+    // Copy circ buff contents then (effectively) clear it
+    bool is_cold_locked = lock_with_cold();
+    shared_ptr<GazeRing> gaze_buff = m_gaze_buff;
+    m_gaze_buff = make_shared<GazeRing>(
+        m_buff_sz, gaze_buff->record_sz(), gaze_buff->is_packed());
+    shared_ptr<GazeColdStore> cold = m_cold;
+
+    if (!is_cold_locked) {
+        m_async_mutex->unlock();
+        return gaze_buff;
+    }
+
+    // Samples leaving the buffer are retained in cold history, after those
+    // evicted before it. They're compressed w/ only the cold history
+    // locked, so ingest isn't stalled. It's locked before release so
+    // readers never miss them in between.
+    m_cold_draining.swap(m_cold_pending);
+    m_async_mutex->unlock();
+    drain_cold(cold);
+
+    gaze_data_t cgd;
+
+    for (int j = 0; j < gaze_buff->size(); j++) {
+        gaze_buff->at(j, &cgd);
+        cold->append(cgd);
+    }
+    m_cold_mutex->unlock();
+
+    return gaze_buff;
+}
+
+// Appends the samples evicted from the buffer (and swapped out of
+// m_cold_pending) to the given cold history, oldest first.
+// ASSUMES: m_cold_mutex is held.
+void EyeTrackerGaze::drain_cold(shared_ptr<GazeColdStore> const &cold) {
+    for (auto &cgd : m_cold_draining)
+        cold->append(cgd);
+
+    m_cold_draining.clear();
+}
+
+// Locks m_async_mutex and, iff cold history is enabled, m_cold_mutex. Never
+// waits on m_cold_mutex (e.g. while take_gaze_buff() compresses) holding
+// m_async_mutex, so ingest isn't stalled meanwhile. Returns true iff
+// m_cold_mutex was locked.
+bool EyeTrackerGaze::lock_with_cold() {
+    while (true) {
+        m_async_mutex->lock();
+        if (!m_cold)
+            return false;
+        if (m_cold_mutex->try_lock())
+            return true;
+        m_async_mutex->unlock();
+
+        // Wait for the holder to finish, then retry
+        m_cold_mutex->lock();
+        m_cold_mutex->unlock();
+    }
+}
+
+// Returns the interned copy of the given export label, so exports may share
+// it w/ their writer threads rather than each copying it. Returns NULL if
+// label is NULL. Once GAZE_MAX_LABELS distinct labels are interned, the next
+// new one resets them, after waiting for any pending export (the only
+// holder of a previously returned copy), so the set stays bounded.
+const char* EyeTrackerGaze::intern_label(const char *label) {
+    if (!label)
+        return NULL;
+
+    boost::mutex::scoped_lock lock(*m_writer_mutex);
+
+    if (m_labels.size() >= GAZE_MAX_LABELS && !m_labels.count(label)) {
+        if (m_async_writer)
+            m_async_writer->join();
+        m_labels.clear();
+    }
+
+    return m_labels.insert(label).first->c_str();
 }
 
 // Writes the gaze data to the given csv file path, creating it if exists 
 // else appending to it. If n is given, writes only the most recent n samples.
 // Returns an int representing the number of samples written. If label given,
 // appends the given cstring to each csv row written.
+// ASSUMES: label, if given, is interned (see intern_label()).
 int EyeTrackerGaze::gaze_data_tocsv(
-    const char *file_path, int n=0, boost::shared_ptr<char> label=NULL) {
-    // Copy circ buff contents then (effectively) clear it
-    m_async_mutex->lock();
-    shared_ptr<circ_buff> gaze_buff = m_gaze_buff;
-    m_gaze_buff = make_shared<circ_buff>(m_buff_sz);
-    m_async_mutex->unlock();
+    const char *file_path, int n=0, const char *label=NULL) {
+    shared_ptr<GazeRing> gaze_buff = take_gaze_buff();
 
     // Get buff content count and return if empty
     int sample_count = gaze_buff->size();
@@ -232,7 +547,10 @@ int EyeTrackerGaze::gaze_data_tocsv(
     if (n == 0)
         n = sample_count;
 
-    // Ensure any previous async write job has finished
+    // Ensure any previous async write job has finished, holding the writer
+    // (w/ intern_label()) until this one is started
+    boost::mutex::scoped_lock lock(*m_writer_mutex);
+
     if (m_async_writer) {
         m_async_writer->join();
     }
@@ -240,15 +558,27 @@ int EyeTrackerGaze::gaze_data_tocsv(
     // Write the gaze data to file asynchronously
     m_async_writer = make_shared<boost::thread>(
         [file_path, gaze_buff, n, label]() {
+            g_gaze_trace.name_thread("gaze_writer");
+            GazeTraceScope trace("write_csv");
+
             ofstream f, f2;
             f.open(file_path, fstream::in | fstream::out | fstream::app);
 
             // Write (at most) the n latest samples to csv in ascending order
             int sz = gaze_buff->size();
             int n_capped = min(sz, n);
+            GAZE_PROBE3(export_start, GAZE_PROBE_EXPORT_CSV, n_capped, file_path);
+
+            gaze_data_t cgd;
 
             for (int j = sz - n_capped; j < sz; j++)  {
-                auto cgd = *gaze_buff->at(j); 
+                gaze_buff->at(j, &cgd);
+
+                // Monocular samples are omitted, since their other eye's
+                // fields are not meaningful
+                if (cgd.validity != GAZE_VALID_BOTH)
+                    continue;
+
                 f << 
                     cgd.unixtime_us << ", " <<
                     cgd.left_pupildiameter_mm << ", " <<
@@ -284,52 +614,263 @@ int EyeTrackerGaze::gaze_data_tocsv(
                     cgd.combined_gazepoint_x << ", " <<
                     cgd.combined_gazepoint_y;
                     
-                if (label != NULL)
+                if (label)
                     f << ", " << label;
                 
                 f << "\n";
             }
 
             f.close();
+            gaze_trace_counter("written", n_capped);
+            GAZE_PROBE3(export_end, GAZE_PROBE_EXPORT_CSV, n_capped, file_path);
         }
     );
 
     return sample_count;
 }
 
-// Enques gaze data into the circular buffer as well as updates user pos members
-void EyeTrackerGaze::enque_gaze_data(shared_ptr<gaze_data_t> cgd) {
-    // Engue the given gaze data
-    m_async_mutex->lock();
-    m_gaze_buff->push_back(cgd);
+// Writes the gaze data to the binary gaze log at the given path (see
+// gaze_log.h), creating it if missing else appending to it. If n is given,
+// writes only the most recent n samples. Unlike gaze_data_tocsv(), monocular
+// samples are also written, w/ their validity. If label is given, the
+// samples are labeled w/ it in the log's label dictionary. The log's index
+// (see gaze_index.h) is then updated. Returns the number of samples in the
+// buffer.
+// ASSUMES: label, if given, is interned (see intern_label()).
+int EyeTrackerGaze::gaze_data_tolog(
+    const char *file_path, int n=0, const char *label=NULL) {
+    shared_ptr<GazeRing> gaze_buff = take_gaze_buff();
+
+    // Get buff content count and return if empty
+    int sample_count = gaze_buff->size();
+    if (sample_count <= 0)
+        return 0;
+
+    // n == 0 denotes write entire buff contents
+    if (n == 0)
+        n = sample_count;
+
+    // Ensure any previous async write job has finished, holding the writer
+    // (w/ intern_label()) until this one is started
+    boost::mutex::scoped_lock lock(*m_writer_mutex);
+
+    if (m_async_writer) {
+        m_async_writer->join();
+    }
+
+    // Write the gaze data to file asynchronously
+    string log_path = file_path;
+    int disp_width = m_disp_width;
+    int disp_height = m_disp_height;
+
+    m_async_writer = make_shared<boost::thread>(
+        [log_path, gaze_buff, n, label, disp_width, disp_height]() {
+            g_gaze_trace.name_thread("gaze_writer");
+            GazeTraceScope trace("write_log");
+
+            GazeLogWriter log;
+            if (!log.open(log_path.c_str()))
+                return;
+
+            log.set_label(label);
+
+            // Write (at most) the n latest samples in ascending order
+            int sz = gaze_buff->size();
+            gaze_data_t cgd;
+            GAZE_PROBE3(export_start,
+                        GAZE_PROBE_EXPORT_LOG, min(sz, n), log_path.c_str());
+
+            for (int j = sz - min(sz, n); j < sz; j++) {
+                gaze_buff->at(j, &cgd);
+                log.append(cgd);
+            }
+
+            log.close();
+            GazeIndex::update(log_path.c_str(), disp_width, disp_height);
+            gaze_trace_counter("written", min(sz, n));
+            GAZE_PROBE3(export_end,
+                        GAZE_PROBE_EXPORT_LOG, min(sz, n), log_path.c_str());
+        }
+    );
+
+    return sample_count;
+}
+
+// Stages the given raw gaze sample for ingest, ingesting the staged batch if
+// full. Called on the stream thread only.
+void EyeTrackerGaze::stage_gaze_data(tobii_gaze_data_t const *data) {
+    GAZE_PROBE3(sample,
+                m_seq + m_n_staged,
+                data->timestamp_tracker_us,
+                data->timestamp_system_us);
+    m_staged[m_n_staged++] = *data;
+
+    if (m_n_staged == GAZE_CONVERT_MAX)
+        ingest_staged_all();
+}
+
+// Ingests all staged raw gaze samples, if any, per the field mode. Called on
+// the stream thread only.
+void EyeTrackerGaze::ingest_staged_all() {
+    if (m_n_staged)
+        (this->*m_ingest)();
+}
+
+// Enques gaze data into the circular buffer as well as updates user pos and
+// key-under-gaze members, and feeds the dwell-selection engine, heatmap, AOI
+// counters, history tiers and quality monitor. Only the fields of the
+// current field mode are buffered.
+void EyeTrackerGaze::enque_gaze_data(gaze_data_t *cgd) {
+    gaze_event_t event;
+    gaze_event_t quality_event;
+    gaze_event_t blink_event;
+
+    // Engue the given gaze data and denote the HUD key it falls on, if any
+    {
+        GazeTraceScope trace("enque_lock");
+        m_async_mutex->lock();
+    }
+
+    if (m_cold && m_gaze_buff->full()) {
+        // Oldest retained in cold history, once drained to it (below)
+        m_cold_pending.emplace_back();
+        m_gaze_buff->at(0, &m_cold_pending.back());
+    } else if (m_gaze_buff->full()) {
+        // Oldest lost, as not yet exported nor retained in cold history
+        m_gaps->overwritten(
+            m_gaze_buff->seq_at(0), m_gaze_buff->unixtime_us_at(0));
+    }
+
+    if (m_is_gap_pending) {
+        cgd->flags |= GAZE_FLAG_GAP;
+        m_is_gap_pending = False;
+    }
+
+    m_gaze_buff->push_back(*cgd);
+    GAZE_PROBE5(enque,
+                cgd->seq,
+                cgd->unixtime_us,
+                cgd->combined_gazepoint_x,
+                cgd->combined_gazepoint_y,
+                cgd->flags);
+    m_gaze_key = m_keymap->key_at(
+        cgd->combined_gazepoint_x, cgd->combined_gazepoint_y);
+    bool is_selected = m_dwell.update(cgd->unixtime_us,
+                                      cgd->combined_gazepoint_x,
+                                      cgd->combined_gazepoint_y,
+                                      m_gaze_key,
+                                      m_keymap.get(),
+                                      &event);
+
+    if (m_heatmap)
+        m_heatmap->splat(cgd->unixtime_us,
+                         cgd->combined_gazepoint_x,
+                         cgd->combined_gazepoint_y);
+
+    m_aois->update(cgd->unixtime_us,
+                   cgd->combined_gazepoint_x,
+                   cgd->combined_gazepoint_y);
+
+    if (m_history)
+        m_history->update(cgd->unixtime_us,
+                          cgd->combined_gazepoint_x,
+                          cgd->combined_gazepoint_y);
+
+    bool is_degraded = m_quality.update(cgd->unixtime_us,
+                                        cgd->validity & GAZE_VALID_LEFT,
+                                        cgd->validity & GAZE_VALID_RIGHT,
+                                        cgd->combined_gazepoint_x,
+                                        cgd->combined_gazepoint_y,
+                                        &quality_event);
+    bool is_blink = m_blinks.update(
+        cgd->unixtime_us, cgd->validity, &blink_event);
+    m_validity_counts[cgd->validity & GAZE_VALID_BOTH]++;
+
+    // Drain evicted samples to cold history, never waiting on it (e.g.
+    // while an export compresses or a history read scans it). If it's busy
+    // they stay pending, to be drained by the next sample, export or read.
+    shared_ptr<GazeColdStore> cold = NULL;
+
+    if (!m_cold_pending.empty() && m_cold_mutex->try_lock()) {
+        cold = m_cold;
+        m_cold_draining.swap(m_cold_pending);
+    }
     m_async_mutex->unlock();
 
-    // Update user position guide from given gaze data
-    m_pos_guide_x = (
-        cgd->left_eyeposition_normed_x + cgd->right_eyeposition_normed_x) / 2;
-    m_pos_guide_y = (
-        cgd->left_eyeposition_normed_y + cgd->right_eyeposition_normed_y) / 2;
-    m_pos_guide_z = (
-        cgd->left_eyeposition_normed_z + cgd->right_eyeposition_normed_z) / 2;
+    if (cold) {
+        drain_cold(cold);
+        m_cold_mutex->unlock();
+    }
+
+    if (is_selected)
+        m_events->push(event);
+
+    if (is_degraded)
+        m_events->push(quality_event);
+
+    if (is_blink)
+        m_events->push(blink_event);
+
+    // Update user position guide from given gaze data, from the valid eye
+    // only if monocular, iff eye positions are ingested
+    if (!(m_fields & GAZE_FIELD_EYEPOS)) {
+        return;
+    } else if (cgd->validity == GAZE_VALID_BOTH) {
+        m_pos_guide_x = (
+            cgd->left_eyeposition_normed_x + cgd->right_eyeposition_normed_x) / 2;
+        m_pos_guide_y = (
+            cgd->left_eyeposition_normed_y + cgd->right_eyeposition_normed_y) / 2;
+        m_pos_guide_z = (
+            cgd->left_eyeposition_normed_z + cgd->right_eyeposition_normed_z) / 2;
+    } else if (cgd->validity & GAZE_VALID_LEFT) {
+        m_pos_guide_x = cgd->left_eyeposition_normed_x;
+        m_pos_guide_y = cgd->left_eyeposition_normed_y;
+        m_pos_guide_z = cgd->left_eyeposition_normed_z;
+    } else {
+        m_pos_guide_x = cgd->right_eyeposition_normed_x;
+        m_pos_guide_y = cgd->right_eyeposition_normed_y;
+        m_pos_guide_z = cgd->right_eyeposition_normed_z;
+    }
 
     // Make x guide scale intutively LR vs RL order
     m_pos_guide_x = abs(1 - m_pos_guide_x);
 }
 
+// Denotes a gaze sample having neither eye valid (i.e. not enqued) at the
+// given time. Such samples are only counted, by the history tiers, quality
+// monitor, blink detector and validity counts.
+void EyeTrackerGaze::enque_gaze_invalid(int64_t unixtime_us) {
+    gaze_event_t event;
+
+    m_async_mutex->lock();
+    if (m_history)
+        m_history->update_invalid(unixtime_us);
+
+    bool is_degraded = m_quality.update(
+        unixtime_us, False, False, 0, 0, &event);
+    m_blinks.update(unixtime_us, 0, NULL);  // Blinks only end on valid samples
+    m_validity_counts[0]++;
+    m_async_mutex->unlock();
+
+    if (is_degraded)
+        m_events->push(event);
+}
+
 // Prints the coord contents of the circular buffer. For debug convenience.
 void EyeTrackerGaze::print_gaze_data() {
-    circ_buff::iterator i; 
+    gaze_data_t cgd;
 
     m_async_mutex->lock();
-    for (i = m_gaze_buff->begin(); i < m_gaze_buff->end(); i++)  {
+    for (int j = 0; j < m_gaze_buff->size(); j++)  {
+        m_gaze_buff->at(j, &cgd);
         printf("(%d, %d)\n",
-        i->get()->combined_gazepoint_x,
-        i->get()->combined_gazepoint_y); 
+        cgd.combined_gazepoint_x,
+        cgd.combined_gazepoint_y); 
     }
     m_async_mutex->unlock();
 
     info("");
-    printf("Gaze sample count = %li\n", m_gaze_buff->size());
+    printf("Gaze sample count = %i\n", m_gaze_buff->size());
 }
 
 // Returns the current number of gaze points in the gaze data buffer.
@@ -355,44 +896,54 @@ gaze_point_t* EyeTrackerGaze::get_gazepoint_smoothed(gaze_point_t *gp) {
     int avg_y = 0;
     int buff_sz = 0;
     int n_samples = 0;
+    GazeTraceScope trace("smooth");
 
     // Average the gaze pt from (at most) the m_smooth_over latest samples
-    m_async_mutex->lock();
+    {
+        GazeTraceScope trace_lock("smooth_lock");
+        m_async_mutex->lock();
+    }
+
     buff_sz = gaze_data_sz();
     n_samples = min(buff_sz, m_smooth_over);
     
+    gaze_data_t cgd;
+    int x, y;
+
     for (int j = buff_sz - n_samples; j < buff_sz; j++)  {
-        auto cgd = *m_gaze_buff->at(j); 
+        m_gaze_buff->at(j, &cgd);
 
         // Iff using ml acc assist, smooth over ml assisted-cords
-        if (m_use_ml) {
-            avg_x += m_x_ml->predict(&cgd);
-            avg_y += m_y_ml->predict(&cgd);
-        }
-        // Else smooth from device-given coords
-        else {
-            avg_x += cgd.combined_gazepoint_x;
-            avg_y += cgd.combined_gazepoint_y;
-        }
+        gaze_smooth_coords(cgd,
+                           m_use_ml ? m_x_ml : NULL,
+                           m_use_ml ? m_y_ml : NULL,
+                           &x,
+                           &y);
+        avg_x += x;
+        avg_y += y;
     }
 
-    m_async_mutex->unlock();
-
     if (n_samples > 0) {
         avg_x = avg_x / n_samples;
         avg_y = avg_y / n_samples; 
+        GAZE_PROBE5(smooth,
+                    cgd.seq, cgd.unixtime_us, n_samples, avg_x, avg_y);
     }
 
     // Update the user provided struct
     gp->n_samples = n_samples;
     gp->x_coord = avg_x;
     gp->y_coord = avg_y;
+    gp->key_idx = n_samples > 0 ? m_keymap->key_at(avg_x, avg_y) : HUD_KEY_NONE;
+
+    m_async_mutex->unlock();
 
     return gp;
 }
 
 // Sets or updates the on-screen gaze marker (or cursor) position.
-void EyeTrackerGaze::set_gaze_marker(shared_ptr<gaze_data_t> cgd) {
+void EyeTrackerGaze::set_gaze_marker() {
+    GazeTraceScope trace("marker");
     gaze_point_t *gp = new(gaze_point_t);
     get_gazepoint_smoothed(gp);
 
@@ -410,9 +961,12 @@ void EyeTrackerGaze::set_gaze_marker(shared_ptr<gaze_data_t> cgd) {
                     gp->x_coord,
                     gp->y_coord); 
     }
+
+    GAZE_PROBE3(marker, gp->x_coord, gp->y_coord, (int)m_capture_cursor);
     
     delete gp;
 
+    GazeTraceScope trace_flush("marker_flush");
     XFlush(m_disp);
 }
 
@@ -425,6 +979,395 @@ void EyeTrackerGaze::set_cursor_capture(bool enabled) {
     XMoveWindow(m_disp, m_overlay, -10, -10);
 }
 
+// Sets the ingest field mode (one of GAZE_FIELDS_*), i.e. which gaze data
+// fields are ingested and buffered, discarding any buffered samples. Fields
+// outside the mode read as zero, e.g. in samples written to CSV. Must be set
+// while the gaze stream is stopped. Returns false if it's running, if the mode
+// is unknown, or if it omits fields the ML assist needs while it's in use.
+bool EyeTrackerGaze::set_fields(int fields) {
+    if (m_async_streamer) {
+        warn("Gaze field mode change attempted while stream running.\n");
+        return False;
+    }
+
+    if (fields != GAZE_FIELDS_MINIMAL &&
+        fields != GAZE_FIELDS_HUD &&
+        fields != GAZE_FIELDS_FULL &&
+        fields != GAZE_FIELDS_PACKED) {
+            warn("Gaze field mode change failed (unknown mode).\n");
+            return False;
+    }
+
+    if (m_use_ml && (fields & GAZE_FIELDS_ML) != GAZE_FIELDS_ML) {
+        warn("Gaze field mode change failed (ML assist needs eye detail).\n");
+        return False;
+    }
+
+    shared_ptr<GazeRing> gaze_buff =
+        make_shared<GazeRing>(
+            m_buff_sz, gaze_record_sz(fields), fields & GAZE_FIELD_PACKED);
+
+    m_async_mutex->lock();
+    m_fields = fields;
+    m_gaze_buff = gaze_buff;
+    m_async_mutex->unlock();
+
+    // Ingest is specialized per mode
+    switch (fields) {
+        case GAZE_FIELDS_MINIMAL:
+            m_ingest = &EyeTrackerGaze::ingest_staged<GAZE_FIELDS_MINIMAL>;
+            break;
+        case GAZE_FIELDS_HUD:
+            m_ingest = &EyeTrackerGaze::ingest_staged<GAZE_FIELDS_HUD>;
+            break;
+        default:    // GAZE_FIELDS_ML/FULL, and PACKED
+            m_ingest = &EyeTrackerGaze::ingest_staged<GAZE_FIELDS_FULL>;
+    }
+
+    return True;
+}
+
+// Loads the HUD keyboard layout at the given json path into the key hit-test
+// index, given the HUD's size and coord divisors. Returns the number of keys
+// loaded, or -1 on failure (in which case any previous keymap is kept).
+int EyeTrackerGaze::load_keymap(const char *json_path,
+                                int hud_width_px,
+                                int hud_height_px,
+                                int hud_div_x,
+                                int hud_div_y) {
+    // Compile the new map outside the lock, then swap it in
+    shared_ptr<HUDKeyMap> keymap = make_shared<HUDKeyMap>();
+    
+    if (!keymap->load(json_path, m_disp_width, m_disp_height,
+                      hud_width_px, hud_height_px, hud_div_x, hud_div_y))
+        return -1;
+
+    m_async_mutex->lock();
+    m_keymap = keymap;
+    m_gaze_key = HUD_KEY_NONE;
+    m_dwell.reset(keymap->key_count());
+    m_async_mutex->unlock();
+
+    return keymap->key_count();
+}
+
+// Returns the index of the HUD key under the most recent gaze sample, or
+// HUD_KEY_NONE if the gaze is not on a key.
+int EyeTrackerGaze::gaze_key() {
+    return m_gaze_key;
+}
+
+// Configures dwell selection of HUD keys. A dwell_ms <= 0 disables it.
+void EyeTrackerGaze::set_dwell(int dwell_ms, int hysteresis_px, int refractory_ms) {
+    m_async_mutex->lock();
+    m_dwell.configure(dwell_ms, hysteresis_px, refractory_ms);
+    m_async_mutex->unlock();
+}
+
+// Returns an eventfd that is readable while gaze events are pending.
+int EyeTrackerGaze::event_fd() {
+    return m_events->fd();
+}
+
+// Populates event with the oldest pending gaze event, if any. Returns false
+// if no events are pending. Should only be called from a single thread.
+bool EyeTrackerGaze::next_event(gaze_event_t *event) {
+    return m_events->pop(event);
+}
+
+// Injects the given UTF-8 string into the focused window as a single batch of
+// keystrokes, with the given X11 modifier mask held. Returns the injection
+// latency in microseconds, or -1 on failure.
+int64_t EyeTrackerGaze::inject_text(const char *utf8, unsigned int modifiers) {
+    return m_keystrokes->inject_text(utf8, modifiers);
+}
+
+// Injects a single keystroke of the given keysym into the focused window,
+// with the given X11 modifier mask held. Returns the injection latency in
+// microseconds, or -1 on failure.
+int64_t EyeTrackerGaze::inject_keysym(unsigned long keysym, unsigned int modifiers) {
+    return m_keystrokes->inject_keysym(keysym, modifiers);
+}
+
+// Memory-maps the word completion trie at the given path, replacing any
+// previously loaded trie. Returns the number of words loaded, or -1.
+int EyeTrackerGaze::load_completions(const char *trie_path) {
+    shared_ptr<WordTrie> trie = make_shared<WordTrie>();
+
+    if (!trie->load(trie_path))
+        return -1;
+
+    // Swap atomically, so completions may be served from any thread
+    atomic_store(&m_trie, trie);
+
+    return trie->word_count();
+}
+
+// Writes up to k completions of the given prefix to out, most frequent first,
+// newline separated and null-terminated in at most out_sz bytes. Returns the
+// number of completions written.
+int EyeTrackerGaze::completions(const char *prefix, int k, char *out, int out_sz) {
+    return atomic_load(&m_trie)->complete(prefix, k, out, out_sz);
+}
+
+// Enables the gaze heatmap at one cell per cell_px display pixels, with each
+// sample splatted as a Gaussian of sigma_px std deviation and the map halving
+// in intensity every half_life_ms. A cell_px <= 0, or failure to allocate the
+// grid, disables the heatmap.
+void EyeTrackerGaze::set_heatmap(int cell_px, float sigma_px, int half_life_ms) {
+    shared_ptr<GazeHeatmap> heatmap = NULL;
+
+    if (cell_px > 0)
+        heatmap = make_shared<GazeHeatmap>(
+            m_disp_width, m_disp_height, cell_px, sigma_px, half_life_ms);
+
+    if (heatmap && !heatmap->allocated())
+        heatmap = NULL;
+
+    m_async_mutex->lock();
+    m_heatmap = heatmap;
+    m_async_mutex->unlock();
+}
+
+// Decays the heatmap to the current time and returns its (zero-copy) grid,
+// populating cols, rows and stride with its dims, or returns NULL if the
+// heatmap is disabled. The buffer remains valid until the heatmap is
+// reconfigured, but is updated in place as samples arrive.
+float* EyeTrackerGaze::heatmap(int *cols, int *rows, int *stride) {
+    int64_t now_us = time_point_cast<microseconds>(
+        system_clock::now()).time_since_epoch().count();
+    float *grid = NULL;
+
+    m_async_mutex->lock();
+    if (m_heatmap) {
+        grid = m_heatmap->sync(now_us);
+        *cols = m_heatmap->cols();
+        *rows = m_heatmap->rows();
+        *stride = m_heatmap->stride();
+    }
+    m_async_mutex->unlock();
+
+    return grid;
+}
+
+// Adds an area of interest, given as a display rect, whose time-on-target is
+// then counted from the gaze stream. Returns its id, or AOI_NONE if empty.
+int EyeTrackerGaze::add_aoi(int x, int y, int width, int height) {
+    m_async_mutex->lock();
+    int id = m_aois->add(x, y, width, height);
+    m_async_mutex->unlock();
+
+    return id;
+}
+
+// Removes the area of interest having the given id. Returns false if none.
+bool EyeTrackerGaze::remove_aoi(int id) {
+    m_async_mutex->lock();
+    bool is_removed = m_aois->remove(id);
+    m_async_mutex->unlock();
+
+    return is_removed;
+}
+
+// Copies a snapshot of (at most) n AOIs' counters to out. Returns the total
+// number of AOIs, which may exceed n.
+int EyeTrackerGaze::aoi_stats(aoi_stats_t *out, int n) {
+    m_async_mutex->lock();
+    int n_aois = m_aois->snapshot(out, n);
+    m_async_mutex->unlock();
+
+    return n_aois;
+}
+
+// Zeroes all AOI counters.
+void EyeTrackerGaze::reset_aoi_stats() {
+    m_async_mutex->lock();
+    m_aois->reset_stats();
+    m_async_mutex->unlock();
+}
+
+// Enables the downsampled gaze history tiers, capped at the given total size
+// in bytes, discarding any existing tier history. A size of 0 disables them.
+void EyeTrackerGaze::set_history(size_t budget_bytes) {
+    shared_ptr<GazeHistory> history = NULL;
+
+    if (budget_bytes > 0)
+        history = make_shared<GazeHistory>(budget_bytes);
+
+    m_async_mutex->lock();
+    m_history = history;
+    m_async_mutex->unlock();
+}
+
+// Copies to out (at most) n gaze records, in time order, covering the range
+// [from_us, to_us], from the finest source reaching back to from_us -- the
+// full-rate buffer (as single-sample records), preceded by the cold history
+// if needed, else the finest history tier. Populates bin_us with the
+// source's period (0 for full-rate) and returns the total number of records
+// in the range, which may exceed n.
+int EyeTrackerGaze::gaze_history(int64_t from_us,
+                                 int64_t to_us,
+                                 gaze_agg_t *out,
+                                 int n,
+                                 int64_t *bin_us) {
+    int n_found = 0;
+
+    // Appends the given sample to out, as a single-sample record
+    auto emit = [&n_found, out, n](gaze_data_t const &cgd) {
+        if (n_found < n)
+            out[n_found] = gaze_agg_t{cgd.unixtime_us, 0, 1, 1.0,
+                                      (float)cgd.combined_gazepoint_x,
+                                      (float)cgd.combined_gazepoint_y,
+                                      cgd.combined_gazepoint_x,
+                                      cgd.combined_gazepoint_x,
+                                      cgd.combined_gazepoint_y,
+                                      cgd.combined_gazepoint_y};
+        n_found++;
+    };
+
+    // Evicted samples pending are drained to cold history once ingest is
+    // released, before it's scanned
+    bool is_cold_locked = lock_with_cold();
+    shared_ptr<GazeColdStore> cold = m_cold;
+
+    if (is_cold_locked)
+        m_cold_draining.swap(m_cold_pending);
+
+    bool is_raw = !m_gaze_buff->empty() &&
+        m_gaze_buff->unixtime_us_at(0) <= from_us;
+    bool is_cold = !is_raw && m_cold &&
+        (!m_cold->is_evicting() || m_cold->oldest_us() <= from_us);
+
+    if (is_raw || is_cold || !m_history) {
+        *bin_us = 0;
+
+        // Binary search for the first sample at or after from_us
+        int lo = 0;
+        int hi = m_gaze_buff->size();
+
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (m_gaze_buff->unixtime_us_at(mid) < from_us)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        vector<gaze_data_t> cgds;
+        gaze_data_t cgd;
+
+        for (int j = lo; j < m_gaze_buff->size(); j++) {
+            m_gaze_buff->at(j, &cgd);
+            if (cgd.unixtime_us > to_us)
+                break;
+            cgds.push_back(cgd);
+        }
+
+        // Cold history precedes the full-rate buffer. It's scanned w/ only
+        // itself locked, so ingest isn't stalled meanwhile.
+        if (is_cold) {
+            int64_t cold_to_us = m_gaze_buff->empty() ?
+                to_us : min(to_us, m_gaze_buff->unixtime_us_at(0) - 1);
+
+            m_async_mutex->unlock();
+            drain_cold(cold);
+            cold->scan(from_us, cold_to_us, emit);
+        }
+
+        for (auto &c : cgds)
+            emit(c);
+    } else {
+        int tier = m_history->tier_for(from_us);
+        *bin_us = m_history->tier_bin_us(tier);
+        n_found = m_history->query(tier, from_us, to_us, out, n);
+    }
+    if (!is_cold)
+        m_async_mutex->unlock();
+    if (is_cold_locked) {
+        drain_cold(cold);
+        m_cold_mutex->unlock();
+    }
+
+    return n_found;
+}
+
+// Enables the compressed cold history of samples leaving the full-rate
+// buffer, capped at the given size in bytes and with float fields truncated
+// to the given number of mantissa bits (23 is lossless), discarding any
+// existing cold history. A size of 0 disables it.
+void EyeTrackerGaze::set_cold_history(size_t budget_bytes, int mantissa_bits) {
+    shared_ptr<GazeColdStore> cold = NULL;
+
+    if (budget_bytes > 0)
+        cold = make_shared<GazeColdStore>(budget_bytes, mantissa_bits);
+
+    m_async_mutex->lock();
+    m_cold = cold;
+    m_cold_pending.clear();
+    m_async_mutex->unlock();
+}
+
+// Configures the gaze quality monitor's window size (in samples), fixation
+// velocity threshold (in px/s) and the thresholds beyond which a
+// GAZE_EVENT_RECALIBRATE event is raised: RMS sample-to-sample precision (in
+// px, 0 disables) and per-eye invalid-sample ratio (1 disables).
+void EyeTrackerGaze::set_quality(int window,
+                                 float fixation_px_s,
+                                 float max_rms_px,
+                                 float max_invalid) {
+    m_async_mutex->lock();
+    m_quality.configure(window, fixation_px_s, max_rms_px, max_invalid);
+    m_async_mutex->unlock();
+}
+
+// Populates quality with the current gaze data-quality metrics.
+void EyeTrackerGaze::quality(gaze_quality_t *quality) {
+    m_async_mutex->lock();
+    m_quality.metrics(quality);
+    m_async_mutex->unlock();
+}
+
+// Clears the quality metrics, e.g. after recalibration, so that a new
+// precision baseline is taken.
+void EyeTrackerGaze::reset_quality() {
+    m_async_mutex->lock();
+    m_quality.reset();
+    m_async_mutex->unlock();
+}
+
+// Populates counts (of length GAZE_VALID_BOTH + 1) with the number of gaze
+// samples seen having each validity bitmask, e.g. counts[0] is the number
+// having neither eye valid and counts[GAZE_VALID_LEFT] left eye only.
+void EyeTrackerGaze::validity_counts(int64_t *counts) {
+    m_async_mutex->lock();
+    memcpy(counts, m_validity_counts, sizeof(m_validity_counts));
+    m_async_mutex->unlock();
+}
+
+// Returns the number of blinks detected.
+int64_t EyeTrackerGaze::blink_count() {
+    m_async_mutex->lock();
+    int64_t n_blinks = m_blinks.blink_count();
+    m_async_mutex->unlock();
+
+    return n_blinks;
+}
+
+// Populates stats with the cold history's size and encode/decode throughput.
+// Returns false if cold history is disabled.
+bool EyeTrackerGaze::cold_history_stats(gaze_cold_stats_t *stats) {
+    m_async_mutex->lock();
+    shared_ptr<GazeColdStore> cold = m_cold;
+    m_async_mutex->unlock();
+
+    if (cold) {
+        boost::mutex::scoped_lock lock(*m_cold_mutex);
+        cold->stats(stats);
+    }
+
+    return cold != NULL;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // Extern wrapper exposing a subset of EyeTrackerGaze()'s methods
 extern "C" {
@@ -457,10 +1400,14 @@ extern "C" {
 
     int eye_gaze_data_tocsv(
         EyeTrackerGaze* gaze, const char *file_path, int n, const char *label) {
-            boost::shared_ptr<char> p_label(new char[strlen(label)+1]);
-            strcpy(p_label.get(), label);
+            return gaze->gaze_data_tocsv(
+                file_path, n, gaze->intern_label(label));
+    }
 
-            return gaze->gaze_data_tocsv(file_path, n, p_label);
+    int eye_gaze_data_tolog(
+        EyeTrackerGaze* gaze, const char *file_path, int n, const char *label) {
+            return gaze->gaze_data_tolog(
+                file_path, n, gaze->intern_label(label));
     }
 
     void eye_gaze_start(EyeTrackerGaze* gaze) {
@@ -492,8 +1439,24 @@ extern "C" {
         gaze->set_cursor_capture(enabled);
     }
 
-    void eye_write_calibration(EyeTrackerGaze* gaze) {
-        gaze->calibration_write();
+    bool eye_gaze_fields(EyeTrackerGaze* gaze, int fields) {
+        return gaze->set_fields(fields);
+    }
+
+    bool eye_write_calibration(EyeTrackerGaze* gaze, const char *profile) {
+        return gaze->calibration_write(profile);
+    }
+
+    bool eye_calibration_apply(EyeTrackerGaze* gaze, const char *profile) {
+        return gaze->calibration_apply(profile);
+    }
+
+    bool eye_calibration_remove(EyeTrackerGaze* gaze, const char *profile) {
+        return gaze->calibration_remove(profile);
+    }
+
+    int eye_calibration_profiles(EyeTrackerGaze* gaze, char *out, int out_sz) {
+        return gaze->calibration_profiles(out, out_sz);
     }
 
     gaze_point_t* eye_gaze_point(EyeTrackerGaze* gaze) {
@@ -505,139 +1468,369 @@ extern "C" {
     void eye_gaze_point_free(gaze_point_t *gp) {
         delete gp;
     }
-}
 
+    int eye_keymap_load(EyeTrackerGaze* gaze,
+                        const char *json_path,
+                        int hud_width_px,
+                        int hud_height_px,
+                        int hud_div_x,
+                        int hud_div_y) {
+        return gaze->load_keymap(
+            json_path, hud_width_px, hud_height_px, hud_div_x, hud_div_y);
+    }
+
+    int eye_gaze_key(EyeTrackerGaze* gaze) {
+        return gaze->gaze_key();
+    }
 
-/////////////////////////////////////////////////////////////////////////////
-// Gaze subscriber and callback functions
+    void eye_dwell_config(
+        EyeTrackerGaze* gaze, int dwell_ms, int hysteresis_px, int refractory_ms) {
+            gaze->set_dwell(dwell_ms, hysteresis_px, refractory_ms);
+    }
+
+    int eye_event_fd(EyeTrackerGaze* gaze) {
+        return gaze->event_fd();
+    }
+
+    int eye_event_next(EyeTrackerGaze* gaze, gaze_event_t *event) {
+        return gaze->next_event(event);
+    }
 
-// Starts the gaze point and user position guide data streams
-void do_gazestream_subscribe(tobii_device_t *device, void *gaze) {
+    int64_t eye_inject_text(
+        EyeTrackerGaze* gaze, const char *utf8, unsigned int modifiers) {
+            return gaze->inject_text(utf8, modifiers);
+    }
 
-    // Subscribe to gaze point
-    assert(tobii_gaze_data_subscribe(device, cb_gaze_data, gaze
-    ) == NO_ERROR);
+    int64_t eye_inject_keysym(
+        EyeTrackerGaze* gaze, unsigned long keysym, unsigned int modifiers) {
+            return gaze->inject_keysym(keysym, modifiers);
+    }
 
-    try {
-        while (True) {
-            assert(tobii_wait_for_callbacks(1, &device) == NO_ERROR);
-            assert(tobii_device_process_callbacks(device) == NO_ERROR);
-            boost::this_thread::sleep_for(boost::chrono::microseconds{1});
-        }
-    } catch (boost::thread_interrupted&) {}
+    int eye_trie_build(const char *wordlist_path, const char *trie_path) {
+        return WordTrie::build(wordlist_path, trie_path);
+    }
+
+    int eye_trie_load(EyeTrackerGaze* gaze, const char *trie_path) {
+        return gaze->load_completions(trie_path);
+    }
+
+    int eye_trie_complete(
+        EyeTrackerGaze* gaze, const char *prefix, int k, char *out, int out_sz) {
+            return gaze->completions(prefix, k, out, out_sz);
+    }
+
+    void eye_heatmap_config(
+        EyeTrackerGaze* gaze, int cell_px, float sigma_px, int half_life_ms) {
+            gaze->set_heatmap(cell_px, sigma_px, half_life_ms);
+    }
+
+    float* eye_heatmap(
+        EyeTrackerGaze* gaze, int *cols, int *rows, int *stride) {
+            return gaze->heatmap(cols, rows, stride);
+    }
+
+    int eye_aoi_add(EyeTrackerGaze* gaze, int x, int y, int width, int height) {
+        return gaze->add_aoi(x, y, width, height);
+    }
+
+    int eye_aoi_remove(EyeTrackerGaze* gaze, int id) {
+        return gaze->remove_aoi(id);
+    }
+
+    int eye_aoi_stats(EyeTrackerGaze* gaze, aoi_stats_t *out, int n) {
+        return gaze->aoi_stats(out, n);
+    }
+
+    void eye_aoi_reset(EyeTrackerGaze* gaze) {
+        gaze->reset_aoi_stats();
+    }
+
+    void eye_history_config(EyeTrackerGaze* gaze, size_t budget_bytes) {
+        gaze->set_history(budget_bytes);
+    }
+
+    int eye_history(EyeTrackerGaze* gaze,
+                    int64_t from_us,
+                    int64_t to_us,
+                    gaze_agg_t *out,
+                    int n,
+                    int64_t *bin_us) {
+        return gaze->gaze_history(from_us, to_us, out, n, bin_us);
+    }
+
+    void eye_cold_history_config(
+        EyeTrackerGaze* gaze, size_t budget_bytes, int mantissa_bits) {
+            gaze->set_cold_history(budget_bytes, mantissa_bits);
+    }
+
+    int eye_cold_history_stats(EyeTrackerGaze* gaze, gaze_cold_stats_t *stats) {
+        return gaze->cold_history_stats(stats);
+    }
+
+    void eye_quality_config(EyeTrackerGaze* gaze,
+                            int window,
+                            float fixation_px_s,
+                            float max_rms_px,
+                            float max_invalid) {
+        gaze->set_quality(window, fixation_px_s, max_rms_px, max_invalid);
+    }
+
+    void eye_quality(EyeTrackerGaze* gaze, gaze_quality_t *quality) {
+        gaze->quality(quality);
+    }
+
+    void eye_quality_reset(EyeTrackerGaze* gaze) {
+        gaze->reset_quality();
+    }
+
+    void eye_validity_counts(EyeTrackerGaze* gaze, int64_t *counts) {
+        gaze->validity_counts(counts);
+    }
 
-    assert(tobii_gaze_data_unsubscribe(device) == NO_ERROR);
+    int64_t eye_blink_count(EyeTrackerGaze* gaze) {
+        return gaze->blink_count();
+    }
+
+    void eye_connection_stats(EyeTrackerGaze* gaze,
+                              device_conn_stats_t *stats) {
+        gaze->connection_stats(stats);
+    }
+
+    void eye_sample_rate(EyeTrackerGaze* gaze, float sample_hz) {
+        gaze->set_sample_rate(sample_hz);
+    }
+
+    int eye_gap_log(EyeTrackerGaze* gaze, gaze_gap_t *out, int n) {
+        return gaze->gaps(out, n);
+    }
+
+    int64_t eye_lost_count(EyeTrackerGaze* gaze) {
+        return gaze->n_lost();
+    }
+
+    int eye_startup_timeline(EyeTrackerGaze* gaze,
+                             startup_stage_t *out,
+                             int n,
+                             int64_t *total_us) {
+        return gaze->startup_timeline(out, n, total_us);
+    }
+
+    void eye_trace_enable(bool enabled) {
+        g_gaze_trace.enable(enabled);
+    }
+
+    int eye_trace_dump(const char *path) {
+        return g_gaze_trace.dump(path);
+    }
+
+    int64_t eye_index_build(const char *log_path,
+                            int disp_width,
+                            int disp_height) {
+        return GazeIndex::update(log_path, disp_width, disp_height);
+    }
+
+    int64_t eye_index_query(const char **log_paths,
+                            int n_logs,
+                            int64_t from_us,
+                            int64_t to_us,
+                            int x,
+                            int y,
+                            int width,
+                            int height,
+                            const char *label,
+                            gaze_index_hit_t *out,
+                            int64_t n,
+                            gaze_index_stats_t *stats) {
+        return gaze_index_query(log_paths,
+                                n_logs,
+                                from_us,
+                                to_us,
+                                x,
+                                y,
+                                width,
+                                height,
+                                label,
+                                out,
+                                n,
+                                stats);
+    }
+
+    int64_t eye_csv_to_log(const char *csv_path,
+                           const char *log_path,
+                           int n_threads,
+                           gaze_csv_stats_t *stats) {
+        return gaze_csv_to_log(csv_path, log_path, n_threads, stats);
+    }
+
+    int64_t eye_replay_logs(const char **log_paths,
+                            int n_logs,
+                            const char *out_dir,
+                            gaze_replay_params_t const *params,
+                            const char *ml_x_path,
+                            const char *ml_y_path,
+                            gaze_replay_stats_t *stats) {
+        GazeReplay replay(*params, ml_x_path, ml_y_path);
+        return replay.run(log_paths, n_logs, out_dir, stats);
+    }
 }
 
 
-// Gaze point callback for use with tobii_gaze_point_subscribe(). Gets the
-// eyetrackers predicted on-screen gaze coordinates (x, y) and enques gaze
-// data into EyeTrackerGazes' circular buffer. Also creates a shaded window
-// overlay denoting the gaze point on the screen.
+/////////////////////////////////////////////////////////////////////////////
+// Gaze subscriber and callback functions
+
+// Returns the bytes buffered per sample in the given field mode. Each
+// unpacked mode's fields are a prefix of gaze_data_t.
+size_t gaze_record_sz(int fields) {
+    if (fields & GAZE_FIELD_PACKED)
+        return sizeof(gaze_packed_t);
+    if (fields & GAZE_FIELD_EYE_DETAIL)
+        return sizeof(gaze_data_t);
+    if (fields & GAZE_FIELD_EYEPOS)
+        return offsetof(gaze_data_t, left_pupildiameter_mm);
+
+    return offsetof(gaze_data_t, left_eyeposition_normed_x);
+}
+
+static_assert(offsetof(gaze_data_t, right_eyeposition_normed_z) <
+              offsetof(gaze_data_t, left_pupildiameter_mm) &&
+              offsetof(gaze_data_t, right_gazepoint_normed_y) <
+              sizeof(gaze_data_t),
+              "gaze_data_t field groups must be ordered by field mode");
+
+// Gaze data callback for use with tobii_gaze_data_subscribe(). Stages the
+// raw sample for batch conversion, converting the batch if full. Batches are
+// otherwise converted once the device's queued callbacks are drained.
 // ASSUMES: user_data is a ptr to an object of type EyeTrackerGaze.
 static void cb_gaze_data(tobii_gaze_data_t const *data, void *obj) {
     auto *gaze = static_cast<EyeTrackerGaze*>(obj);
+    GazeTraceScope trace("gaze_callback");
+
+    gaze->stage_gaze_data(data);
+}
+
+// Converts the staged raw gaze samples and enques gaze data into the
+// circular buffer. If only one eye is valid, its gaze point is used alone.
+// Also creates a shaded window overlay denoting the gaze point on the
+// screen. Only the field groups in Fields (as GAZE_FIELD_* bits) are copied,
+// the rest being left zeroed.
+template <int Fields>
+void EyeTrackerGaze::ingest_staged() {
+    gaze_convert_params_t params = {
+        m_device_time_offset, (float)m_disp_width, (float)m_disp_height};
+    gaze_points_t *pts = &m_staged_pts;
+    bool is_mark_due = False;
+    GazeTraceScope trace("ingest");
+    gaze_trace_counter("ingest_batch", m_n_staged);
+
+    // Convert timestamps, validity and combined gaze points in one pass
+    m_convert(m_staged.data(), m_n_staged, params, pts);
+
+    for (int i = 0; i < m_n_staged; i++) {
+        tobii_gaze_data_t const *raw = &m_staged[i];
+        uint32_t seq = m_seq++;
+
+        // Flag the next valid sample after any samples lost by the device
+        if (m_gaps->sample(seq, pts->unixtime_us[i], NULL)) {
+            m_async_mutex->lock();
+            m_is_gap_pending = True;
+            m_async_mutex->unlock();
+        }
 
-    if(data->left.gaze_point_validity == TOBII_VALIDITY_VALID ==
-        data->right.gaze_point_validity) {
-        
-        // Convert gaze point to screen coords
-        int left_gazepoint_x = gaze->disp_x_from_normed_x(
-            data->left.gaze_point_on_display_normalized_xy[0]);
-        int left_gazepoint_y = gaze->disp_y_from_normed_y(
-            data->left.gaze_point_on_display_normalized_xy[1]);
-            
-        int right_gazepoint_x = gaze->disp_x_from_normed_x(
-            data->right.gaze_point_on_display_normalized_xy[0]);
-        int right_gazepoint_y = gaze->disp_y_from_normed_y(
-            data->right.gaze_point_on_display_normalized_xy[1]);
-
-        int x_gazepoint = (left_gazepoint_x + right_gazepoint_x) / 2;
-        int y_gazepoint = (left_gazepoint_y + right_gazepoint_y) / 2;
-
-        // Convert timestamp from device time to system clock time
-        int64_t timestamp_us = gaze->devicetime_to_systime(
-            data->timestamp_system_us);
-
-        // Copy gaze data then enque it in the EyeTrackerGaze buff
-        shared_ptr<gaze_data_t> cgd = make_shared<gaze_data_t>();
-
-        cgd->unixtime_us = timestamp_us;
-        cgd->left_pupildiameter_mm = data->left.pupil_diameter_mm;
-        cgd->right_pupildiameter_mm = data->right.pupil_diameter_mm;
-        cgd->left_eyeposition_normed_x = 
-            data->left.eye_position_in_track_box_normalized_xyz[0];
-		cgd->left_eyeposition_normed_y = 
-            data->left.eye_position_in_track_box_normalized_xyz[1];
-		cgd->left_eyeposition_normed_z = 
-            data->left.eye_position_in_track_box_normalized_xyz[2];
-		cgd->right_eyeposition_normed_x = 
-            data->right.eye_position_in_track_box_normalized_xyz[0];
-		cgd->right_eyeposition_normed_y = 
-            data->right.eye_position_in_track_box_normalized_xyz[1];
-		cgd->right_eyeposition_normed_z = 
-            data->right.eye_position_in_track_box_normalized_xyz[2];
-        cgd->left_eyecenter_mm_x = 
-            data->left.eyeball_center_from_eye_tracker_mm_xyz[0];
-		cgd->left_eyecenter_mm_y = 
-            data->left.eyeball_center_from_eye_tracker_mm_xyz[1];
-		cgd->left_eyecenter_mm_z = 
-            data->left.eyeball_center_from_eye_tracker_mm_xyz[2];
-		cgd->right_eyecenter_mm_x = 
-            data->right.eyeball_center_from_eye_tracker_mm_xyz[0];
-		cgd->right_eyecenter_mm_y = 
-            data->right.eyeball_center_from_eye_tracker_mm_xyz[1];
-		cgd->right_eyecenter_mm_z = 
-            data->right.eyeball_center_from_eye_tracker_mm_xyz[2];
-        cgd->left_gazeorigin_mm_x = 
-            data->left.gaze_origin_from_eye_tracker_mm_xyz[0];
-		cgd->left_gazeorigin_mm_y = 
-            data->left.gaze_origin_from_eye_tracker_mm_xyz[1];
-		cgd->left_gazeorigin_mm_z = 
-            data->left.gaze_origin_from_eye_tracker_mm_xyz[2];
-		cgd->right_gazeorigin_mm_x = 
-            data->right.gaze_origin_from_eye_tracker_mm_xyz[0];
-		cgd->right_gazeorigin_mm_y = 
-            data->right.gaze_origin_from_eye_tracker_mm_xyz[1];
-		cgd->right_gazeorigin_mm_z = 
-            data->right.gaze_origin_from_eye_tracker_mm_xyz[2];
-        cgd->left_gazepoint_mm_x = 
-            data->left.gaze_point_from_eye_tracker_mm_xyz[0];
-		cgd->left_gazepoint_mm_y = 
-            data->left.gaze_point_from_eye_tracker_mm_xyz[1];
-		cgd->left_gazepoint_mm_z = 
-            data->left.gaze_point_from_eye_tracker_mm_xyz[2];
-		cgd->right_gazepoint_mm_x = 
-            data->right.gaze_point_from_eye_tracker_mm_xyz[0];
-		cgd->right_gazepoint_mm_y = 
-            data->right.gaze_point_from_eye_tracker_mm_xyz[1];
-		cgd->right_gazepoint_mm_z = 
-            data->right.gaze_point_from_eye_tracker_mm_xyz[2];
-        cgd->left_gazepoint_normed_x = 
-            data->left.gaze_point_on_display_normalized_xy[0];
-		cgd->left_gazepoint_normed_y = 
-            data->left.gaze_point_on_display_normalized_xy[1];
-		cgd->right_gazepoint_normed_x = 
-            data->right.gaze_point_on_display_normalized_xy[0];
-		cgd->right_gazepoint_normed_y = 
-            data->right.gaze_point_on_display_normalized_xy[1];
-        cgd->combined_gazepoint_x = x_gazepoint;
-        cgd->combined_gazepoint_y = y_gazepoint;
-
-        gaze->enque_gaze_data(cgd);
-
-        // Annotate (x, y) on the screen every m_mark_freq callbacks
-        gaze->m_mark_count++;
-        if (gaze->m_mark_count % gaze->m_mark_freq != 0)
-            return;
-
-        gaze->set_gaze_marker(cgd);
-        gaze->m_mark_count = 0;
-    }
-    else {
-        // Gaze point invalid. Is user present?
-        gaze->m_mark_count = 0;
+        if (pts->validity[i]) {
+            // Copy the mode's gaze data then enque it in the buff
+            gaze_data_t cgd = {};
+
+            cgd.unixtime_us = pts->unixtime_us[i];
+            cgd.combined_gazepoint_x = pts->x[i];
+            cgd.combined_gazepoint_y = pts->y[i];
+            cgd.validity = pts->validity[i];
+            cgd.seq = seq;
+
+            if (Fields & GAZE_FIELD_EYEPOS) {
+                cgd.left_eyeposition_normed_x = 
+                    raw->left.eye_position_in_track_box_normalized_xyz[0];
+                cgd.left_eyeposition_normed_y = 
+                    raw->left.eye_position_in_track_box_normalized_xyz[1];
+                cgd.left_eyeposition_normed_z = 
+                    raw->left.eye_position_in_track_box_normalized_xyz[2];
+                cgd.right_eyeposition_normed_x = 
+                    raw->right.eye_position_in_track_box_normalized_xyz[0];
+                cgd.right_eyeposition_normed_y = 
+                    raw->right.eye_position_in_track_box_normalized_xyz[1];
+                cgd.right_eyeposition_normed_z = 
+                    raw->right.eye_position_in_track_box_normalized_xyz[2];
+            }
+
+            if (Fields & GAZE_FIELD_EYE_DETAIL) {
+                cgd.left_pupildiameter_mm = raw->left.pupil_diameter_mm;
+                cgd.right_pupildiameter_mm = raw->right.pupil_diameter_mm;
+                cgd.left_eyecenter_mm_x = 
+                    raw->left.eyeball_center_from_eye_tracker_mm_xyz[0];
+                cgd.left_eyecenter_mm_y = 
+                    raw->left.eyeball_center_from_eye_tracker_mm_xyz[1];
+                cgd.left_eyecenter_mm_z = 
+                    raw->left.eyeball_center_from_eye_tracker_mm_xyz[2];
+                cgd.right_eyecenter_mm_x = 
+                    raw->right.eyeball_center_from_eye_tracker_mm_xyz[0];
+                cgd.right_eyecenter_mm_y = 
+                    raw->right.eyeball_center_from_eye_tracker_mm_xyz[1];
+                cgd.right_eyecenter_mm_z = 
+                    raw->right.eyeball_center_from_eye_tracker_mm_xyz[2];
+                cgd.left_gazeorigin_mm_x = 
+                    raw->left.gaze_origin_from_eye_tracker_mm_xyz[0];
+                cgd.left_gazeorigin_mm_y = 
+                    raw->left.gaze_origin_from_eye_tracker_mm_xyz[1];
+                cgd.left_gazeorigin_mm_z = 
+                    raw->left.gaze_origin_from_eye_tracker_mm_xyz[2];
+                cgd.right_gazeorigin_mm_x = 
+                    raw->right.gaze_origin_from_eye_tracker_mm_xyz[0];
+                cgd.right_gazeorigin_mm_y = 
+                    raw->right.gaze_origin_from_eye_tracker_mm_xyz[1];
+                cgd.right_gazeorigin_mm_z = 
+                    raw->right.gaze_origin_from_eye_tracker_mm_xyz[2];
+                cgd.left_gazepoint_mm_x = 
+                    raw->left.gaze_point_from_eye_tracker_mm_xyz[0];
+                cgd.left_gazepoint_mm_y = 
+                    raw->left.gaze_point_from_eye_tracker_mm_xyz[1];
+                cgd.left_gazepoint_mm_z = 
+                    raw->left.gaze_point_from_eye_tracker_mm_xyz[2];
+                cgd.right_gazepoint_mm_x = 
+                    raw->right.gaze_point_from_eye_tracker_mm_xyz[0];
+                cgd.right_gazepoint_mm_y = 
+                    raw->right.gaze_point_from_eye_tracker_mm_xyz[1];
+                cgd.right_gazepoint_mm_z = 
+                    raw->right.gaze_point_from_eye_tracker_mm_xyz[2];
+                cgd.left_gazepoint_normed_x = 
+                    raw->left.gaze_point_on_display_normalized_xy[0];
+                cgd.left_gazepoint_normed_y = 
+                    raw->left.gaze_point_on_display_normalized_xy[1];
+                cgd.right_gazepoint_normed_x = 
+                    raw->right.gaze_point_on_display_normalized_xy[0];
+                cgd.right_gazepoint_normed_y = 
+                    raw->right.gaze_point_on_display_normalized_xy[1];
+            }
+
+            enque_gaze_data(&cgd);
+
+            // Annotate (x, y) on the screen every m_mark_freq samples
+            m_mark_count++;
+            if (m_mark_count % m_mark_freq == 0) {
+                is_mark_due = True;
+                m_mark_count = 0;
+            }
+        }
+        else {
+            // Gaze point invalid. Is user present?
+            m_mark_count = 0;
+            enque_gaze_invalid(pts->unixtime_us[i]);
+        }
     }
+
+    m_n_staged = 0;
+
+    // The marker shows the latest smoothed point, so once per batch suffices
+    if (is_mark_due)
+        set_gaze_marker();
 }
 
 
@@ -0,0 +1,522 @@
+/////////////////////////////////////////////////////////////////////////////
+// Microbenchmarks of EyeTrackerGaze's hot paths, against the stubbed stream
+// engine (i.e. no eyetracker device is needed) and an X display, e.g. Xvfb.
+// Synthetic samples (mostly binocular, some monocular and invalid) are used
+// throughout. Benchmarked are:
+//
+//      ingest              cb_gaze_data() and batch ingest, per field mode,
+//                          and w/ tracing on (see gaze_trace.h)
+//      enque_contended     enque_gaze_data() while reader threads poll
+//                          get_gazepoint_smoothed(), w/ per-call latencies
+//      smoothed            get_gazepoint_smoothed(), per smoothing window
+//      smoothed_ml         As above, through EyeTrackerCoordPredict, iff
+//                          model paths are given (else reported skipped)
+//      tocsv, tolog        Exports of a full buffer, incl. the async write
+//      marker              set_gaze_marker(), w/ the overlay and cursor
+//
+// Each is timed over several runs, and the best and median time per op are
+// reported. Results are printed and written as JSON, for tracking
+// regressions between releases.
+//
+// Usage: eyetracker_gaze_bench [JSON_PATH [ML_X_PATH ML_Y_PATH]]
+// Build and run with lib/sh/bench_eyetracker_gaze.sh
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "tobii_stub.h"
+#include "eyetracker_gaze.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define BENCH_FORMAT_VER 1
+#define BENCH_JSON_PATH "eyetracker_gaze_bench.json"
+#define BENCH_CSV_PATH "/tmp/eyetracker_gaze_bench.csv"
+#define BENCH_LOG_PATH "/tmp/eyetracker_gaze_bench.glog"
+#define BENCH_DISP_WIDTH_MM 698.5
+#define BENCH_DISP_HEIGHT_MM 393.7
+#define BENCH_DISP_WIDTH_PX 3840
+#define BENCH_DISP_HEIGHT_PX 2160
+#define BENCH_MARK_INTERVAL 5           // As EYETRACKER_MARK_INTERVAL
+#define BENCH_BUFF_SZ 4500              // As EYETRACKER_BUFF_SZ
+#define BENCH_SMOOTH_OVER 13            // As EYETRACKER_SMOOTH_OVER
+#define BENCH_SAMPLE_HZ 90              // As EYETRACKER_SAMPLE_HZ
+#define BENCH_N_RUNS 7
+#define BENCH_N_INGEST (1 << 15)        // Ops per run, per benchmark
+#define BENCH_N_ENQUE (1 << 15)
+#define BENCH_N_SMOOTH 20000
+#define BENCH_N_SMOOTH_ML 100
+#define BENCH_N_MARKER 2000
+
+typedef struct bench_result {
+        string name;
+        string variant;
+        int64_t n_ops;                  // Per run
+        double best_ns;                 // Per op
+        double median_ns;
+        bool has_latency;               // Iff per-op latencies measured
+        double p50_ns;
+        double p99_ns;
+        double max_ns;
+        bool is_skipped;
+	    } bench_result_t;
+
+// Exposes EyeTrackerGaze's protected smoothing states
+class BenchGaze : public EyeTrackerGaze {
+    public:
+        using EyeTrackerGaze::EyeTrackerGaze;
+
+        void set_smooth_over(int n) { m_smooth_over = n; }
+        bool set_use_ml(bool use_ml) {
+            m_use_ml = use_ml && m_is_ml_loaded;
+            return m_use_ml;
+        }
+        void denote_ml_loaded() { m_is_ml_loaded = m_use_ml; }
+
+    private:
+        bool m_is_ml_loaded = False;
+};
+
+static vector<bench_result_t> g_results;
+
+/////////////////////////////////////////////////////////////////////////////
+// Helpers
+
+// Returns the current time, in nanoseconds.
+static int64_t bench_now_ns() {
+    return duration_cast<nanoseconds>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+// Returns the given percentile of the given (sorted) values.
+static double bench_pct(vector<int64_t> const &sorted, double pct) {
+    if (sorted.empty())
+        return 0;
+
+    return sorted[min(sorted.size() - 1, (size_t)(pct * sorted.size()))];
+}
+
+// Times BENCH_N_RUNS runs of run(), each of n_ops ops and preceded by an
+// (untimed) call to setup(), and records the result.
+template <typename Setup, typename Run>
+static bench_result_t& bench_runs(const char *name,
+                                  string variant,
+                                  int64_t n_ops,
+                                  Setup setup,
+                                  Run run) {
+    vector<int64_t> runs_ns;
+
+    for (int r = 0; r < BENCH_N_RUNS; r++) {
+        setup();
+        int64_t start_ns = bench_now_ns();
+        run();
+        runs_ns.push_back(bench_now_ns() - start_ns);
+    }
+
+    sort(runs_ns.begin(), runs_ns.end());
+
+    bench_result_t result = {};
+    result.name = name;
+    result.variant = variant;
+    result.n_ops = n_ops;
+    result.best_ns = (double)runs_ns.front() / n_ops;
+    result.median_ns = (double)runs_ns[runs_ns.size() / 2] / n_ops;
+
+    printf("%-16s %-14s %10.1f %10.1f\n",
+           name, variant.c_str(), result.best_ns, result.median_ns);
+
+    g_results.push_back(result);
+    return g_results.back();
+}
+
+// Records the given benchmark as skipped.
+static void bench_skip(const char *name, string variant) {
+    bench_result_t result = {};
+    result.name = name;
+    result.variant = variant;
+    result.is_skipped = True;
+
+    printf("%-16s %-14s %21s\n", name, variant.c_str(), "skipped");
+
+    g_results.push_back(result);
+}
+
+// Populates raw w/ synthetic raw samples, untimestamped (see
+// bench_restamp()): fixations of ~300ms w/ small jitter, 90% binocular, 4%
+// left eye only, 3% right eye only and 3% invalid.
+static void bench_raw_samples(vector<tobii_gaze_data_t> &raw) {
+    mt19937 rng(7);
+    uniform_real_distribution<float> unit(0, 1);
+    normal_distribution<float> jitter(0, 0.005);
+    float fix_x = 0.5;
+    float fix_y = 0.5;
+
+    for (size_t i = 0; i < raw.size(); i++) {
+        tobii_gaze_data_t *data = &raw[i];
+        tobii_gaze_data_eye_t *eyes[] = {&data->left, &data->right};
+        float pct = unit(rng);
+
+        if (i % 27 == 0) {
+            fix_x = unit(rng);
+            fix_y = unit(rng);
+        }
+
+        memset(data, 0, sizeof(*data));
+
+        for (int e = 0; e < 2; e++) {
+            tobii_gaze_data_eye_t *eye = eyes[e];
+            bool is_valid = pct < 0.90 ||
+                (pct < 0.94 && e == 0) || (pct >= 0.94 && pct < 0.97 && e == 1);
+            tobii_validity_t validity =
+                is_valid ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+
+            eye->gaze_origin_validity = validity;
+            eye->gaze_point_validity = validity;
+            eye->eyeball_center_validity = validity;
+            eye->pupil_validity = validity;
+
+            for (int k = 0; k < 3; k++) {
+                float side = e ? 1 : -1;
+                eye->gaze_origin_from_eye_tracker_mm_xyz[k] =
+                    k == 2 ? 600 : side * 30 + jitter(rng) * 100;
+                eye->eye_position_in_track_box_normalized_xyz[k] =
+                    0.5 + side * 0.05 + jitter(rng);
+                eye->gaze_point_from_eye_tracker_mm_xyz[k] =
+                    k == 2 ? 0 : (fix_x - 0.5) * 600 + jitter(rng) * 100;
+                eye->eyeball_center_from_eye_tracker_mm_xyz[k] =
+                    k == 2 ? 610 : side * 30 + jitter(rng) * 100;
+            }
+
+            eye->gaze_point_on_display_normalized_xy[0] = fix_x + jitter(rng);
+            eye->gaze_point_on_display_normalized_xy[1] = fix_y + jitter(rng);
+            eye->pupil_diameter_mm = 3.5 + jitter(rng) * 10;
+        }
+    }
+}
+
+// Sets the given raw samples' timestamps, sample_us apart, ending now.
+static void bench_restamp(vector<tobii_gaze_data_t> &raw) {
+    int64_t sample_us = 1000000 / BENCH_SAMPLE_HZ;
+    int64_t t_us = tobii_stub_now_us() - raw.size() * sample_us;
+
+    for (auto &data : raw) {
+        data.timestamp_tracker_us = t_us;
+        data.timestamp_system_us = t_us;
+        t_us += sample_us;
+    }
+}
+
+// Ingests the given raw samples, as from the stream loop.
+static void bench_ingest(BenchGaze &gaze, vector<tobii_gaze_data_t> &raw) {
+    for (auto const &data : raw)
+        cb_gaze_data(&data, &gaze);
+
+    gaze.ingest_staged_all();
+}
+
+// Fills the gaze buffer w/ fresh samples, of the given raw samples.
+static void bench_fill(BenchGaze &gaze, vector<tobii_gaze_data_t> &raw) {
+    int mark_freq = gaze.m_mark_freq;
+
+    gaze.set_fields(GAZE_FIELDS_FULL);
+    gaze.m_mark_freq = INT_MAX;
+
+    bench_restamp(raw);
+    bench_ingest(gaze, raw);
+
+    gaze.m_mark_freq = mark_freq;
+}
+
+// Writes the results, and the given run metadata, to the given path as JSON.
+static bool bench_write_json(const char *path, const char *kernel) {
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return False;
+
+    const char *rev = getenv("BENCH_REV");
+    int64_t unixtime = time_point_cast<seconds>(
+        system_clock::now()).time_since_epoch().count();
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"format\": %d,\n", BENCH_FORMAT_VER);
+    fprintf(f, "  \"rev\": \"%s\",\n", rev ? rev : "");
+    fprintf(f, "  \"unixtime\": %ld,\n", (long)unixtime);
+    fprintf(f, "  \"convert_kernel\": \"%s\",\n", kernel);
+    fprintf(f, "  \"buff_sz\": %d,\n", BENCH_BUFF_SZ);
+    fprintf(f, "  \"n_runs\": %d,\n", BENCH_N_RUNS);
+    fprintf(f, "  \"results\": [\n");
+
+    for (size_t i = 0; i < g_results.size(); i++) {
+        bench_result_t const &r = g_results[i];
+
+        fprintf(f, "    {\"name\": \"%s\", \"variant\": \"%s\"",
+                r.name.c_str(), r.variant.c_str());
+
+        if (r.is_skipped) {
+            fprintf(f, ", \"skipped\": true");
+        } else {
+            fprintf(f, ", \"n_ops\": %ld, \"best_ns\": %.2f, \"median_ns\": %.2f",
+                    (long)r.n_ops, r.best_ns, r.median_ns);
+            if (r.has_latency)
+                fprintf(f, ", \"p50_ns\": %.0f, \"p99_ns\": %.0f, "
+                           "\"max_ns\": %.0f",
+                        r.p50_ns, r.p99_ns, r.max_ns);
+        }
+
+        fprintf(f, "}%s\n", i + 1 < g_results.size() ? "," : "");
+    }
+
+    fprintf(f, "  ]\n}\n");
+
+    return fclose(f) == 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+
+// Ingest of raw samples, per field mode. The marker is benchmarked
+// separately, so is disabled here.
+static void bench_ingest_modes(BenchGaze &gaze) {
+    const pair<int, const char*> modes[] = {
+        {GAZE_FIELDS_MINIMAL, "minimal"},
+        {GAZE_FIELDS_HUD, "hud"},
+        {GAZE_FIELDS_FULL, "full"},
+        {GAZE_FIELDS_PACKED, "packed"}};
+    vector<tobii_gaze_data_t> raw(BENCH_N_INGEST);
+    int mark_freq = gaze.m_mark_freq;
+
+    bench_raw_samples(raw);
+    gaze.m_mark_freq = INT_MAX;
+
+    for (auto const &mode : modes) {
+        gaze.set_fields(mode.first);
+        bench_runs("ingest", mode.second, raw.size(),
+            [&]() { bench_restamp(raw); },
+            [&]() { bench_ingest(gaze, raw); });
+    }
+
+    // Tracing's cost when on. When off, it's included in the above.
+    gaze.set_fields(GAZE_FIELDS_FULL);
+    g_gaze_trace.enable(True);
+    bench_runs("ingest", "full_traced", raw.size(),
+        [&]() { bench_restamp(raw); },
+        [&]() { bench_ingest(gaze, raw); });
+    g_gaze_trace.enable(False);
+
+    gaze.m_mark_freq = mark_freq;
+}
+
+// Enque of converted samples while the given number of reader threads poll
+// the smoothed gaze point, as the HUD and marker do.
+static void bench_enque_contended(BenchGaze &gaze, int n_readers) {
+    vector<tobii_gaze_data_t> raw(BENCH_N_ENQUE);
+    vector<gaze_data_t> cgds(BENCH_N_ENQUE);
+    vector<int64_t> latencies_ns;
+    atomic<bool> is_stopped(False);
+    vector<shared_ptr<boost::thread>> readers;
+
+    // The converted samples are rebuilt per run, w/ fresh timestamps
+    bench_raw_samples(raw);
+    latencies_ns.reserve(BENCH_N_RUNS * cgds.size());
+
+    for (int i = 0; i < n_readers; i++)
+        readers.push_back(make_shared<boost::thread>([&]() {
+            gaze_point_t gp;
+            while (!is_stopped)
+                gaze.get_gazepoint_smoothed(&gp);
+        }));
+
+    bench_result_t &result = bench_runs(
+        "enque_contended", "readers_" + to_string(n_readers), cgds.size(),
+        [&]() {
+            int64_t sample_us = 1000000 / BENCH_SAMPLE_HZ;
+            int64_t t_us = tobii_stub_now_us() - cgds.size() * sample_us;
+
+            for (size_t i = 0; i < cgds.size(); i++) {
+                tobii_gaze_data_t const &data = raw[i];
+                gaze_data_t *cgd = &cgds[i];
+
+                memset(cgd, 0, sizeof(*cgd));
+                cgd->unixtime_us = t_us + i * sample_us;
+                cgd->validity = GAZE_VALID_BOTH;
+                cgd->seq = i;
+                cgd->combined_gazepoint_x = gaze.disp_x_from_normed_x(
+                    data.left.gaze_point_on_display_normalized_xy[0]);
+                cgd->combined_gazepoint_y = gaze.disp_y_from_normed_y(
+                    data.left.gaze_point_on_display_normalized_xy[1]);
+                cgd->left_eyeposition_normed_x =
+                    data.left.eye_position_in_track_box_normalized_xyz[0];
+                cgd->right_eyeposition_normed_x =
+                    data.right.eye_position_in_track_box_normalized_xyz[0];
+            }
+        },
+        [&]() {
+            for (auto &cgd : cgds) {
+                int64_t start_ns = bench_now_ns();
+                gaze.enque_gaze_data(&cgd);
+                latencies_ns.push_back(bench_now_ns() - start_ns);
+            }
+        });
+
+    is_stopped = True;
+    for (auto &reader : readers)
+        reader->join();
+
+    sort(latencies_ns.begin(), latencies_ns.end());
+    result.has_latency = True;
+    result.p50_ns = bench_pct(latencies_ns, 0.50);
+    result.p99_ns = bench_pct(latencies_ns, 0.99);
+    result.max_ns = latencies_ns.back();
+}
+
+// The smoothed gaze point, over a full buffer, per smoothing window, w/ or
+// w/o the ML accuracy-assist.
+static void bench_smoothed(BenchGaze &gaze, bool use_ml) {
+    const int windows[] = {1, 4, BENCH_SMOOTH_OVER, 64, 256};
+    const char *name = use_ml ? "smoothed_ml" : "smoothed";
+    vector<tobii_gaze_data_t> raw(BENCH_BUFF_SZ);
+    int n_calls = use_ml ? BENCH_N_SMOOTH_ML : BENCH_N_SMOOTH;
+
+    if (use_ml && !gaze.set_use_ml(True)) {
+        for (int window : windows)
+            bench_skip(name, "window_" + to_string(window));
+        return;
+    }
+
+    bench_raw_samples(raw);
+    bench_fill(gaze, raw);
+
+    for (int window : windows) {
+        gaze.set_smooth_over(window);
+        bench_runs(name, "window_" + to_string(window), n_calls,
+            []() {},
+            [&]() {
+                gaze_point_t gp;
+                for (int i = 0; i < n_calls; i++)
+                    gaze.get_gazepoint_smoothed(&gp);
+            });
+    }
+
+    gaze.set_smooth_over(BENCH_SMOOTH_OVER);
+    gaze.set_use_ml(False);
+}
+
+// Export of a full buffer, to CSV or the binary log, timed to the async
+// writer's completion. Ops are samples.
+static void bench_export(BenchGaze &gaze, bool is_csv) {
+    const char *path = is_csv ? BENCH_CSV_PATH : BENCH_LOG_PATH;
+    vector<tobii_gaze_data_t> raw(BENCH_BUFF_SZ);
+    const char *label = gaze.intern_label("bench");
+
+    bench_raw_samples(raw);
+
+    bench_runs(is_csv ? "tocsv" : "tolog", "full_buff", BENCH_BUFF_SZ,
+        [&]() {
+            remove(path);
+            bench_fill(gaze, raw);
+        },
+        [&]() {
+            if (is_csv)
+                gaze.gaze_data_tocsv(path, 0, label);
+            else
+                gaze.gaze_data_tolog(path, 0, label);
+            gaze.stop();    // Joins the writer
+        });
+
+    remove(path);
+}
+
+// Gaze marker updates, w/ the overlay window or by cursor capture.
+static void bench_marker(BenchGaze &gaze) {
+    vector<tobii_gaze_data_t> raw(BENCH_BUFF_SZ);
+
+    bench_raw_samples(raw);
+    bench_fill(gaze, raw);
+
+    for (int is_cursor = 0; is_cursor < 2; is_cursor++) {
+        gaze.set_cursor_capture(is_cursor);
+        bench_runs("marker", is_cursor ? "cursor" : "overlay", BENCH_N_MARKER,
+            []() {},
+            [&]() {
+                for (int i = 0; i < BENCH_N_MARKER; i++)
+                    gaze.set_gaze_marker();
+            });
+    }
+
+    gaze.set_cursor_capture(False);
+}
+
+int main(int argc, char **argv) {
+    const char *json_path = argc > 1 ? argv[1] : BENCH_JSON_PATH;
+    const char *ml_x_path = argc > 3 ? argv[2] : NULL;
+    const char *ml_y_path = argc > 3 ? argv[3] : NULL;
+
+    // The marker overlay needs a display
+    Display *disp = XOpenDisplay(NULL);
+    if (!disp) {
+        error("No X display. Run under Xvfb, e.g. w/ ");
+        printf("lib/sh/bench_eyetracker_gaze.sh\n");
+        return 1;
+    }
+    XCloseDisplay(disp);
+
+    // The models' module is pyx, so is imported via pyximport. The GIL is
+    // then released, for the models to take as from any other thread.
+    if (ml_x_path) {
+        Py_Initialize();
+        PyEval_InitThreads();
+        PyRun_SimpleString("import pyximport; pyximport.install()");
+        PyEval_SaveThread();
+    }
+
+    BenchGaze gaze(BENCH_DISP_WIDTH_MM,
+                   BENCH_DISP_HEIGHT_MM,
+                   BENCH_DISP_WIDTH_PX,
+                   BENCH_DISP_HEIGHT_PX,
+                   BENCH_MARK_INTERVAL,
+                   BENCH_BUFF_SZ,
+                   BENCH_SMOOTH_OVER,
+                   ml_x_path,
+                   ml_y_path);
+    gaze.denote_ml_loaded();
+    gaze.set_use_ml(False);
+    gaze.set_sample_rate(BENCH_SAMPLE_HZ);
+
+    const char *kernel =
+        gaze_convert_select() == gaze_convert_avx2 ? "avx2" : "scalar";
+
+    printf("\n%-16s %-14s %10s %10s\n",
+           "benchmark", "variant", "best_ns", "median_ns");
+
+    bench_ingest_modes(gaze);
+
+    for (int n_readers : {0, 1, 2, 4})
+        bench_enque_contended(gaze, n_readers);
+
+    bench_smoothed(gaze, False);
+    bench_smoothed(gaze, True);
+    bench_export(gaze, True);
+    bench_export(gaze, False);
+    bench_marker(gaze);
+
+    if (!bench_write_json(json_path, kernel)) {
+        error("Failed to write results to ");
+        printf("%s\n", json_path);
+        return 1;
+    }
+
+    printf("\nResults written to %s\n", json_path);
+
+    return 0;
+}
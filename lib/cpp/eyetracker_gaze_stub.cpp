@@ -0,0 +1,13 @@
+/////////////////////////////////////////////////////////////////////////////
+// The eyetracker_gaze lib, built against the stubbed stream engine (see
+// tobii_stub.h) rather than the device's. A synthetic backend for exercising
+// the Python API w/o an eyetracker device, e.g. by bench_eyetracker_api.py.
+//
+// Build with lib/sh/prep_eyetracker_gaze_stub.sh
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include "tobii_stub.h"
+#include "eyetracker_gaze.h"
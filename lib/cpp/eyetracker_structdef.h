@@ -5,11 +5,17 @@
 //
 /////////////////////////////////////////////////////////////////////////////
 
+// Fields are ordered such that each of the ingest field modes' records
+// (see GAZE_FIELDS_*) is a prefix of this struct.
 typedef struct gaze_data {
         int64_t unixtime_us;
 
-        float left_pupildiameter_mm;
-        float right_pupildiameter_mm;
+        int combined_gazepoint_x;
+        int combined_gazepoint_y;
+
+        uint8_t validity;           // Valid eyes, as GAZE_VALID_* bits
+        uint8_t flags;              // As GAZE_FLAG_* bits
+        uint32_t seq;               // Ingest order, incl. invalid samples
 
         float left_eyeposition_normed_x;
 		float left_eyeposition_normed_y;
@@ -18,6 +24,9 @@ typedef struct gaze_data {
 		float right_eyeposition_normed_y;
 		float right_eyeposition_normed_z;
 
+        float left_pupildiameter_mm;
+        float right_pupildiameter_mm;
+
         float left_eyecenter_mm_x;
 		float left_eyecenter_mm_y;
 		float left_eyecenter_mm_z;
@@ -43,13 +52,156 @@ typedef struct gaze_data {
 		float left_gazepoint_normed_y;
 		float right_gazepoint_normed_x;
 		float right_gazepoint_normed_y;
-
-        int combined_gazepoint_x;
-        int combined_gazepoint_y;
 	    } gaze_data_t;
 
+// A gaze_data_t in compact, fixed-point form (see gaze_pack.h). Timestamps
+// and sequence numbers are relative to bases held per block of records, e.g.
+// by the ring or log.
+typedef struct gaze_packed {
+        int32_t dt_us;              // From the block's base timestamp
+        int16_t combined_gazepoint_x;
+        int16_t combined_gazepoint_y;
+        uint8_t validity;
+        uint8_t flags;
+        uint16_t dseq;              // From the block's base seq
+        int16_t fields[30];         // left_eyeposition_normed_x ... on
+	    } gaze_packed_t;
+
 typedef struct gaze_point {
         int n_samples;
         int x_coord;
         int y_coord;
+        int key_idx;
 	    } gaze_point_t;
+
+typedef struct hud_key {
+        int x;
+        int y;
+        int width;
+        int height;
+	    } hud_key_t;
+
+typedef struct gaze_event {
+        int type;
+        int key_idx;
+        int64_t unixtime_us;
+        int64_t duration_us;
+	    } gaze_event_t;
+
+typedef struct aoi_stats {
+        int id;
+        int x;
+        int y;
+        int width;
+        int height;
+        int n_entries;
+        int64_t dwell_us;
+        int64_t first_entry_us;    // Latency from AOI add to first entry, or -1
+	    } aoi_stats_t;
+
+typedef struct gaze_agg {
+        int64_t unixtime_us;        // Start of the aggregated period
+        int64_t duration_us;        // Length of the period (0 if raw sample)
+        int n_samples;              // Valid samples aggregated
+        float valid_frac;           // Valid samples / all samples
+        float mean_x;
+        float mean_y;
+        int min_x;
+        int max_x;
+        int min_y;
+        int max_y;
+	    } gaze_agg_t;
+
+typedef struct gaze_cold_stats {
+        int64_t n_samples;          // Samples currently retained
+        int64_t n_pages;
+        int64_t bytes_used;         // Bytes of pages in use
+        int64_t bytes_raw;          // Bytes the samples occupy uncompressed
+        double encode_ns;           // Mean encode time per sample
+        double decode_ns;           // Mean decode time per sample
+	    } gaze_cold_stats_t;
+
+typedef struct gaze_quality {
+        int64_t n_samples;          // Samples seen, valid or not
+        float rms_s2s_px;           // RMS sample-to-sample dist in fixations
+        float rms_s2s_baseline_px;  // rms_s2s_px of the first full window
+        float left_invalid_ratio;
+        float right_invalid_ratio;
+        int n_bursts;               // Dropout bursts in the burst window
+        int burst_max;              // Longest dropout burst, in samples
+        float burst_mean;
+        int burst_current;          // Length of any dropout in progress
+        int is_degraded;            // Are thresholds currently crossed?
+	    } gaze_quality_t;
+
+typedef struct startup_stage {
+        char name[32];
+        int64_t start_us;           // From the start of startup
+        int64_t duration_us;
+        int worker;                 // Idx of the executor thread that ran it
+	    } startup_stage_t;
+
+typedef struct device_conn_stats {
+        int64_t n_disconnects;
+        int64_t n_attempts;         // Reconnect attempts, over all outages
+        int64_t last_outage_us;     // From connection loss to gaze resumed
+        int64_t max_outage_us;
+        int is_connected;
+	    } device_conn_stats_t;
+
+typedef struct gaze_gap {
+        int type;                   // As GAZE_GAP_*
+        uint32_t seq;               // Of the first sample after, or lost
+        int64_t unixtime_us;        // Start of the gap
+        int64_t duration_us;
+        int64_t n_samples;          // Lost (estimated, if on the device side)
+	    } gaze_gap_t;
+
+typedef struct gaze_replay_params {
+        int smooth_over;            // As EyeTrackerGaze's
+        int quality_window;         // As GazeQuality::configure()'s
+        float quality_fixation_px_s;
+        float quality_max_rms_px;
+        float quality_max_invalid;
+        int n_threads;              // Or 0 for one per core
+        int64_t shard_us;           // Or 0 for one shard per log
+        int64_t warmup_us;          // Replayed before each shard, w/o output
+	    } gaze_replay_params_t;
+
+typedef struct gaze_replay_stats {
+        int64_t n_samples;          // Written
+        int64_t n_warmup;           // Replayed for warm-up only
+        int n_logs;                 // Replayed
+        int n_failed;               // Logs not opened or written
+        int n_shards;
+        int n_threads;
+        int64_t elapsed_us;
+	    } gaze_replay_stats_t;
+
+typedef struct gaze_index_hit {
+        int64_t unixtime_us;
+        uint32_t seq;
+        int x;
+        int y;
+        int validity;
+	    } gaze_index_hit_t;
+
+typedef struct gaze_index_stats {
+        int64_t n_blocks;           // In the logs queried
+        int64_t n_blocks_scanned;   // Not pruned by time, label or region
+        int64_t n_records_scanned;
+        int64_t n_hits;
+        int n_logs;                 // Queried
+        int n_failed;               // Logs not opened
+        int64_t elapsed_us;
+	    } gaze_index_stats_t;
+
+typedef struct gaze_csv_stats {
+        int64_t n_rows;             // Converted
+        int64_t n_labeled;          // Of n_rows, w/ a label
+        int64_t n_malformed;        // Rows skipped
+        int64_t first_malformed;    // Line number (from 1) of the first, or 0
+        int64_t n_bytes;            // Of the CSV
+        int n_threads;
+        int64_t elapsed_us;
+	    } gaze_csv_stats_t;
@@ -0,0 +1,213 @@
+/////////////////////////////////////////////////////////////////////////////
+// A registry of areas of interest (AOIs), i.e. display rects, w/ per-AOI
+// time-on-target counters maintained from the gaze sample stream. AOIs may
+// be added or removed at any time and may overlap.
+//
+// AOIs are indexed by a uniform grid over the display, so classifying a
+// sample costs only a test of the few AOIs overlapping its grid cell, and
+// counters (dwell time, entry count and first-entry latency) are updated
+// incrementally, so per-sample cost is independent of the number of AOIs.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define AOI_GRID_CELL_PX 64
+#define AOI_NONE -1
+
+typedef struct aoi {
+        aoi_stats_t stats;
+        int64_t added_us;
+        bool is_in;             // Was the most recent sample inside?
+	    } aoi_t;
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class AOIRegistry {
+    public:
+        int add(int, int, int, int);
+        bool remove(int);
+        void update(int64_t, int, int);
+        int snapshot(aoi_stats_t*, int);
+        void reset_stats();
+        int count();
+
+        AOIRegistry(int, int);
+
+    protected:
+        int m_grid_cols;
+        int m_grid_rows;
+        int m_next_id;
+        int64_t m_prev_us;
+        vector<aoi_t> m_aois;
+        vector<vector<int>> m_grid;     // Cell -> Idxs of AOIs overlapping it
+        vector<int> m_active;           // Idxs of AOIs containing prev sample
+        vector<int> m_prev_active;
+
+        void index();
+        void exit_all();
+};
+
+// Constructor. The grid index covers a display of the given dims.
+AOIRegistry::AOIRegistry(int disp_width_px, int disp_height_px) {
+    m_grid_cols = (disp_width_px + AOI_GRID_CELL_PX - 1) / AOI_GRID_CELL_PX;
+    m_grid_rows = (disp_height_px + AOI_GRID_CELL_PX - 1) / AOI_GRID_CELL_PX;
+    m_grid.resize(m_grid_cols * m_grid_rows);
+    m_next_id = 0;
+    m_prev_us = 0;
+}
+
+// Adds an AOI having the given display rect and returns its id, or AOI_NONE
+// if the rect is empty.
+int AOIRegistry::add(int x, int y, int width, int height) {
+    if (width <= 0 || height <= 0)
+        return AOI_NONE;
+
+    aoi_t aoi;
+    aoi.stats = aoi_stats_t{m_next_id++, x, y, width, height, 0, 0, -1};
+    aoi.added_us = time_point_cast<microseconds>(
+        system_clock::now()).time_since_epoch().count();
+    aoi.is_in = false;
+
+    m_aois.push_back(aoi);
+    index();
+
+    return aoi.stats.id;
+}
+
+// Removes the AOI having the given id. Returns false if no such AOI.
+bool AOIRegistry::remove(int id) {
+    for (size_t i = 0; i < m_aois.size(); i++) {
+        if (m_aois[i].stats.id != id)
+            continue;
+
+        m_aois.erase(m_aois.begin() + i);
+        index();
+
+        // Shift active idxs past the removed AOI, keeping the others active
+        vector<int> active;
+        for (int j : m_active)
+            if (j != (int)i)
+                active.push_back(j > (int)i ? j - 1 : j);
+        m_active.swap(active);
+
+        return true;
+    }
+
+    return false;
+}
+
+// Rebuilds the grid index. Called only on add/remove, so it may be slow.
+void AOIRegistry::index() {
+    for (auto &cell : m_grid)
+        cell.clear();
+
+    for (size_t i = 0; i < m_aois.size(); i++) {
+        aoi_stats_t *s = &m_aois[i].stats;
+
+        int c0 = max(s->x / AOI_GRID_CELL_PX, 0);
+        int r0 = max(s->y / AOI_GRID_CELL_PX, 0);
+        int c1 = min((s->x + s->width - 1) / AOI_GRID_CELL_PX, m_grid_cols - 1);
+        int r1 = min((s->y + s->height - 1) / AOI_GRID_CELL_PX, m_grid_rows - 1);
+
+        for (int r = r0; r <= r1; r++)
+            for (int c = c0; c <= c1; c++)
+                m_grid[r * m_grid_cols + c].push_back(i);
+    }
+}
+
+// Marks every AOI as not containing the gaze, so the next sample in any AOI
+// counts as an entry.
+void AOIRegistry::exit_all() {
+    for (int i : m_active)
+        m_aois[i].is_in = false;
+
+    m_active.clear();
+}
+
+// Updates AOI counters from a gaze sample at time t_us and display coords
+// (x, y). Dwell accrues to each AOI containing both this sample and the
+// previous one, w/ dropouts (see DWELL_MAX_SAMPLE_GAP_US) counting as exits.
+void AOIRegistry::update(int64_t t_us, int x, int y) {
+    int64_t dt_us = m_prev_us > 0 ? t_us - m_prev_us : 0;
+    m_prev_us = t_us;
+
+    if (dt_us < 0 || dt_us > DWELL_MAX_SAMPLE_GAP_US)
+        exit_all();
+
+    // Swap (not copy) active sets, so no per-sample allocation occurs
+    m_prev_active.swap(m_active);
+    m_active.clear();
+
+    int c = x / AOI_GRID_CELL_PX;
+    int r = y / AOI_GRID_CELL_PX;
+
+    if (x >= 0 && y >= 0 && c < m_grid_cols && r < m_grid_rows) {
+        for (int i : m_grid[r * m_grid_cols + c]) {
+            aoi_t *aoi = &m_aois[i];
+            aoi_stats_t *s = &aoi->stats;
+
+            if (x < s->x || x >= s->x + s->width ||
+                y < s->y || y >= s->y + s->height)
+                    continue;
+
+            if (aoi->is_in) {
+                s->dwell_us += dt_us;
+            } else {
+                s->n_entries++;
+                if (s->first_entry_us < 0)
+                    s->first_entry_us = max((int64_t)0, t_us - aoi->added_us);
+            }
+
+            m_active.push_back(i);
+        }
+    }
+
+    // Exit any AOIs the gaze has left, then mark those it is in
+    for (int i : m_prev_active)
+        m_aois[i].is_in = false;
+
+    for (int i : m_active)
+        m_aois[i].is_in = true;
+}
+
+// Copies the stats of (at most) n AOIs to out, in order added. Returns the
+// total number of AOIs, which may exceed n.
+int AOIRegistry::snapshot(aoi_stats_t *out, int n) {
+    int n_copy = min(n, (int)m_aois.size());
+
+    for (int i = 0; i < n_copy; i++)
+        out[i] = m_aois[i].stats;
+
+    return m_aois.size();
+}
+
+// Zeroes all AOI counters. First-entry latencies restart from now.
+void AOIRegistry::reset_stats() {
+    int64_t now_us = time_point_cast<microseconds>(
+        system_clock::now()).time_since_epoch().count();
+
+    exit_all();
+
+    for (auto &aoi : m_aois) {
+        aoi.stats.n_entries = 0;
+        aoi.stats.dwell_us = 0;
+        aoi.stats.first_entry_us = -1;
+        aoi.added_us = now_us;
+    }
+}
+
+// Returns the number of AOIs.
+int AOIRegistry::count() {
+    return m_aois.size();
+}
@@ -0,0 +1,204 @@
+/////////////////////////////////////////////////////////////////////////////
+// Batch conversion of raw device gaze samples. Samples queued by the device
+// are staged raw, then converted a batch at a time: device to system
+// timestamps, per-eye validity, normalized to display coords and the
+// combining of both eyes' gaze points (else the valid eye's alone). The
+// conversion has an AVX2 kernel, 8 samples at a time, and a scalar one,
+// selected at runtime by CPU support. Both give bit-identical results.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <immintrin.h>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define GAZE_CONVERT_MAX 64     // Max samples per batch
+#define GAZE_VALID_LEFT 0x1
+#define GAZE_VALID_RIGHT 0x2
+#define GAZE_VALID_BOTH (GAZE_VALID_LEFT | GAZE_VALID_RIGHT)
+
+typedef struct gaze_convert_params {
+        int64_t time_offset_us;     // Device to system clock
+        float disp_width;           // In px
+        float disp_height;
+	    } gaze_convert_params_t;
+
+// Per-sample conversion results, as arrays
+typedef struct gaze_points {
+        int64_t unixtime_us[GAZE_CONVERT_MAX];
+        int x[GAZE_CONVERT_MAX];
+        int y[GAZE_CONVERT_MAX];
+        uint8_t validity[GAZE_CONVERT_MAX];     // As GAZE_VALID_* bits
+	    } gaze_points_t;
+
+typedef void (*gaze_convert_fn_t)(tobii_gaze_data_t const*,
+                                  int,
+                                  gaze_convert_params_t const&,
+                                  gaze_points_t*);
+
+/////////////////////////////////////////////////////////////////////////////
+// Kernels
+
+// Converts the first n (<= GAZE_CONVERT_MAX) of the given raw samples to
+// pts, starting at sample i.
+static void gaze_convert_from(tobii_gaze_data_t const *raw,
+                              int i,
+                              int n,
+                              gaze_convert_params_t const &params,
+                              gaze_points_t *pts) {
+    for (; i < n; i++) {
+        tobii_gaze_data_t const *data = &raw[i];
+        uint8_t validity =
+            (data->left.gaze_point_validity == TOBII_VALIDITY_VALID ?
+                GAZE_VALID_LEFT : 0) |
+            (data->right.gaze_point_validity == TOBII_VALIDITY_VALID ?
+                GAZE_VALID_RIGHT : 0);
+
+        int left_x =
+            data->left.gaze_point_on_display_normalized_xy[0] * params.disp_width;
+        int left_y =
+            data->left.gaze_point_on_display_normalized_xy[1] * params.disp_height;
+        int right_x =
+            data->right.gaze_point_on_display_normalized_xy[0] * params.disp_width;
+        int right_y =
+            data->right.gaze_point_on_display_normalized_xy[1] * params.disp_height;
+
+        pts->unixtime_us[i] = data->timestamp_system_us + params.time_offset_us;
+        pts->validity[i] = validity;
+
+        if (validity == GAZE_VALID_BOTH) {
+            pts->x[i] = (left_x + right_x) / 2;
+            pts->y[i] = (left_y + right_y) / 2;
+        } else if (validity == GAZE_VALID_LEFT) {
+            pts->x[i] = left_x;
+            pts->y[i] = left_y;
+        } else {
+            pts->x[i] = right_x;
+            pts->y[i] = right_y;
+        }
+    }
+}
+
+// Scalar kernel. Converts the first n of the given raw samples to pts.
+void gaze_convert_scalar(tobii_gaze_data_t const *raw,
+                         int n,
+                         gaze_convert_params_t const &params,
+                         gaze_points_t *pts) {
+    gaze_convert_from(raw, 0, n, params, pts);
+}
+
+// Returns the given float fields' coords of 8 samples, as display coords,
+// given the fields' byte offsets (vidx) from base.
+__attribute__((target("avx2")))
+static inline __m256i gaze_convert_coords(char const *base,
+                                          __m256i vidx,
+                                          __m256 scale) {
+    __m256 normed = _mm256_i32gather_ps((float const*)base, vidx, 1);
+    return _mm256_cvttps_epi32(_mm256_mul_ps(normed, scale));
+}
+
+// Returns the combined coords of 8 samples: both eyes' averaged (rounding
+// toward zero, as int division does) if both valid, else the left's if
+// valid, else the right's.
+__attribute__((target("avx2")))
+static inline __m256i gaze_convert_combine(__m256i left,
+                                           __m256i right,
+                                           __m256i is_left,
+                                           __m256i is_both) {
+    __m256i sum = _mm256_add_epi32(left, right);
+    __m256i avg = _mm256_srai_epi32(
+        _mm256_add_epi32(sum, _mm256_srli_epi32(sum, 31)), 1);
+    __m256i one = _mm256_blendv_epi8(right, left, is_left);
+
+    return _mm256_blendv_epi8(one, avg, is_both);
+}
+
+// AVX2 kernel. Converts the first n of the given raw samples to pts, 8 at a
+// time, w/ any remainder done by the scalar kernel.
+__attribute__((target("avx2")))
+void gaze_convert_avx2(tobii_gaze_data_t const *raw,
+                       int n,
+                       gaze_convert_params_t const &params,
+                       gaze_points_t *pts) {
+    const int stride = sizeof(tobii_gaze_data_t);
+    const __m256i vidx = _mm256_mullo_epi32(
+        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+    const __m256 width = _mm256_set1_ps(params.disp_width);
+    const __m256 height = _mm256_set1_ps(params.disp_height);
+    const __m256i valid = _mm256_set1_epi32(TOBII_VALIDITY_VALID);
+    const __m256i offset = _mm256_set1_epi64x(params.time_offset_us);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        char const *base = (char const*)&raw[i];
+
+        // Validity
+        __m256i is_left = _mm256_cmpeq_epi32(valid, _mm256_i32gather_epi32(
+            (int const*)(base + offsetof(tobii_gaze_data_t, left) +
+                offsetof(tobii_gaze_data_eye_t, gaze_point_validity)),
+            vidx, 1));
+        __m256i is_right = _mm256_cmpeq_epi32(valid, _mm256_i32gather_epi32(
+            (int const*)(base + offsetof(tobii_gaze_data_t, right) +
+                offsetof(tobii_gaze_data_eye_t, gaze_point_validity)),
+            vidx, 1));
+        __m256i is_both = _mm256_and_si256(is_left, is_right);
+
+        // Display coords, per eye, then combined
+        char const *left_xy = base + offsetof(tobii_gaze_data_t, left) +
+            offsetof(tobii_gaze_data_eye_t, gaze_point_on_display_normalized_xy);
+        char const *right_xy = base + offsetof(tobii_gaze_data_t, right) +
+            offsetof(tobii_gaze_data_eye_t, gaze_point_on_display_normalized_xy);
+
+        __m256i x = gaze_convert_combine(
+            gaze_convert_coords(left_xy, vidx, width),
+            gaze_convert_coords(right_xy, vidx, width),
+            is_left, is_both);
+        __m256i y = gaze_convert_combine(
+            gaze_convert_coords(left_xy + sizeof(float), vidx, height),
+            gaze_convert_coords(right_xy + sizeof(float), vidx, height),
+            is_left, is_both);
+
+        _mm256_storeu_si256((__m256i*)&pts->x[i], x);
+        _mm256_storeu_si256((__m256i*)&pts->y[i], y);
+
+        // Validity as bits, packing 8 lanes into 8 bytes
+        __m256i bits = _mm256_or_si256(
+            _mm256_and_si256(is_left, _mm256_set1_epi32(GAZE_VALID_LEFT)),
+            _mm256_and_si256(is_right, _mm256_set1_epi32(GAZE_VALID_RIGHT)));
+        __m128i bits16 = _mm_packus_epi32(_mm256_castsi256_si128(bits),
+                                          _mm256_extracti128_si256(bits, 1));
+        _mm_storel_epi64((__m128i*)&pts->validity[i],
+                         _mm_packus_epi16(bits16, bits16));
+
+        // Timestamps, 4 at a time
+        __m128i vidx4 = _mm256_castsi256_si128(vidx);
+        long long const *t_base = (long long const*)(
+            base + offsetof(tobii_gaze_data_t, timestamp_system_us));
+
+        _mm256_storeu_si256((__m256i*)&pts->unixtime_us[i], _mm256_add_epi64(
+            offset, _mm256_i32gather_epi64(t_base, vidx4, 1)));
+        _mm256_storeu_si256((__m256i*)&pts->unixtime_us[i + 4], _mm256_add_epi64(
+            offset, _mm256_i32gather_epi64(t_base, _mm_add_epi32(
+                vidx4, _mm_set1_epi32(4 * stride)), 1)));
+    }
+
+    // Avoids AVX to SSE transition stalls in the (non-AVX) caller
+    _mm256_zeroupper();
+
+    gaze_convert_from(raw, i, n, params, pts);
+}
+
+// Returns the fastest kernel the CPU supports.
+gaze_convert_fn_t gaze_convert_select() {
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return gaze_convert_avx2;
+
+    return gaze_convert_scalar;
+}
@@ -0,0 +1,155 @@
+/////////////////////////////////////////////////////////////////////////////
+// Microbenchmark of the gaze sample batch conversion kernels. Random raw
+// samples (incl. invalid eyes, w/ their garbage coords) are converted by
+// each kernel the CPU supports, at batch sizes of 1, 8 and 64, and the time
+// per sample is reported. Each kernel's results are first verified as
+// bit-identical to the scalar kernel's. Exits non-zero if they're not.
+//
+// Build and run with lib/sh/bench_gaze_convert.sh
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_advanced.h>
+
+#include "gaze_convert.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define BENCH_N_SAMPLES (1 << 16)       // Converted per timed run
+#define BENCH_N_RUNS 50                 // Fastest run is reported
+#define BENCH_DISP_WIDTH 1920
+#define BENCH_DISP_HEIGHT 1080
+
+typedef struct bench_kernel {
+        const char *name;
+        gaze_convert_fn_t fn;
+	    } bench_kernel_t;
+
+// Populates the given raw samples randomly. Roughly 1 in 5 of each eye is
+// invalid, and invalid eyes' coords are NaN or out of range, as from the
+// device.
+static void bench_samples(vector<tobii_gaze_data_t> &raw) {
+    mt19937 rng(7);
+    uniform_real_distribution<float> coord(-0.1, 1.1);
+    uniform_int_distribution<int> pct(0, 99);
+
+    for (size_t i = 0; i < raw.size(); i++) {
+        tobii_gaze_data_t *data = &raw[i];
+        tobii_gaze_data_eye_t *eyes[] = {&data->left, &data->right};
+
+        memset(data, 0, sizeof(*data));
+        data->timestamp_system_us = 1000000000000 + i * 8333;
+
+        for (auto *eye : eyes) {
+            bool is_valid = pct(rng) >= 20;
+            eye->gaze_point_validity =
+                is_valid ? TOBII_VALIDITY_VALID : TOBII_VALIDITY_INVALID;
+            eye->gaze_point_on_display_normalized_xy[0] =
+                is_valid || pct(rng) < 50 ? coord(rng) : NAN;
+            eye->gaze_point_on_display_normalized_xy[1] =
+                is_valid || pct(rng) < 50 ? coord(rng) : -5e9;
+        }
+    }
+}
+
+// Converts the given raw samples w/ the given kernel, in batches of the
+// given size, populating out w/ each batch's results back to back.
+static void bench_convert(gaze_convert_fn_t fn,
+                          vector<tobii_gaze_data_t> const &raw,
+                          int batch_sz,
+                          gaze_convert_params_t const &params,
+                          vector<gaze_points_t> &out) {
+    for (size_t i = 0, j = 0; i < raw.size(); i += batch_sz, j++)
+        fn(&raw[i], batch_sz, params, &out[j % out.size()]);
+}
+
+// Returns true iff the given batch results match in their first n samples.
+static bool bench_is_equal(gaze_points_t const &a,
+                           gaze_points_t const &b,
+                           int n) {
+    return !memcmp(a.unixtime_us, b.unixtime_us, n * sizeof(a.unixtime_us[0]))
+        && !memcmp(a.x, b.x, n * sizeof(a.x[0]))
+        && !memcmp(a.y, b.y, n * sizeof(a.y[0]))
+        && !memcmp(a.validity, b.validity, n * sizeof(a.validity[0]));
+}
+
+int main() {
+    const int batch_szs[] = {1, 8, 64};
+    const gaze_convert_params_t params = {
+        -123456789, BENCH_DISP_WIDTH, BENCH_DISP_HEIGHT};
+    vector<tobii_gaze_data_t> raw(BENCH_N_SAMPLES);
+    vector<bench_kernel_t> kernels = {{"scalar", gaze_convert_scalar}};
+    bool is_exact = true;
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        kernels.push_back({"avx2", gaze_convert_avx2});
+    else
+        printf("AVX2 unsupported by this CPU, benchmarking scalar only.\n");
+
+    bench_samples(raw);
+
+    // Verify each kernel against the scalar, at every batch size
+    for (int batch_sz : batch_szs) {
+        int n_batches = BENCH_N_SAMPLES / batch_sz;
+        vector<gaze_points_t> expected(n_batches);
+        bench_convert(gaze_convert_scalar, raw, batch_sz, params, expected);
+
+        for (size_t k = 1; k < kernels.size(); k++) {
+            vector<gaze_points_t> actual(n_batches);
+            bench_convert(kernels[k].fn, raw, batch_sz, params, actual);
+
+            for (int j = 0; j < n_batches; j++) {
+                if (!bench_is_equal(expected[j], actual[j], batch_sz)) {
+                    printf("MISMATCH: %s, batch size %d, batch %d\n",
+                           kernels[k].name, batch_sz, j);
+                    is_exact = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    printf("\n%10s", "batch_sz");
+    for (auto &kernel : kernels)
+        printf(" %12s", (string(kernel.name) + "_ns").c_str());
+    printf("\n");
+
+    // Time each kernel, reusing a cache-resident set of result batches
+    vector<gaze_points_t> out(16);
+
+    for (int batch_sz : batch_szs) {
+        printf("%10d", batch_sz);
+
+        for (auto &kernel : kernels) {
+            int64_t best_ns = INT64_MAX;
+
+            for (int r = 0; r < BENCH_N_RUNS; r++) {
+                auto start = steady_clock::now();
+                bench_convert(kernel.fn, raw, batch_sz, params, out);
+                best_ns = min(best_ns, (int64_t)duration_cast<nanoseconds>(
+                    steady_clock::now() - start).count());
+            }
+
+            printf(" %12.2f", (double)best_ns / BENCH_N_SAMPLES);
+        }
+        printf("\n");
+    }
+
+    printf("\nKernel results %s.\n", is_exact ? "bit-identical" : "DIFFER");
+
+    return is_exact ? 0 : 1;
+}
@@ -0,0 +1,486 @@
+/////////////////////////////////////////////////////////////////////////////
+// Conversion of gaze CSV, as written by EyeTrackerGaze::gaze_data_tocsv(),
+// to the binary gaze log (see gaze_log.h). Each row is a sample's timestamp,
+// its float fields and its combined gaze point (GAZE_CSV_N_COLS columns),
+// optionally followed by a label. Columns may be separated by "," w/ any
+// blanks around it (e.g. ", "), and rows by "\n" or "\r\n". Blank rows are
+// skipped, and rows w/ any other column count or an unparsable column are
+// skipped and counted as malformed.
+//
+// The CSV is memory-mapped and converted in segments of GAZE_CSV_SEGMENT_SZ
+// bytes. Each segment is split at row boundaries across a pool of threads
+// and parsed while the calling thread writes the previous segment's samples
+// to the log, in order. Floats are parsed exactly by a fast path for those
+// of at most 7 significant digits and small exponents, as gaze_data_tocsv()
+// writes, else by strtof().
+//
+// As gaze_data_tocsv() writes only binocular samples, each sample is taken
+// as having both eyes valid, and samples are given consecutive seqs, from 0.
+// Row labels, w/o surrounding blanks, are interned in the log's label
+// dictionary (see gaze_log.h), each run of rows sharing a label spanning its
+// own blocks.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <boost/thread.hpp>
+
+using namespace std;
+using namespace std::chrono;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define GAZE_CSV_N_COLS 33                  // W/o the label
+#define GAZE_CSV_N_FLOATS 30
+#define GAZE_CSV_SEGMENT_SZ (64 << 20)
+#define GAZE_CSV_TOKEN_SZ 64                // Max len of a slow-path float
+#define GAZE_CSV_FAST_MAX_MANTISSA (1 << 24)
+#define GAZE_CSV_FAST_MAX_EXP 10
+
+// The float fields, in column order
+static const size_t g_gaze_csv_fields[GAZE_CSV_N_FLOATS] = {
+    offsetof(gaze_data_t, left_pupildiameter_mm),
+    offsetof(gaze_data_t, right_pupildiameter_mm),
+    offsetof(gaze_data_t, left_eyeposition_normed_x),
+    offsetof(gaze_data_t, left_eyeposition_normed_y),
+    offsetof(gaze_data_t, left_eyeposition_normed_z),
+    offsetof(gaze_data_t, right_eyeposition_normed_x),
+    offsetof(gaze_data_t, right_eyeposition_normed_y),
+    offsetof(gaze_data_t, right_eyeposition_normed_z),
+    offsetof(gaze_data_t, left_eyecenter_mm_x),
+    offsetof(gaze_data_t, left_eyecenter_mm_y),
+    offsetof(gaze_data_t, left_eyecenter_mm_z),
+    offsetof(gaze_data_t, right_eyecenter_mm_x),
+    offsetof(gaze_data_t, right_eyecenter_mm_y),
+    offsetof(gaze_data_t, right_eyecenter_mm_z),
+    offsetof(gaze_data_t, left_gazeorigin_mm_x),
+    offsetof(gaze_data_t, left_gazeorigin_mm_y),
+    offsetof(gaze_data_t, left_gazeorigin_mm_z),
+    offsetof(gaze_data_t, right_gazeorigin_mm_x),
+    offsetof(gaze_data_t, right_gazeorigin_mm_y),
+    offsetof(gaze_data_t, right_gazeorigin_mm_z),
+    offsetof(gaze_data_t, left_gazepoint_mm_x),
+    offsetof(gaze_data_t, left_gazepoint_mm_y),
+    offsetof(gaze_data_t, left_gazepoint_mm_z),
+    offsetof(gaze_data_t, right_gazepoint_mm_x),
+    offsetof(gaze_data_t, right_gazepoint_mm_y),
+    offsetof(gaze_data_t, right_gazepoint_mm_z),
+    offsetof(gaze_data_t, left_gazepoint_normed_x),
+    offsetof(gaze_data_t, left_gazepoint_normed_y),
+    offsetof(gaze_data_t, right_gazepoint_normed_x),
+    offsetof(gaze_data_t, right_gazepoint_normed_y)
+};
+
+// Powers of 10 exactly representable as floats
+static const float g_gaze_csv_pow10[GAZE_CSV_FAST_MAX_EXP + 1] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+// A run of a chunk's samples sharing a label
+typedef struct gaze_csv_label_run {
+        size_t first;               // Idx of the run's first sample
+        const char *label;          // In the CSV, so not NUL-terminated
+        size_t len;                 // 0 if unlabeled
+	    } gaze_csv_label_run_t;
+
+// The results of parsing a chunk of rows
+typedef struct gaze_csv_chunk {
+        const char *begin;
+        const char *end;
+        vector<gaze_data_t> samples;
+        vector<gaze_csv_label_run_t> labels;    // In sample order
+        int64_t n_lines;
+        int64_t n_labeled;
+        int64_t n_malformed;
+        int64_t first_malformed;    // Line idx in the chunk, or -1
+	    } gaze_csv_chunk_t;
+
+// Returns p advanced past any blanks, up to end.
+static inline const char* gaze_csv_skip_blanks(const char *p,
+                                               const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+// Parses the integer at p, up to end. Returns the end of the integer, or
+// NULL if none.
+static inline const char* gaze_csv_int(const char *p,
+                                       const char *end,
+                                       int64_t *out) {
+    bool is_neg = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+'))
+        p++;
+
+    const char *digits = p;
+    uint64_t v = 0;
+
+    while (p < end && (unsigned)(*p - '0') < 10 && p - digits < 19)
+        v = v * 10 + (*p++ - '0');
+
+    if (p == digits || (p < end && (unsigned)(*p - '0') < 10))
+        return NULL;
+
+    *out = is_neg ? -(int64_t)v : (int64_t)v;
+
+    return p;
+}
+
+// Parses the float at p, up to end. Returns the end of the float, or NULL
+// if none.
+static inline const char* gaze_csv_float(const char *p,
+                                         const char *end,
+                                         float *out) {
+    const char *start = p;
+    bool is_neg = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+'))
+        p++;
+
+    // Mantissa and decimal exponent. The mantissa may overflow iff there are
+    // over 19 digits, in which case the slow path is taken.
+    const char *digits = p;
+    uint64_t m = 0;
+
+    while (p < end && (unsigned)(*p - '0') < 10)
+        m = m * 10 + (*p++ - '0');
+
+    int n_digits = p - digits;
+    int exp10 = 0;
+
+    if (p < end && *p == '.') {
+        const char *frac = ++p;
+
+        while (p < end && (unsigned)(*p - '0') < 10)
+            m = m * 10 + (*p++ - '0');
+
+        exp10 = -(p - frac);
+        n_digits -= exp10;
+    }
+
+    if (n_digits && p < end && (*p == 'e' || *p == 'E')) {
+        int64_t e;
+        const char *q = gaze_csv_int(p + 1, end, &e);
+
+        if (q && e > -1000 && e < 1000) {
+            exp10 += e;
+            p = q;
+        }
+    }
+
+    // Fast path, exact as both operands are exact floats
+    if (n_digits && n_digits <= 19 &&
+        m <= GAZE_CSV_FAST_MAX_MANTISSA &&
+        exp10 >= -GAZE_CSV_FAST_MAX_EXP && exp10 <= GAZE_CSV_FAST_MAX_EXP) {
+        float f = exp10 < 0 ? (float)m / g_gaze_csv_pow10[-exp10] :
+                              (float)m * g_gaze_csv_pow10[exp10];
+        *out = is_neg ? -f : f;
+        return p;
+    }
+
+    // Else slow path, e.g. for long mantissas or nan, from a NUL-terminated
+    // copy of the token
+    char token[GAZE_CSV_TOKEN_SZ];
+    const char *token_end = start;
+
+    while (token_end < end && token_end - start < GAZE_CSV_TOKEN_SZ - 1 &&
+           *token_end != ',' && *token_end != ' ' && *token_end != '\t' &&
+           *token_end != '\r' && *token_end != '\n')
+        token_end++;
+
+    memcpy(token, start, token_end - start);
+    token[token_end - start] = '\0';
+
+    char *parsed_end;
+    *out = strtof(token, &parsed_end);
+
+    if (parsed_end == token)
+        return NULL;
+
+    return start + (parsed_end - token);
+}
+
+// Parses the row [p, end), w/o its line ending, into cgd, setting label and
+// label_len to its label, if any, else label_len to 0. Returns false if
+// malformed.
+static bool gaze_csv_row(const char *p,
+                         const char *end,
+                         gaze_data_t *cgd,
+                         const char **label,
+                         size_t *label_len) {
+    int64_t v;
+
+    memset(cgd, 0, sizeof(*cgd));
+
+    // Each column, then its separator or, after the last, the row's end or
+    // the label
+    for (int col = 0; ; col++) {
+        p = gaze_csv_skip_blanks(p, end);
+
+        if (col == 0 || col > GAZE_CSV_N_FLOATS) {
+            p = gaze_csv_int(p, end, &v);
+            if (!p)
+                return false;
+
+            if (col == 0)
+                cgd->unixtime_us = v;
+            else if (col == GAZE_CSV_N_COLS - 2)
+                cgd->combined_gazepoint_x = v;
+            else
+                cgd->combined_gazepoint_y = v;
+        } else {
+            p = gaze_csv_float(
+                p, end, (float*)((char*)cgd + g_gaze_csv_fields[col - 1]));
+            if (!p)
+                return false;
+        }
+
+        p = gaze_csv_skip_blanks(p, end);
+
+        if (col == GAZE_CSV_N_COLS - 1) {
+            *label_len = 0;
+
+            if (p == end)
+                return true;
+            if (*p != ',')
+                return false;
+
+            const char *label_end = end;
+            *label = gaze_csv_skip_blanks(p + 1, end);
+
+            while (label_end > *label &&
+                   (label_end[-1] == ' ' || label_end[-1] == '\t'))
+                label_end--;
+
+            *label_len = label_end - *label;
+
+            return true;
+        }
+
+        if (p == end || *p++ != ',')
+            return false;
+    }
+}
+
+// Parses the chunk's rows into its samples.
+static void gaze_csv_parse(gaze_csv_chunk_t *chunk) {
+    const char *p = chunk->begin;
+    const char *end = chunk->end;
+
+    chunk->samples.clear();
+    chunk->samples.reserve((end - p) / (GAZE_CSV_N_COLS * 8));
+    chunk->labels.clear();
+    chunk->n_lines = 0;
+    chunk->n_labeled = 0;
+    chunk->n_malformed = 0;
+    chunk->first_malformed = -1;
+
+    while (p < end) {
+        const char *line_end = (const char*)memchr(p, '\n', end - p);
+        if (!line_end)
+            line_end = end;
+
+        const char *row_end = line_end;
+        if (row_end > p && row_end[-1] == '\r')
+            row_end--;
+
+        chunk->n_lines++;
+
+        gaze_data_t cgd;
+        const char *label;
+        size_t label_len;
+
+        if (gaze_csv_skip_blanks(p, row_end) == row_end) {
+            // Blank
+        } else if (gaze_csv_row(p, row_end, &cgd, &label, &label_len)) {
+            cgd.validity = GAZE_VALID_BOTH;
+            chunk->samples.push_back(cgd);
+            chunk->n_labeled += label_len > 0;
+
+            // Start a run iff the label differs from the previous row's
+            gaze_csv_label_run_t *run =
+                chunk->labels.empty() ? NULL : &chunk->labels.back();
+
+            if (!run || run->len != label_len ||
+                memcmp(run->label, label, label_len) != 0)
+                chunk->labels.push_back(
+                    {chunk->samples.size() - 1, label, label_len});
+        } else {
+            if (!chunk->n_malformed)
+                chunk->first_malformed = chunk->n_lines - 1;
+            chunk->n_malformed++;
+        }
+
+        p = line_end + 1;
+    }
+}
+
+// Returns the end of the row containing data[i] (i.e. past its '\n'), or sz
+// if none, of the given data, of size sz.
+static size_t gaze_csv_row_end(const char *data, size_t sz, size_t i) {
+    if (i >= sz)
+        return sz;
+
+    const char *nl = (const char*)memchr(data + i, '\n', sz - i);
+
+    return nl ? nl - data + 1 : sz;
+}
+
+// Converts the CSV at csv_path to the binary gaze log at log_path,
+// overwriting it if exists, parsing on n_threads threads (or one per core,
+// if 0). The log is written to a temp file, renamed over log_path only on
+// success, so a failed conversion leaves any existing log intact. Any index
+// of the existing log (see gaze_index.h) is removed first, to be rebuilt on
+// the next GazeIndex::update(). Populates stats, if given. Returns the
+// number of samples written, or -1 on failure.
+int64_t gaze_csv_to_log(const char *csv_path,
+                        const char *log_path,
+                        int n_threads,
+                        gaze_csv_stats_t *stats) {
+    steady_clock::time_point t_start = steady_clock::now();
+
+    int fd = ::open(csv_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        warn("CSV conversion failed (CSV not found).\n");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        warn("CSV conversion failed (stat failed).\n");
+        return -1;
+    }
+
+    size_t sz = st.st_size;
+    void *map = sz ? mmap(NULL, sz, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    ::close(fd);
+
+    if (map == MAP_FAILED) {
+        warn("CSV conversion failed (mmap failed).\n");
+        return -1;
+    }
+
+    if (map)
+        madvise(map, sz, MADV_SEQUENTIAL);
+
+    string tmp_path = string(log_path) + ".tmp";
+    unlink(tmp_path.c_str());
+    GazeLogWriter log;
+
+    if (!log.open(tmp_path.c_str())) {
+        if (map)
+            munmap(map, sz);
+        warn("CSV conversion failed (log not opened).\n");
+        return -1;
+    }
+
+    if (n_threads <= 0)
+        n_threads = boost::thread::hardware_concurrency();
+    n_threads = max(n_threads, 1);
+
+    // Parse each segment on the pool while writing the previous one
+    const char *data = (const char*)map;
+    vector<gaze_csv_chunk_t> parsing(n_threads);
+    vector<gaze_csv_chunk_t> parsed;
+    int64_t n_rows = 0;
+    int64_t n_lines = 0;
+    int64_t n_labeled = 0;
+    int64_t n_malformed = 0;
+    int64_t first_malformed = 0;
+
+    for (size_t seg_begin = 0; seg_begin < sz || !parsed.empty(); ) {
+        size_t seg_end = gaze_csv_row_end(
+            data, sz, seg_begin + GAZE_CSV_SEGMENT_SZ - 1);
+        boost::thread_group workers;
+
+        for (int i = 0; i < n_threads && seg_begin < sz; i++) {
+            size_t begin = i ? parsing[i - 1].end - data : seg_begin;
+            size_t end = i == n_threads - 1 ? seg_end : gaze_csv_row_end(
+                data, seg_end, begin + (seg_end - seg_begin) / n_threads);
+
+            parsing[i].begin = data + begin;
+            parsing[i].end = data + end;
+            workers.create_thread(boost::bind(gaze_csv_parse, &parsing[i]));
+        }
+
+        for (gaze_csv_chunk_t &chunk : parsed) {
+            size_t run = 0;
+
+            for (size_t i = 0; i < chunk.samples.size(); i++) {
+                if (run < chunk.labels.size() && chunk.labels[run].first == i) {
+                    log.set_label(string(chunk.labels[run].label,
+                                         chunk.labels[run].len).c_str());
+                    run++;
+                }
+
+                chunk.samples[i].seq = n_rows++;
+                log.append(chunk.samples[i]);
+            }
+
+            if (chunk.n_malformed && !n_malformed)
+                first_malformed = n_lines + chunk.first_malformed + 1;
+
+            n_lines += chunk.n_lines;
+            n_labeled += chunk.n_labeled;
+            n_malformed += chunk.n_malformed;
+        }
+
+        workers.join_all();
+
+        parsed.clear();
+        if (seg_begin < sz)
+            parsed.swap(parsing);
+        parsing.resize(n_threads);
+
+        seg_begin = seg_end;
+    }
+
+    bool is_ok = log.close();
+
+    if (map)
+        munmap(map, sz);
+
+    if (!is_ok) {
+        unlink(tmp_path.c_str());
+        warn("CSV conversion failed (log write failed).\n");
+        return -1;
+    }
+
+    // A stale index may match the new log's block count, so is removed
+    // before it's replaced
+    string idx_path = string(log_path) + GAZE_INDEX_EXT;
+
+    if ((unlink(idx_path.c_str()) != 0 && errno != ENOENT) ||
+        rename(tmp_path.c_str(), log_path) != 0) {
+        unlink(tmp_path.c_str());
+        warn("CSV conversion failed (log not replaced).\n");
+        return -1;
+    }
+
+    if (stats) {
+        stats->n_rows = n_rows;
+        stats->n_labeled = n_labeled;
+        stats->n_malformed = n_malformed;
+        stats->first_malformed = first_malformed;
+        stats->n_bytes = sz;
+        stats->n_threads = n_threads;
+        stats->elapsed_us = duration_cast<microseconds>(
+            steady_clock::now() - t_start).count();
+    }
+
+    return n_rows;
+}
@@ -0,0 +1,103 @@
+/////////////////////////////////////////////////////////////////////////////
+// A single-producer/single-consumer queue of gaze events (e.g. dwell key
+// selections) raised from the gaze stream thread. Events are passed through
+// a lock-free ring and signalled on an eventfd, so consumers may block on
+// (or select/poll) the fd rather than polling the queue itself.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <boost/lockfree/spsc_queue.hpp>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define GAZE_EVENT_QUEUE_SZ 256
+#define GAZE_EVENT_KEY_SELECTED 1
+#define GAZE_EVENT_RECALIBRATE 2    // Data quality degraded. See GazeQuality.
+#define GAZE_EVENT_BLINK 3
+#define GAZE_EVENT_DISCONNECTED 4   // Device connection lost
+#define GAZE_EVENT_RECONNECTED 5    // Device connection restored
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class GazeEventQueue {
+    public:
+        bool push(gaze_event_t const&);
+        bool pop(gaze_event_t*);
+        int fd();
+        int dropped();
+
+        GazeEventQueue();
+        ~GazeEventQueue();
+
+    protected:
+        int m_fd;
+        int m_dropped;
+        boost::lockfree::spsc_queue<
+            gaze_event_t,
+            boost::lockfree::capacity<GAZE_EVENT_QUEUE_SZ>> m_queue;
+};
+
+// Default constructor
+GazeEventQueue::GazeEventQueue() {
+    // Semaphore mode, so that each read of the fd consumes exactly one event
+    m_fd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE | EFD_CLOEXEC);
+    assert(m_fd >= 0);
+
+    m_dropped = 0;
+}
+
+// Destructor
+GazeEventQueue::~GazeEventQueue() {
+    close(m_fd);
+}
+
+// Enques the given event and signals the fd. If the consumer has fallen
+// GAZE_EVENT_QUEUE_SZ events behind, the event is dropped and false returned.
+// Note: May only be called from the (single) producer thread.
+bool GazeEventQueue::push(gaze_event_t const &event) {
+    if (!m_queue.push(event)) {
+        m_dropped++;
+        return false;
+    }
+
+    uint64_t one = 1;
+    if (write(m_fd, &one, sizeof(one)) != sizeof(one))
+        warn("Gaze event signal failed.\n");
+
+    return true;
+}
+
+// Populates event with the oldest pending event and returns true, or returns
+// false if no events are pending. Never blocks.
+// Note: May only be called from the (single) consumer thread.
+bool GazeEventQueue::pop(gaze_event_t *event) {
+    if (!m_queue.pop(*event))
+        return false;
+
+    // Consume the event's signal. A failed read only means the fd may read
+    // as ready once more than needed, which consumers must tolerate anyway.
+    uint64_t one;
+    ssize_t n_read = read(m_fd, &one, sizeof(one));
+    (void)n_read;
+
+    return true;
+}
+
+// Returns the eventfd that becomes readable while events are pending.
+int GazeEventQueue::fd() {
+    return m_fd;
+}
+
+// Returns the number of events dropped due to a full queue.
+int GazeEventQueue::dropped() {
+    return m_dropped;
+}
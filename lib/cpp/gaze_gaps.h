@@ -0,0 +1,173 @@
+/////////////////////////////////////////////////////////////////////////////
+// A small side log of lost gaze samples, distinguishing "lost data" from
+// "no data" (i.e. invalid samples, which only advance the sample sequence
+// number). Samples may be lost:
+//
+//      On the device side, detected from sample timestamp deltas exceeding
+//      the nominal sample interval (GAZE_GAP_DEVICE)
+//      During device connection outages (GAZE_GAP_DISCONNECT)
+//      By the gaze buffer overwriting its oldest, not yet exported, samples
+//      (GAZE_GAP_OVERWRITE). Overwrites of consecutive samples are
+//      coalesced, but not across an export, which ends the run.
+//
+// The log holds the most recent GAZE_GAP_LOG_SZ gaps.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <boost/circular_buffer.hpp>
+#include <boost/thread/mutex.hpp>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define GAZE_GAP_LOG_SZ 256
+#define GAZE_GAP_DEVICE 1
+#define GAZE_GAP_DISCONNECT 2
+#define GAZE_GAP_OVERWRITE 3
+#define GAZE_GAP_MIN_INTERVALS 1.5  // Delta, in nominal intervals, of a gap
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class GazeGapLog {
+    public:
+        void set_interval(int64_t);
+        bool sample(uint32_t, int64_t, gaze_gap_t*);
+        void restart();
+        void disconnected(uint32_t, int64_t, int64_t);
+        void overwritten(uint32_t, int64_t);
+        int gaps(gaze_gap_t*, int);
+        int64_t n_lost();
+
+        GazeGapLog();
+
+    protected:
+        boost::circular_buffer<gaze_gap_t> m_gaps;
+        boost::mutex m_mutex;
+        int64_t m_interval_us;      // Nominal sample interval
+        int64_t m_prev_us;          // Prev sample's timestamp, or 0 if none
+        int64_t m_n_lost;           // Over all gaps ever logged
+
+        void add(gaze_gap_t const&);
+};
+
+// Default constructor
+GazeGapLog::GazeGapLog() {
+    m_gaps.set_capacity(GAZE_GAP_LOG_SZ);
+    m_interval_us = 0;
+    m_prev_us = 0;
+    m_n_lost = 0;
+}
+
+// Sets the device's nominal sample interval, in microseconds. Device gaps
+// are only detected if nonzero.
+void GazeGapLog::set_interval(int64_t interval_us) {
+    m_interval_us = interval_us;
+}
+
+// Logs the given gap.
+void GazeGapLog::add(gaze_gap_t const &gap) {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_gaps.push_back(gap);
+    m_n_lost += gap.n_samples;
+}
+
+// Denotes the arrival of the given sample, of the given sequence number and
+// (device clock based) timestamp. If samples were lost on the device side
+// before it, logs the gap, populates gap (if not NULL) w/ it and returns
+// true. Note: Called on the stream thread only.
+bool GazeGapLog::sample(uint32_t seq, int64_t unixtime_us, gaze_gap_t *gap) {
+    int64_t prev_us = m_prev_us;
+    m_prev_us = unixtime_us;
+
+    if (!prev_us || !m_interval_us ||
+        unixtime_us - prev_us < GAZE_GAP_MIN_INTERVALS * m_interval_us)
+        return false;
+
+    // Samples missed, rounding to the nearest whole interval
+    int64_t delta_us = unixtime_us - prev_us;
+    gaze_gap_t g = {
+        GAZE_GAP_DEVICE,
+        seq,
+        prev_us,
+        delta_us,
+        (delta_us + m_interval_us / 2) / m_interval_us - 1};
+    add(g);
+
+    if (gap)
+        *gap = g;
+
+    return true;
+}
+
+// Denotes a (re)start of the sample stream, such that the next sample's
+// delta from the previous isn't a device gap.
+void GazeGapLog::restart() {
+    m_prev_us = 0;
+}
+
+// Logs a device connection outage from the given time and of the given
+// duration, before the sample of the given sequence number.
+void GazeGapLog::disconnected(uint32_t seq, int64_t lost_us, int64_t outage_us) {
+    add(gaze_gap_t{
+        GAZE_GAP_DISCONNECT,
+        seq,
+        lost_us,
+        outage_us,
+        m_interval_us ? outage_us / m_interval_us : 0});
+
+    restart();
+}
+
+// Logs the overwriting of the given (i.e. the oldest) sample of the gaze
+// buffer, coalescing it w/ the previous gap iff that was an overwrite it
+// directly continues, i.e. of the previous sample and within a nominal
+// interval or so of it. Otherwise (e.g. samples were exported in between)
+// it starts a new gap.
+void GazeGapLog::overwritten(uint32_t seq, int64_t unixtime_us) {
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        gaze_gap_t *gap = m_gaps.empty() ? NULL : &m_gaps.back();
+
+        if (gap && gap->type == GAZE_GAP_OVERWRITE &&
+            seq == gap->seq + (uint32_t)gap->n_samples &&
+            unixtime_us >= gap->unixtime_us + gap->duration_us &&
+            (!m_interval_us ||
+             unixtime_us - gap->unixtime_us - gap->duration_us <
+                GAZE_GAP_MIN_INTERVALS * m_interval_us)) {
+            gap->duration_us = unixtime_us - gap->unixtime_us;
+            gap->n_samples++;
+            m_n_lost++;
+            return;
+        }
+    }
+
+    add(gaze_gap_t{GAZE_GAP_OVERWRITE, seq, unixtime_us, 0, 1});
+}
+
+// Populates out w/ (at most) the n most recent gaps, oldest first. Returns
+// the number populated, or if out is NULL the number of gaps logged.
+int GazeGapLog::gaps(gaze_gap_t *out, int n) {
+    boost::mutex::scoped_lock lock(m_mutex);
+    int sz = m_gaps.size();
+
+    if (!out)
+        return sz;
+
+    int n_capped = min(sz, n);
+
+    for (int i = 0; i < n_capped; i++)
+        out[i] = m_gaps[sz - n_capped + i];
+
+    return n_capped;
+}
+
+// Returns the number of samples lost, over all gaps ever logged.
+int64_t GazeGapLog::n_lost() {
+    boost::mutex::scoped_lock lock(m_mutex);
+    return m_n_lost;
+}
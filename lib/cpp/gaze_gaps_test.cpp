@@ -0,0 +1,151 @@
+/////////////////////////////////////////////////////////////////////////////
+// Tests the gap log's coalescing of gaze buffer overwrites: a run of
+// overwrites is one gap, an export ends the run (so the next overwrite
+// starts a new gap) and a drain, i.e. a run of samples exported w/o loss,
+// likewise does. The gaze buffer is simulated by the seqs and timestamps of
+// its oldest sample, as EyeTrackerGaze::enque_gaze_data() reports them.
+// Exits non-zero on any failure.
+//
+// Build and run with lib/sh/test_gaze_gaps.sh
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <cstdio>
+
+#include "eyetracker_structdef.h"
+#include "gaze_gaps.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define TEST_INTERVAL_US 11111      // 90 Hz
+#define TEST_BUFF_SZ 100
+#define TEST_T0_US 1600000000000000
+
+static int g_n_failed = 0;
+
+// Denotes a failure iff the given condition is false.
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool is_ok, const char *expr, int line) {
+    if (!is_ok) {
+        printf("FAIL (line %d): %s\n", line, expr);
+        g_n_failed++;
+    }
+}
+
+// Returns the timestamp of the sample of the given seq.
+static int64_t test_us(uint32_t seq) {
+    return TEST_T0_US + seq * (int64_t)TEST_INTERVAL_US;
+}
+
+// Overwrites the samples of seqs [first, last], oldest first.
+static void test_overwrite(GazeGapLog &log, uint32_t first, uint32_t last) {
+    for (uint32_t seq = first; seq <= last; seq++)
+        log.overwritten(seq, test_us(seq));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Tests
+
+// Consecutive overwrites coalesce into a single gap.
+static void test_run() {
+    GazeGapLog log;
+    gaze_gap_t gaps[4];
+
+    log.set_interval(TEST_INTERVAL_US);
+    test_overwrite(log, 0, 9);
+
+    CHECK(log.gaps(gaps, 4) == 1);
+    CHECK(gaps[0].type == GAZE_GAP_OVERWRITE);
+    CHECK(gaps[0].seq == 0);
+    CHECK(gaps[0].n_samples == 10);
+    CHECK(gaps[0].duration_us == 9 * TEST_INTERVAL_US);
+    CHECK(log.n_lost() == 10);
+}
+
+// Overwrite -> export -> overwrite. The export takes the buffer's samples
+// after the last overwritten, so the next overwrite (once the new buffer
+// fills) is of a sample TEST_BUFF_SZ later, and starts a new gap.
+static void test_export() {
+    GazeGapLog log;
+    gaze_gap_t gaps[4];
+
+    log.set_interval(TEST_INTERVAL_US);
+    test_overwrite(log, 0, 4);
+    test_overwrite(log, 5 + TEST_BUFF_SZ, 7 + TEST_BUFF_SZ);
+
+    CHECK(log.gaps(gaps, 4) == 2);
+    CHECK(gaps[0].seq == 0);
+    CHECK(gaps[0].n_samples == 5);
+    CHECK(gaps[0].duration_us == 4 * TEST_INTERVAL_US);
+    CHECK(gaps[1].type == GAZE_GAP_OVERWRITE);
+    CHECK(gaps[1].seq == 5 + TEST_BUFF_SZ);
+    CHECK(gaps[1].unixtime_us == test_us(5 + TEST_BUFF_SZ));
+    CHECK(gaps[1].n_samples == 3);
+    CHECK(gaps[1].duration_us == 2 * TEST_INTERVAL_US);
+    CHECK(log.n_lost() == 8);
+}
+
+// As test_export, but w/ no interval known, so only seqs are compared.
+static void test_export_no_interval() {
+    GazeGapLog log;
+    gaze_gap_t gaps[4];
+
+    test_overwrite(log, 0, 4);
+    test_overwrite(log, 5 + TEST_BUFF_SZ, 7 + TEST_BUFF_SZ);
+
+    CHECK(log.gaps(gaps, 4) == 2);
+    CHECK(gaps[0].n_samples == 5);
+    CHECK(gaps[1].n_samples == 3);
+}
+
+// A next-seq overwrite far later than the last (e.g. the stream stalled and
+// the buffer was drained in between) doesn't continue the run either.
+static void test_stale() {
+    GazeGapLog log;
+    gaze_gap_t gaps[4];
+
+    log.set_interval(TEST_INTERVAL_US);
+    test_overwrite(log, 0, 4);
+    log.overwritten(5, test_us(5) + 10 * TEST_INTERVAL_US);
+
+    CHECK(log.gaps(gaps, 4) == 2);
+    CHECK(gaps[0].n_samples == 5);
+    CHECK(gaps[1].seq == 5);
+    CHECK(gaps[1].n_samples == 1);
+    CHECK(gaps[1].duration_us == 0);
+}
+
+// Other gaps end the run, as before.
+static void test_interleaved() {
+    GazeGapLog log;
+    gaze_gap_t gaps[4];
+
+    log.set_interval(TEST_INTERVAL_US);
+    test_overwrite(log, 0, 4);
+    log.disconnected(5, test_us(5), 100000);
+    test_overwrite(log, 5, 6);
+
+    CHECK(log.gaps(gaps, 4) == 3);
+    CHECK(gaps[1].type == GAZE_GAP_DISCONNECT);
+    CHECK(gaps[2].type == GAZE_GAP_OVERWRITE);
+    CHECK(gaps[2].n_samples == 2);
+}
+
+int main() {
+    test_run();
+    test_export();
+    test_export_no_interval();
+    test_stale();
+    test_interleaved();
+
+    printf("%s\n", g_n_failed ? "FAILED" : "OK");
+
+    return g_n_failed ? 1 : 0;
+}
@@ -0,0 +1,430 @@
+/////////////////////////////////////////////////////////////////////////////
+// A compressed, in-memory "cold" gaze history. Gaze samples leaving the
+// full-rate buffer are compressed, Gorilla style, into fixed-size pages:
+// timestamps as delta-of-deltas, float fields as the XOR of each with its
+// previous value (stored as only its meaningful bits, reusing the previous
+// leading/trailing zero window where possible), int fields as deltas, seqs
+// as their excess over the previous seq + 1, and the validity and flag
+// bitmasks as-is.
+// Since most fields change slowly between samples, most encode in few bits.
+//
+// Each page is self-contained (its first sample is encoded against zeros),
+// so pages may be evicted oldest first once the byte budget is reached and
+// are decoded by streaming through them from their start.
+//
+// Float mantissas may optionally be truncated before encoding, trading
+// precision for retention. At 23 mantissa bits encoding is lossless.
+// Tracker noise leaves the low mantissa bits near random, so gains are
+// modest. Measured on a noisy synthetic 90 Hz stream, vs. raw gaze_data_t:
+// ~1.25x at 23 bits, ~1.65x at 16, ~2.05x at 12 and ~3.0x at 8.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstddef>
+
+#include <boost/circular_buffer.hpp>
+
+using namespace std;
+using namespace std::chrono;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define GORILLA_PAGE_BYTES 4096
+#define GORILLA_PAGE_WORDS ((GORILLA_PAGE_BYTES - 24) / 8)
+#define GORILLA_N_FLOATS 30         // left_eyeposition_normed_x ... right_gazepoint_normed_y
+#define GORILLA_N_INTS 2            // combined_gazepoint_x, combined_gazepoint_y
+#define GORILLA_VALIDITY_BITS 2
+#define GORILLA_FLAG_BITS 1
+#define GORILLA_MAX_SAMPLE_BITS \
+    (68 + GORILLA_N_FLOATS * 44 + GORILLA_N_INTS * 68 + 68 + \
+     GORILLA_VALIDITY_BITS + GORILLA_FLAG_BITS)
+#define GORILLA_NO_WINDOW 0xFF
+
+static_assert(offsetof(gaze_data_t, right_gazepoint_normed_y) ==
+              offsetof(gaze_data_t, left_eyeposition_normed_x) +
+              (GORILLA_N_FLOATS - 1) * sizeof(float),
+              "gaze_data_t float fields must be contiguous");
+static_assert(offsetof(gaze_data_t, combined_gazepoint_y) ==
+              offsetof(gaze_data_t, combined_gazepoint_x) +
+              (GORILLA_N_INTS - 1) * sizeof(int),
+              "gaze_data_t int fields must be contiguous");
+
+typedef struct gorilla_page {
+        int64_t first_us;
+        int64_t last_us;
+        uint32_t n_samples;
+        uint32_t n_bits;
+        uint64_t words[GORILLA_PAGE_WORDS];
+	    } gorilla_page_t;
+
+// Previous-value state, identical for encoder and decoder
+typedef struct gorilla_state {
+        int64_t prev_us;
+        int64_t prev_delta_us;
+        uint32_t prev_floats[GORILLA_N_FLOATS];
+        uint8_t lead[GORILLA_N_FLOATS];
+        uint8_t trail[GORILLA_N_FLOATS];
+        int32_t prev_ints[GORILLA_N_INTS];
+        uint32_t prev_seq;
+	    } gorilla_state_t;
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+// A streaming decoder over a single page.
+class GorillaPageReader {
+    public:
+        bool next(gaze_data_t*);
+
+        GorillaPageReader(gorilla_page_t const*);
+
+    protected:
+        gorilla_page_t const *m_page;
+        uint32_t m_n_read;
+        uint32_t m_bit;
+        gorilla_state_t m_state;
+
+        uint64_t get(int);
+        int64_t get_signed();
+};
+
+class GazeColdStore {
+    public:
+        void append(gaze_data_t const&);
+        int64_t oldest_us();
+        bool is_evicting();
+        void stats(gaze_cold_stats_t*);
+        void add_decode_time(int64_t, int64_t);
+        template <typename F> int scan(int64_t, int64_t, F);
+
+        GazeColdStore(size_t, int);
+
+    protected:
+        uint32_t m_float_mask;
+        int64_t m_n_samples;
+        int64_t m_n_encoded;
+        int64_t m_encode_ns;
+        int64_t m_n_decoded;
+        int64_t m_decode_ns;
+        gorilla_state_t m_state;
+        gorilla_page_t *m_open;                          // m_pages.back()
+        boost::circular_buffer<gorilla_page_t> m_pages;
+
+        void new_page();
+        void put(uint64_t, int);
+        void put_signed(int64_t);
+};
+
+// Zeroes the given state, as at the start of a page.
+static void gorilla_state_reset(gorilla_state_t *state) {
+    memset(state, 0, sizeof(gorilla_state_t));
+    memset(state->lead, GORILLA_NO_WINDOW, sizeof(state->lead));
+}
+
+// Constructor. Pages are kept within budget_bytes. Float mantissas are
+// truncated to mantissa_bits (0-23) before encoding.
+GazeColdStore::GazeColdStore(size_t budget_bytes, int mantissa_bits) {
+    mantissa_bits = min(max(mantissa_bits, 0), 23);
+    m_float_mask = ~((1u << (23 - mantissa_bits)) - 1);
+
+    m_n_samples = 0;
+    m_n_encoded = 0;
+    m_encode_ns = 0;
+    m_n_decoded = 0;
+    m_decode_ns = 0;
+
+    m_pages.set_capacity(max(budget_bytes / sizeof(gorilla_page_t), (size_t)2));
+    new_page();
+}
+
+// Opens a new, empty page, evicting the oldest if at capacity.
+void GazeColdStore::new_page() {
+    if (m_pages.full())
+        m_n_samples -= m_pages.front().n_samples;
+
+    m_pages.push_back(gorilla_page_t());  // Value-initialized, i.e. zeroed
+    m_open = &m_pages.back();
+    gorilla_state_reset(&m_state);
+}
+
+// Appends the low n_bits (1-64) of v to the open page.
+void GazeColdStore::put(uint64_t v, int n_bits) {
+    gorilla_page_t *page = m_open;
+    uint32_t word = page->n_bits >> 6;
+    int offset = page->n_bits & 63;
+
+    if (n_bits < 64)
+        v &= (1ULL << n_bits) - 1;
+
+    page->words[word] |= v << offset;
+    if (offset + n_bits > 64)
+        page->words[word + 1] = v >> (64 - offset);
+
+    page->n_bits += n_bits;
+}
+
+// Appends the given signed value in a variable number of bits, favoring 0.
+// Codes: 0 | 10+7 bits | 110+9 bits | 1110+12 bits | 1111+64 bits.
+void GazeColdStore::put_signed(int64_t v) {
+    if (v == 0) {
+        put(0, 1);
+    } else if (v >= -64 && v < 64) {
+        put(0b01, 2);
+        put(v, 7);
+    } else if (v >= -256 && v < 256) {
+        put(0b011, 3);
+        put(v, 9);
+    } else if (v >= -2048 && v < 2048) {
+        put(0b0111, 4);
+        put(v, 12);
+    } else {
+        put(0b1111, 4);
+        put(v, 64);
+    }
+}
+
+// Compresses the given sample onto the end of the history.
+void GazeColdStore::append(gaze_data_t const &cgd) {
+    auto t_start = steady_clock::now();
+
+    if (m_open->n_bits + GORILLA_MAX_SAMPLE_BITS > GORILLA_PAGE_WORDS * 64)
+        new_page();
+
+    gorilla_page_t *page = m_open;
+    gorilla_state_t *state = &m_state;
+
+    // Timestamp, as delta of deltas
+    int64_t delta_us = cgd.unixtime_us - state->prev_us;
+    put_signed(delta_us - state->prev_delta_us);
+    state->prev_us = cgd.unixtime_us;
+    state->prev_delta_us = delta_us;
+
+    // Floats, as XOR w/ prev value
+    const float *floats = &cgd.left_eyeposition_normed_x;
+
+    for (int i = 0; i < GORILLA_N_FLOATS; i++) {
+        uint32_t bits;
+        memcpy(&bits, &floats[i], sizeof(bits));
+        bits &= m_float_mask;
+
+        uint32_t x = bits ^ state->prev_floats[i];
+        state->prev_floats[i] = bits;
+
+        if (x == 0) {
+            put(0, 1);
+            continue;
+        }
+
+        int lead = min(__builtin_clz(x), 31);
+        int trail = __builtin_ctz(x);
+
+        if (state->lead[i] != GORILLA_NO_WINDOW &&
+            lead >= state->lead[i] && trail >= state->trail[i]) {
+                // Fits the prev window: 1, 0, meaningful bits
+                put(0b01, 2);
+                put(x >> state->trail[i], 32 - state->lead[i] - state->trail[i]);
+        } else {
+            // New window: 1, 1, lead, len - 1, meaningful bits
+            int len = 32 - lead - trail;
+            put(0b11, 2);
+            put(lead, 5);
+            put(len - 1, 5);
+            put(x >> trail, len);
+            state->lead[i] = lead;
+            state->trail[i] = trail;
+        }
+    }
+
+    // Ints, as deltas
+    const int *ints = &cgd.combined_gazepoint_x;
+
+    for (int i = 0; i < GORILLA_N_INTS; i++) {
+        put_signed((int64_t)ints[i] - state->prev_ints[i]);
+        state->prev_ints[i] = ints[i];
+    }
+
+    // Seq, as excess over the prev's next (nonzero only after invalid samples)
+    put_signed((int64_t)(uint32_t)(cgd.seq - state->prev_seq - 1));
+    state->prev_seq = cgd.seq;
+
+    put(cgd.validity, GORILLA_VALIDITY_BITS);
+    put(cgd.flags, GORILLA_FLAG_BITS);
+
+    if (page->n_samples == 0)
+        page->first_us = cgd.unixtime_us;
+    page->last_us = cgd.unixtime_us;
+    page->n_samples++;
+    m_n_samples++;
+
+    m_n_encoded++;
+    m_encode_ns += duration_cast<nanoseconds>(
+        steady_clock::now() - t_start).count();
+}
+
+// Returns the timestamp of the oldest sample retained, or 0 if none.
+int64_t GazeColdStore::oldest_us() {
+    for (auto &page : m_pages)
+        if (page.n_samples > 0)
+            return page.first_us;
+
+    return 0;
+}
+
+// Returns true iff pages have been evicted, i.e. history is incomplete.
+bool GazeColdStore::is_evicting() {
+    return m_pages.full();
+}
+
+// Populates stats with the store's current size and throughput.
+void GazeColdStore::stats(gaze_cold_stats_t *stats) {
+    stats->n_samples = m_n_samples;
+    stats->n_pages = m_pages.size();
+    stats->bytes_used = m_pages.size() * sizeof(gorilla_page_t);
+    stats->bytes_raw = m_n_samples * sizeof(gaze_data_t);
+    stats->encode_ns = m_n_encoded > 0 ? (double)m_encode_ns / m_n_encoded : 0;
+    stats->decode_ns = m_n_decoded > 0 ? (double)m_decode_ns / m_n_decoded : 0;
+}
+
+// Denotes that n_decoded samples were decoded in decode_ns, for stats().
+void GazeColdStore::add_decode_time(int64_t n_decoded, int64_t decode_ns) {
+    m_n_decoded += n_decoded;
+    m_decode_ns += decode_ns;
+}
+
+// Decodes, in time order, each sample in [from_us, to_us], calling fn(cgd)
+// for each. Pages entirely outside the range are skipped undecoded. Returns
+// the number of samples in the range.
+template <typename F>
+int GazeColdStore::scan(int64_t from_us, int64_t to_us, F fn) {
+    auto t_start = steady_clock::now();
+    int64_t n_decoded = 0;
+    int n_found = 0;
+
+    for (auto &page : m_pages) {
+        if (page.n_samples == 0 || page.last_us < from_us)
+            continue;
+        if (page.first_us > to_us)
+            break;
+
+        GorillaPageReader reader(&page);
+        gaze_data_t cgd;
+
+        while (reader.next(&cgd)) {
+            n_decoded++;
+
+            if (cgd.unixtime_us < from_us)
+                continue;
+            if (cgd.unixtime_us > to_us)
+                break;
+
+            fn(cgd);
+            n_found++;
+        }
+    }
+
+    add_decode_time(n_decoded, duration_cast<nanoseconds>(
+        steady_clock::now() - t_start).count());
+
+    return n_found;
+}
+
+// Constructor. Decodes from the start of the given page.
+GorillaPageReader::GorillaPageReader(gorilla_page_t const *page) {
+    m_page = page;
+    m_n_read = 0;
+    m_bit = 0;
+    gorilla_state_reset(&m_state);
+}
+
+// Reads the next n_bits (1-64) from the page.
+uint64_t GorillaPageReader::get(int n_bits) {
+    uint32_t word = m_bit >> 6;
+    int offset = m_bit & 63;
+    uint64_t v = m_page->words[word] >> offset;
+
+    if (offset + n_bits > 64)
+        v |= m_page->words[word + 1] << (64 - offset);
+    if (n_bits < 64)
+        v &= (1ULL << n_bits) - 1;
+
+    m_bit += n_bits;
+    return v;
+}
+
+// Reads a signed value, as written by GazeColdStore::put_signed().
+int64_t GorillaPageReader::get_signed() {
+    int n_bits;
+
+    if (!get(1))
+        return 0;
+    else if (!get(1))
+        n_bits = 7;
+    else if (!get(1))
+        n_bits = 9;
+    else if (!get(1))
+        n_bits = 12;
+    else
+        n_bits = 64;
+
+    // Sign extend
+    uint64_t v = get(n_bits);
+    return n_bits == 64 ? (int64_t)v : (int64_t)(v << (64 - n_bits)) >> (64 - n_bits);
+}
+
+// Populates cgd with the page's next sample and returns true, or returns
+// false if the page is exhausted. Fields not stored are zeroed.
+bool GorillaPageReader::next(gaze_data_t *cgd) {
+    if (m_n_read >= m_page->n_samples)
+        return false;
+
+    gorilla_state_t *state = &m_state;
+    memset(cgd, 0, sizeof(gaze_data_t));
+
+    state->prev_delta_us += get_signed();
+    state->prev_us += state->prev_delta_us;
+    cgd->unixtime_us = state->prev_us;
+
+    float *floats = &cgd->left_eyeposition_normed_x;
+
+    for (int i = 0; i < GORILLA_N_FLOATS; i++) {
+        if (get(1)) {
+            uint32_t x;
+
+            if (!get(1)) {
+                x = get(32 - state->lead[i] - state->trail[i]) << state->trail[i];
+            } else {
+                int lead = get(5);
+                int len = get(5) + 1;
+                int trail = 32 - lead - len;
+
+                x = get(len) << trail;
+                state->lead[i] = lead;
+                state->trail[i] = trail;
+            }
+
+            state->prev_floats[i] ^= x;
+        }
+
+        memcpy(&floats[i], &state->prev_floats[i], sizeof(float));
+    }
+
+    int *ints = &cgd->combined_gazepoint_x;
+
+    for (int i = 0; i < GORILLA_N_INTS; i++) {
+        state->prev_ints[i] += get_signed();
+        ints[i] = state->prev_ints[i];
+    }
+
+    state->prev_seq += 1 + (uint32_t)get_signed();
+    cgd->seq = state->prev_seq;
+
+    cgd->validity = get(GORILLA_VALIDITY_BITS);
+    cgd->flags = get(GORILLA_FLAG_BITS);
+
+    m_n_read++;
+    return true;
+}
@@ -0,0 +1,211 @@
+/////////////////////////////////////////////////////////////////////////////
+// A streaming gaze heatmap. Gaze points are splatted, as a Gaussian, into a
+// downsampled 2D grid of the display, and the grid's contents decay
+// exponentially with time. Decay is applied lazily, per tile of the grid,
+// only when a tile is next written to or when the map is synced for
+// reading, so the cost per sample is constant (bounded by the few tiles a
+// splat overlaps) regardless of grid size. Decay and splats are SIMD.
+//
+// The grid is a single, stable, row-major float buffer (rows of m_stride
+// floats, the first m_cols of which are in use) that readers may access
+// directly after calling sync().
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <vector>
+#include <stdlib.h>
+
+#include <xmmintrin.h>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define HEATMAP_TILE_CELLS 16       // Tile edge len, in cells. Multiple of 4.
+#define HEATMAP_MAX_RADIUS_CELLS 8  // Bounds per-sample splat cost
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class GazeHeatmap {
+    public:
+        void splat(int64_t, int, int);
+        float* sync(int64_t);
+        void clear();
+        int cols();
+        int rows();
+        int stride();
+        bool allocated();
+
+        GazeHeatmap(int, int, int, float, int);
+        ~GazeHeatmap();
+
+    protected:
+        int m_cell_px;
+        int m_cols;
+        int m_rows;
+        int m_stride;
+        int m_tile_cols;
+        int m_tile_rows;
+        int m_radius;
+        double m_half_life_us;
+        float *m_grid;
+        vector<float> m_kernel;
+        vector<int64_t> m_tile_times;
+
+        void decay_tile(int, int64_t);
+};
+
+// Constructor. The heatmap covers a display of disp_width_px x disp_height_px
+// at one cell per cell_px, splats with a Gaussian of sigma_px std deviation,
+// and halves in intensity every half_life_ms (or never decays if <= 0).
+GazeHeatmap::GazeHeatmap(int disp_width_px,
+                         int disp_height_px,
+                         int cell_px,
+                         float sigma_px,
+                         int half_life_ms) {
+    m_cell_px = max(1, cell_px);
+    m_cols = (disp_width_px + m_cell_px - 1) / m_cell_px;
+    m_rows = (disp_height_px + m_cell_px - 1) / m_cell_px;
+    m_half_life_us = half_life_ms > 0 ? half_life_ms * 1000.0 : 0;
+
+    // Pad to whole tiles, so tile rows are always full, aligned SIMD widths
+    m_tile_cols = (m_cols + HEATMAP_TILE_CELLS - 1) / HEATMAP_TILE_CELLS;
+    m_tile_rows = (m_rows + HEATMAP_TILE_CELLS - 1) / HEATMAP_TILE_CELLS;
+    m_stride = m_tile_cols * HEATMAP_TILE_CELLS;
+
+    // On allocation failure, leave an empty (zero-dim) map that ignores
+    // splats, and let the owner check allocated()
+    size_t grid_sz = (size_t)m_stride * m_tile_rows * HEATMAP_TILE_CELLS;
+
+    if (posix_memalign((void**)&m_grid, 16, grid_sz * sizeof(float)) != 0) {
+        error("Heatmap init failed (could not allocate grid).\n");
+        m_grid = NULL;
+        m_cols = m_rows = m_stride = 0;
+        m_tile_cols = m_tile_rows = 0;
+        m_radius = 0;
+        return;
+    }
+    m_tile_times.resize(m_tile_cols * m_tile_rows);
+    clear();
+
+    // Precompute the splat kernel, in cell units
+    float sigma = max(sigma_px / m_cell_px, 0.25f);
+    m_radius = min((int)ceil(3 * sigma), HEATMAP_MAX_RADIUS_CELLS);
+
+    int width = 2 * m_radius + 1;
+    m_kernel.resize(width * width);
+
+    for (int r = -m_radius; r <= m_radius; r++)
+        for (int c = -m_radius; c <= m_radius; c++)
+            m_kernel[(r + m_radius) * width + c + m_radius] =
+                exp(-(r * r + c * c) / (2 * sigma * sigma));
+}
+
+// Destructor
+GazeHeatmap::~GazeHeatmap() {
+    free(m_grid);
+}
+
+// Zeroes the heatmap.
+void GazeHeatmap::clear() {
+    if (!m_grid)
+        return;
+
+    memset(m_grid, 0,
+        (size_t)m_stride * m_tile_rows * HEATMAP_TILE_CELLS * sizeof(float));
+    fill(m_tile_times.begin(), m_tile_times.end(), 0);
+}
+
+// Decays the given tile's contents from its last update time to t_us.
+void GazeHeatmap::decay_tile(int tile, int64_t t_us) {
+    int64_t dt_us = t_us - m_tile_times[tile];
+
+    if (dt_us <= 0)
+        return;
+    m_tile_times[tile] = t_us;
+
+    if (m_half_life_us <= 0)
+        return;
+
+    __m128 factor = _mm_set1_ps(exp2(-dt_us / m_half_life_us));
+    int r0 = (tile / m_tile_cols) * HEATMAP_TILE_CELLS;
+    int c0 = (tile % m_tile_cols) * HEATMAP_TILE_CELLS;
+
+    for (int r = r0; r < r0 + HEATMAP_TILE_CELLS; r++) {
+        float *row = m_grid + (size_t)r * m_stride + c0;
+
+        for (int c = 0; c < HEATMAP_TILE_CELLS; c += 4)
+            _mm_store_ps(row + c, _mm_mul_ps(_mm_load_ps(row + c), factor));
+    }
+}
+
+// Adds a Gaussian splat at the given display coords, at time t_us, first
+// bringing each tile it touches up to date.
+void GazeHeatmap::splat(int64_t t_us, int x, int y) {
+    int cx = x / m_cell_px;
+    int cy = y / m_cell_px;
+
+    if (x < 0 || y < 0 || cx >= m_cols || cy >= m_rows)
+        return;
+
+    // Clip the kernel footprint to the grid
+    int r0 = max(cy - m_radius, 0);
+    int r1 = min(cy + m_radius, m_rows - 1);
+    int c0 = max(cx - m_radius, 0);
+    int c1 = min(cx + m_radius, m_cols - 1);
+
+    for (int tr = r0 / HEATMAP_TILE_CELLS; tr <= r1 / HEATMAP_TILE_CELLS; tr++)
+        for (int tc = c0 / HEATMAP_TILE_CELLS; tc <= c1 / HEATMAP_TILE_CELLS; tc++)
+            decay_tile(tr * m_tile_cols + tc, t_us);
+
+    // Accumulate the kernel, 4 cells at a time then any remainder
+    int width = 2 * m_radius + 1;
+    int n_cols = c1 - c0 + 1;
+
+    for (int r = r0; r <= r1; r++) {
+        float *row = m_grid + (size_t)r * m_stride + c0;
+        const float *k_row = &m_kernel[
+            (r - cy + m_radius) * width + (c0 - cx + m_radius)];
+        int c = 0;
+
+        for (; c + 4 <= n_cols; c += 4)
+            _mm_storeu_ps(row + c, _mm_add_ps(
+                _mm_loadu_ps(row + c), _mm_loadu_ps(k_row + c)));
+
+        for (; c < n_cols; c++)
+            row[c] += k_row[c];
+    }
+}
+
+// Brings every tile up to date as of t_us and returns the grid buffer.
+float* GazeHeatmap::sync(int64_t t_us) {
+    for (int tile = 0; tile < (int)m_tile_times.size(); tile++)
+        decay_tile(tile, t_us);
+
+    return m_grid;
+}
+
+// Returns the number of in-use cells per row.
+int GazeHeatmap::cols() {
+    return m_cols;
+}
+
+// Returns the number of rows.
+int GazeHeatmap::rows() {
+    return m_rows;
+}
+
+// Returns the number of floats between the starts of consecutive rows.
+int GazeHeatmap::stride() {
+    return m_stride;
+}
+
+// Returns true iff the grid was allocated, i.e. the heatmap is usable.
+bool GazeHeatmap::allocated() {
+    return m_grid != NULL;
+}
@@ -0,0 +1,217 @@
+/////////////////////////////////////////////////////////////////////////////
+// A multi-resolution gaze history. Alongside the full-rate sample buffer,
+// gaze samples are aggregated into fixed-period bins (e.g. 10 Hz and 1 Hz)
+// of mean, min and max gaze point and validity fraction, each tier kept in
+// its own ring. Bins are accumulated incrementally as samples arrive, so
+// per-sample cost is O(1) per tier, and total memory is fixed at
+// construction by a byte budget split evenly across tiers.
+//
+// Queries over a time range are served from the finest tier whose history
+// reaches back to the range's start (see EyeTrackerGaze::gaze_history).
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <climits>
+#include <algorithm>
+
+#include <boost/circular_buffer.hpp>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+static const int64_t GAZE_HISTORY_TIERS_US[] = {100000, 1000000};  // 10, 1 Hz
+#define GAZE_HISTORY_N_TIERS \
+    (int)(sizeof(GAZE_HISTORY_TIERS_US) / sizeof(GAZE_HISTORY_TIERS_US[0]))
+
+typedef struct gaze_agg_accum {
+        int64_t start_us;
+        int n_valid;
+        int n_invalid;
+        int64_t sum_x;
+        int64_t sum_y;
+        int min_x;
+        int max_x;
+        int min_y;
+        int max_y;
+	    } gaze_agg_accum_t;
+
+typedef struct gaze_tier {
+        int64_t bin_us;
+        gaze_agg_accum_t accum;                     // The bin in progress
+        boost::circular_buffer<gaze_agg_t> bins;    // Completed bins
+	    } gaze_tier_t;
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class GazeHistory {
+    public:
+        void update(int64_t, int, int);
+        void update_invalid(int64_t);
+        int tier_for(int64_t);
+        int64_t tier_bin_us(int);
+        int query(int, int64_t, int64_t, gaze_agg_t*, int);
+        size_t capacity_bytes();
+
+        GazeHistory(size_t);
+
+    protected:
+        vector<gaze_tier_t> m_tiers;
+
+        void accum_to(gaze_tier_t*, int64_t);
+        static void accum_reset(gaze_agg_accum_t*, int64_t);
+        static gaze_agg_t agg_from_accum(gaze_agg_accum_t const&, int64_t);
+};
+
+// Constructor. Tiers share the given memory budget (in bytes) evenly.
+GazeHistory::GazeHistory(size_t budget_bytes) {
+    size_t tier_sz = budget_bytes / GAZE_HISTORY_N_TIERS / sizeof(gaze_agg_t);
+
+    m_tiers.resize(GAZE_HISTORY_N_TIERS);
+
+    for (int i = 0; i < GAZE_HISTORY_N_TIERS; i++) {
+        m_tiers[i].bin_us = GAZE_HISTORY_TIERS_US[i];
+        m_tiers[i].bins.set_capacity(max(tier_sz, (size_t)1));
+        accum_reset(&m_tiers[i].accum, 0);
+    }
+}
+
+// Clears the given accumulator, starting a bin at start_us.
+void GazeHistory::accum_reset(gaze_agg_accum_t *accum, int64_t start_us) {
+    *accum = gaze_agg_accum_t{
+        start_us, 0, 0, 0, 0, INT_MAX, INT_MIN, INT_MAX, INT_MIN};
+}
+
+// Returns the aggregate record for the given accumulator.
+gaze_agg_t GazeHistory::agg_from_accum(gaze_agg_accum_t const &accum,
+                                       int64_t bin_us) {
+    gaze_agg_t agg;
+    int n_total = accum.n_valid + accum.n_invalid;
+
+    agg.unixtime_us = accum.start_us;
+    agg.duration_us = bin_us;
+    agg.n_samples = accum.n_valid;
+    agg.valid_frac = n_total > 0 ? (float)accum.n_valid / n_total : 0;
+    agg.mean_x = accum.n_valid > 0 ? (float)accum.sum_x / accum.n_valid : 0;
+    agg.mean_y = accum.n_valid > 0 ? (float)accum.sum_y / accum.n_valid : 0;
+    agg.min_x = accum.n_valid > 0 ? accum.min_x : 0;
+    agg.max_x = accum.n_valid > 0 ? accum.max_x : 0;
+    agg.min_y = accum.n_valid > 0 ? accum.min_y : 0;
+    agg.max_y = accum.n_valid > 0 ? accum.max_y : 0;
+
+    return agg;
+}
+
+// Brings the given tier's in-progress bin up to the bin containing t_us,
+// first completing (and storing) the current bin if it has ended.
+void GazeHistory::accum_to(gaze_tier_t *tier, int64_t t_us) {
+    int64_t start_us = t_us - t_us % tier->bin_us;
+    gaze_agg_accum_t *accum = &tier->accum;
+
+    if (start_us <= accum->start_us)
+        return;  // Still in the current bin (or sample is out of order)
+
+    if (accum->n_valid + accum->n_invalid > 0)
+        tier->bins.push_back(agg_from_accum(*accum, tier->bin_us));
+
+    accum_reset(accum, start_us);
+}
+
+// Aggregates a valid gaze sample at time t_us and display coords (x, y).
+void GazeHistory::update(int64_t t_us, int x, int y) {
+    for (auto &tier : m_tiers) {
+        accum_to(&tier, t_us);
+
+        gaze_agg_accum_t *accum = &tier.accum;
+        accum->n_valid++;
+        accum->sum_x += x;
+        accum->sum_y += y;
+        accum->min_x = min(accum->min_x, x);
+        accum->max_x = max(accum->max_x, x);
+        accum->min_y = min(accum->min_y, y);
+        accum->max_y = max(accum->max_y, y);
+    }
+}
+
+// Denotes an invalid gaze sample (e.g. no user present) at time t_us.
+void GazeHistory::update_invalid(int64_t t_us) {
+    for (auto &tier : m_tiers) {
+        accum_to(&tier, t_us);
+        tier.accum.n_invalid++;
+    }
+}
+
+// Returns the idx of the finest tier whose history reaches back to from_us,
+// else the coarsest tier.
+int GazeHistory::tier_for(int64_t from_us) {
+    for (int i = 0; i < GAZE_HISTORY_N_TIERS; i++) {
+        gaze_tier_t *tier = &m_tiers[i];
+        int64_t oldest_us = tier->bins.empty() ?
+            tier->accum.start_us : tier->bins.front().unixtime_us;
+
+        // A full ring has evicted bins, so only reaches back to its oldest
+        if (!tier->bins.full() || oldest_us <= from_us)
+            return i;
+    }
+
+    return GAZE_HISTORY_N_TIERS - 1;
+}
+
+// Returns the bin length, in microseconds, of the given tier.
+int64_t GazeHistory::tier_bin_us(int tier) {
+    return m_tiers[tier].bin_us;
+}
+
+// Copies to out (at most) n bins of the given tier, in time order, overlapping
+// the range [from_us, to_us], including the bin in progress. Returns the
+// total number of bins in the range, which may exceed n.
+int GazeHistory::query(int tier_idx,
+                       int64_t from_us,
+                       int64_t to_us,
+                       gaze_agg_t *out,
+                       int n) {
+    gaze_tier_t *tier = &m_tiers[tier_idx];
+
+    // Binary search for the first bin ending after from_us
+    auto first = lower_bound(
+        tier->bins.begin(), tier->bins.end(), from_us - tier->bin_us,
+        [](gaze_agg_t const &agg, int64_t t_us) {
+            return agg.unixtime_us <= t_us; });
+
+    int n_found = 0;
+
+    for (auto it = first; it != tier->bins.end(); it++) {
+        if (it->unixtime_us > to_us)
+            break;
+        if (n_found < n)
+            out[n_found] = *it;
+        n_found++;
+    }
+
+    gaze_agg_accum_t *accum = &tier->accum;
+
+    if (accum->n_valid + accum->n_invalid > 0 &&
+        accum->start_us + tier->bin_us > from_us &&
+        accum->start_us <= to_us) {
+            if (n_found < n)
+                out[n_found] = agg_from_accum(*accum, tier->bin_us);
+            n_found++;
+    }
+
+    return n_found;
+}
+
+// Returns the memory, in bytes, reserved for aggregate bins.
+size_t GazeHistory::capacity_bytes() {
+    size_t n_bytes = 0;
+
+    for (auto &tier : m_tiers)
+        n_bytes += tier.bins.capacity() * sizeof(gaze_agg_t);
+
+    return n_bytes;
+}
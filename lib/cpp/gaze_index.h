@@ -0,0 +1,463 @@
+/////////////////////////////////////////////////////////////////////////////
+// A spatio-temporal index over a binary gaze log (see gaze_log.h), for
+// queries such as "when did the user look at the top-right HUD panel last
+// week" w/o scanning every sample. The index is a sidecar file alongside
+// the log (at the log's path plus GAZE_INDEX_EXT) holding, per log block,
+// the block's time span, the bounding box of its gaze points and a coarse
+// grid summary of them: a bitmask of the display's GAZE_INDEX_GRID_W x
+// GAZE_INDEX_GRID_H cells the points fall in (points off the display
+// falling in its edge cells).
+//
+// A query for the samples in a time range and display region (and
+// optionally of a label) binary searches the blocks by time, then skips
+// those of other labels or whose bounding box or cells miss the region,
+// scanning only the remaining blocks' records.
+//
+// The index is updated incrementally, indexing only the blocks appended to
+// the log since its last update (e.g. on each export to the log), and is
+// rebuilt if it no longer matches the log (e.g. the log was rewritten).
+// Blocks not yet indexed are scanned by queries, so results are always
+// exact.
+//
+// File format: A gaze_index_header_t, followed by the entries, a
+// gaze_index_entry_t per log block, in the log's block order.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace std::chrono;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define GAZE_INDEX_MAGIC "AEYGIDX1"
+#define GAZE_INDEX_VERSION 1
+#define GAZE_INDEX_EXT ".idx"
+#define GAZE_INDEX_GRID_W 16
+#define GAZE_INDEX_GRID_H 16
+#define GAZE_INDEX_GRID_WORDS (GAZE_INDEX_GRID_W * GAZE_INDEX_GRID_H / 64)
+
+typedef struct gaze_index_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t entry_sz;          // sizeof(gaze_index_entry_t)
+        int32_t disp_width;         // Spanned by the grid, in px
+        int32_t disp_height;
+        uint64_t n_entries;
+	    } gaze_index_header_t;
+
+// A log block's summary
+typedef struct gaze_index_entry {
+        int64_t min_us;             // As the block's
+        int64_t max_us;
+        uint64_t offset;
+        int16_t min_x;              // Bounding box of the gaze points
+        int16_t min_y;
+        int16_t max_x;
+        int16_t max_y;
+        uint64_t cells[GAZE_INDEX_GRID_WORDS];  // Row-major
+	    } gaze_index_entry_t;
+
+// Returns the grid cell (row or col) of n spanning the given px dimension,
+// in which the given coord falls, clamped to the grid.
+static int gaze_index_cell(int coord, int disp_px, int n) {
+    return max(0, min(n - 1, (int)((int64_t)coord * n / max(disp_px, 1))));
+}
+
+// Populates cells w/ the mask of the grid cells overlapping the given
+// region, of positive size.
+static void gaze_index_cells(int x,
+                             int y,
+                             int width,
+                             int height,
+                             int disp_width,
+                             int disp_height,
+                             uint64_t *cells) {
+    int col0 = gaze_index_cell(x, disp_width, GAZE_INDEX_GRID_W);
+    int col1 = gaze_index_cell(x + width - 1, disp_width, GAZE_INDEX_GRID_W);
+    int row0 = gaze_index_cell(y, disp_height, GAZE_INDEX_GRID_H);
+    int row1 = gaze_index_cell(y + height - 1, disp_height, GAZE_INDEX_GRID_H);
+
+    memset(cells, 0, GAZE_INDEX_GRID_WORDS * sizeof(uint64_t));
+
+    for (int row = row0; row <= row1; row++) {
+        for (int col = col0; col <= col1; col++) {
+            int bit = row * GAZE_INDEX_GRID_W + col;
+            cells[bit / 64] |= (uint64_t)1 << (bit % 64);
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class GazeIndex {
+    public:
+        static int64_t update(const char*, int, int);
+        bool open(const char*);
+        int64_t query(int64_t,
+                      int64_t,
+                      int,
+                      int,
+                      int,
+                      int,
+                      const char*,
+                      gaze_index_hit_t*,
+                      int64_t,
+                      gaze_index_stats_t*);
+
+        GazeIndex();
+
+    protected:
+        GazeLogReader m_log;
+        vector<gaze_index_entry_t> m_entries;   // Of the first blocks
+        int m_disp_width;
+        int m_disp_height;
+
+        static bool load(const char*,
+                         GazeLogReader&,
+                         gaze_index_header_t*,
+                         vector<gaze_index_entry_t>*);
+        static void summarize(GazeLogReader&, int, int, int,
+                              gaze_index_entry_t*);
+};
+
+// Default constructor. The index is empty until open().
+GazeIndex::GazeIndex() {
+    m_disp_width = 0;
+    m_disp_height = 0;
+}
+
+// Populates header and entries from the index of the given log path,
+// keeping only the entries matching the given log's blocks. Returns false
+// if the index is missing or malformed, in which case entries is empty.
+bool GazeIndex::load(const char *log_path,
+                     GazeLogReader &log,
+                     gaze_index_header_t *header,
+                     vector<gaze_index_entry_t> *entries) {
+    string idx_path = string(log_path) + GAZE_INDEX_EXT;
+    entries->clear();
+
+    int fd = ::open(idx_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    bool is_ok = fstat(fd, &st) == 0 &&
+        pread(fd, header, sizeof(*header), 0) == sizeof(*header) &&
+        memcmp(header->magic, GAZE_INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == GAZE_INDEX_VERSION &&
+        header->entry_sz == sizeof(gaze_index_entry_t) &&
+        header->n_entries <=
+            (st.st_size - sizeof(*header)) / sizeof(gaze_index_entry_t);
+
+    if (is_ok) {
+        entries->resize(min(header->n_entries, (uint64_t)log.n_blocks()));
+        size_t sz = entries->size() * sizeof(gaze_index_entry_t);
+
+        is_ok = pread(fd, entries->data(), sz, sizeof(*header)) == (ssize_t)sz;
+    }
+
+    ::close(fd);
+
+    if (!is_ok) {
+        entries->clear();
+        return false;
+    }
+
+    // Keep the entries up to the first not matching its block
+    for (size_t i = 0; i < entries->size(); i++) {
+        gaze_log_block_t const &block = log.block(i);
+        gaze_index_entry_t const &entry = (*entries)[i];
+
+        if (entry.offset != block.offset ||
+            entry.min_us != block.min_us ||
+            entry.max_us != block.max_us) {
+            entries->resize(i);
+            break;
+        }
+    }
+
+    return true;
+}
+
+// Populates entry w/ the summary of the given block of the given log.
+void GazeIndex::summarize(GazeLogReader &log,
+                          int block,
+                          int disp_width,
+                          int disp_height,
+                          gaze_index_entry_t *entry) {
+    gaze_log_block_t const &b = log.block(block);
+
+    memset(entry, 0, sizeof(*entry));
+    entry->min_us = b.min_us;
+    entry->max_us = b.max_us;
+    entry->offset = b.offset;
+    entry->min_x = INT16_MAX;
+    entry->min_y = INT16_MAX;
+    entry->max_x = INT16_MIN;
+    entry->max_y = INT16_MIN;
+
+    for (uint32_t i = 0; i < b.n_records; i++) {
+        gaze_packed_t const *rec = log.record(block, i);
+        int x = rec->combined_gazepoint_x;
+        int y = rec->combined_gazepoint_y;
+        int bit =
+            gaze_index_cell(y, disp_height, GAZE_INDEX_GRID_H) *
+                GAZE_INDEX_GRID_W +
+            gaze_index_cell(x, disp_width, GAZE_INDEX_GRID_W);
+
+        entry->cells[bit / 64] |= (uint64_t)1 << (bit % 64);
+        entry->min_x = min((int)entry->min_x, x);
+        entry->min_y = min((int)entry->min_y, y);
+        entry->max_x = max((int)entry->max_x, x);
+        entry->max_y = max((int)entry->max_y, y);
+    }
+}
+
+// Indexes the blocks of the log at the given path not yet indexed, w/ a grid
+// spanning the given display size, rebuilding the index if it does not
+// match the log or display size. Returns the number of blocks indexed, in
+// total, or -1 on failure.
+int64_t GazeIndex::update(const char *log_path,
+                          int disp_width,
+                          int disp_height) {
+    GazeLogReader log;
+    if (!log.open(log_path))
+        return -1;
+
+    gaze_index_header_t header;
+    vector<gaze_index_entry_t> entries;
+
+    memset(&header, 0, sizeof(header));
+
+    if (!load(log_path, log, &header, &entries) ||
+        header.disp_width != disp_width ||
+        header.disp_height != disp_height)
+        entries.clear();
+
+    if (entries.size() == header.n_entries &&
+        (int)entries.size() == log.n_blocks())
+        return entries.size();
+
+    // Write the new entries, then the header, so readers see only entries
+    // fully written
+    size_t n_valid = entries.size();
+    entries.resize(log.n_blocks());
+
+    for (size_t i = n_valid; i < entries.size(); i++)
+        summarize(log, i, disp_width, disp_height, &entries[i]);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GAZE_INDEX_MAGIC, sizeof(header.magic));
+    header.version = GAZE_INDEX_VERSION;
+    header.entry_sz = sizeof(gaze_index_entry_t);
+    header.disp_width = disp_width;
+    header.disp_height = disp_height;
+    header.n_entries = entries.size();
+
+    string idx_path = string(log_path) + GAZE_INDEX_EXT;
+    int fd = ::open(idx_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        warn("Gaze index update failed (open failed).\n");
+        return -1;
+    }
+
+    size_t sz = (entries.size() - n_valid) * sizeof(gaze_index_entry_t);
+    uint64_t offset = sizeof(header) + n_valid * sizeof(gaze_index_entry_t);
+    bool is_ok =
+        pwrite(fd, entries.data() + n_valid, sz, offset) == (ssize_t)sz &&
+        pwrite(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        ftruncate(fd, offset + sz) == 0;
+
+    if (::close(fd) != 0 || !is_ok) {
+        warn("Gaze index update failed (write failed).\n");
+        return -1;
+    }
+
+    return entries.size();
+}
+
+// Opens the log at the given path and its index, if any. Returns false if
+// the log is missing or malformed.
+bool GazeIndex::open(const char *log_path) {
+    gaze_index_header_t header;
+
+    m_entries.clear();
+    m_disp_width = 0;
+    m_disp_height = 0;
+
+    if (!m_log.open(log_path))
+        return false;
+
+    if (load(log_path, m_log, &header, &m_entries)) {
+        m_disp_width = header.disp_width;
+        m_disp_height = header.disp_height;
+    }
+
+    return true;
+}
+
+// Copies to out (at most) n of the samples in the time range [from_us,
+// to_us] whose gaze points fall in the given display region, in time order.
+// If label is given, only samples of that label are included ("" for
+// unlabeled samples). Adds the query's counts to stats, if given. Returns the
+// total number of such samples, which may exceed n.
+// ASSUMES: Samples were logged in chronological order.
+int64_t GazeIndex::query(int64_t from_us,
+                         int64_t to_us,
+                         int x,
+                         int y,
+                         int width,
+                         int height,
+                         const char *label,
+                         gaze_index_hit_t *out,
+                         int64_t n,
+                         gaze_index_stats_t *stats) {
+    int64_t n_hits = 0;
+    int64_t n_scanned = 0;
+    int64_t n_records = 0;
+    int n_blocks = m_log.n_blocks();
+    int label_id = label ? m_log.label_id(label) : -1;
+
+    if (stats)
+        stats->n_blocks += n_blocks;
+
+    if (width <= 0 || height <= 0 || from_us > to_us ||
+        (label && label_id < 0))
+        return 0;
+
+    uint64_t cells[GAZE_INDEX_GRID_WORDS];
+    gaze_index_cells(
+        x, y, width, height, m_disp_width, m_disp_height, cells);
+
+    // The first block ending at or after from_us
+    int lo = 0;
+    int hi = n_blocks;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (m_log.block(mid).max_us < from_us)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (int b = lo; b < n_blocks && m_log.block(b).min_us <= to_us; b++) {
+        if (label && (int)m_log.block(b).label != label_id)
+            continue;
+
+        // Skip blocks whose summary misses the region
+        if (b < (int)m_entries.size()) {
+            gaze_index_entry_t const &entry = m_entries[b];
+            uint64_t overlap = 0;
+
+            for (int w = 0; w < GAZE_INDEX_GRID_WORDS; w++)
+                overlap |= entry.cells[w] & cells[w];
+
+            if (!overlap ||
+                entry.max_x < x || entry.min_x >= x + width ||
+                entry.max_y < y || entry.min_y >= y + height)
+                continue;
+        }
+
+        gaze_log_block_t const &block = m_log.block(b);
+        n_scanned++;
+        n_records += block.n_records;
+
+        for (uint32_t i = 0; i < block.n_records; i++) {
+            gaze_packed_t const *rec = m_log.record(b, i);
+            int64_t t_us = block.base_us + rec->dt_us;
+
+            if (t_us < from_us || t_us > to_us ||
+                rec->combined_gazepoint_x < x ||
+                rec->combined_gazepoint_x >= x + width ||
+                rec->combined_gazepoint_y < y ||
+                rec->combined_gazepoint_y >= y + height)
+                continue;
+
+            if (n_hits < n) {
+                gaze_index_hit_t *hit = &out[n_hits];
+                hit->unixtime_us = t_us;
+                hit->seq = block.base_seq + rec->dseq;
+                hit->x = rec->combined_gazepoint_x;
+                hit->y = rec->combined_gazepoint_y;
+                hit->validity = rec->validity;
+            }
+
+            n_hits++;
+        }
+    }
+
+    if (stats) {
+        stats->n_blocks_scanned += n_scanned;
+        stats->n_records_scanned += n_records;
+        stats->n_hits += n_hits;
+    }
+
+    return n_hits;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Archive queries
+
+// As GazeIndex::query(), over the logs at the given paths, in the given
+// order, populating stats, if given. Logs failing to open are skipped.
+int64_t gaze_index_query(const char **log_paths,
+                         int n_logs,
+                         int64_t from_us,
+                         int64_t to_us,
+                         int x,
+                         int y,
+                         int width,
+                         int height,
+                         const char *label,
+                         gaze_index_hit_t *out,
+                         int64_t n,
+                         gaze_index_stats_t *stats) {
+    steady_clock::time_point t_start = steady_clock::now();
+    gaze_index_stats_t log_stats;
+    int64_t n_hits = 0;
+
+    memset(&log_stats, 0, sizeof(log_stats));
+
+    for (int i = 0; i < n_logs; i++) {
+        GazeIndex index;
+
+        if (!index.open(log_paths[i])) {
+            log_stats.n_failed++;
+            continue;
+        }
+
+        n_hits += index.query(from_us,
+                              to_us,
+                              x,
+                              y,
+                              width,
+                              height,
+                              label,
+                              out + min(n_hits, n),
+                              max(n - n_hits, (int64_t)0),
+                              &log_stats);
+        log_stats.n_logs++;
+    }
+
+    if (stats) {
+        *stats = log_stats;
+        stats->elapsed_us = duration_cast<microseconds>(
+            steady_clock::now() - t_start).count();
+    }
+
+    return n_hits;
+}
@@ -0,0 +1,564 @@
+/////////////////////////////////////////////////////////////////////////////
+// The binary gaze log: gaze samples, packed (see gaze_pack.h), in blocks of
+// up to GAZE_PACK_BLOCK_SZ records sharing timestamp and seq bases, w/ an
+// index of the blocks' time spans for seeking by time w/o reading records.
+//
+// File format: A gaze_log_header_t, followed by the label dictionary,
+// followed by the blocks, each a gaze_log_block_t followed by its records,
+// followed by the index (a copy of every block's gaze_log_block_t). The index
+// is written when a writer is closed, having been invalidated in the header
+// when it was opened, so a log whose writer is still open (or crashed) is
+// read by scanning its blocks.
+//
+// Labels: A block's samples share a label (e.g. that of the export writing
+// them), stored in its header as an id into the log's dictionary of label
+// names, so labeled samples cost nothing per sample and readers may filter
+// by label per block. The dictionary is GAZE_LOG_MAX_LABELS fixed-size slots,
+// label id i in slot i - 1 (an empty slot ends it), and id 0 is unlabeled. A
+// label's slot is written before any block referencing it.
+//
+// Logs of other versions (e.g. version 1, which predates labels) are
+// rejected as invalid.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define GAZE_LOG_MAGIC "AEYGLOG1"
+#define GAZE_LOG_VERSION 2
+#define GAZE_LOG_MAX_LABELS 255     // Per log, excl. unlabeled
+#define GAZE_LOG_LABEL_SZ 32        // Incl. the terminating NUL
+
+typedef struct gaze_log_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t rec_sz;            // sizeof(gaze_packed_t)
+        uint64_t index_offset;      // From the start of the file, 0 if none
+        uint64_t n_blocks;
+	    } gaze_log_header_t;
+
+// A block's header, also its index entry
+typedef struct gaze_log_block {
+        int64_t base_us;            // Records' timestamps are relative to this
+        int64_t min_us;             // Of the block's records
+        int64_t max_us;
+        uint64_t offset;            // Of the records, from the start of file
+        uint32_t n_records;
+        uint32_t base_seq;          // Records' seqs are relative to this
+        uint32_t label;             // Label id, 0 if unlabeled
+        uint32_t pad;
+	    } gaze_log_block_t;
+
+// A label dictionary slot
+typedef struct gaze_log_label {
+        char name[GAZE_LOG_LABEL_SZ];
+	    } gaze_log_label_t;
+
+// Offset of the first block, i.e. after the header and label dictionary
+#define GAZE_LOG_DATA_OFFSET \
+    (sizeof(gaze_log_header_t) + GAZE_LOG_MAX_LABELS * sizeof(gaze_log_label_t))
+
+// Populates blocks with the block headers of the given log file contents, of
+// the given size, from its index if any, else by scanning its blocks. The
+// scan ends at the first truncated or malformed block (e.g. from a crashed
+// writer). Returns the offset of the end of the last valid block, or 0 if
+// the header or index is invalid.
+static uint64_t gaze_log_blocks(const char *data,
+                                uint64_t sz,
+                                vector<gaze_log_block_t> *blocks) {
+    const gaze_log_header_t *header = (const gaze_log_header_t*)data;
+
+    blocks->clear();
+
+    if (sz < sizeof(gaze_log_header_t) ||
+        memcmp(header->magic, GAZE_LOG_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != GAZE_LOG_VERSION ||
+        header->rec_sz != sizeof(gaze_packed_t) ||
+        sz < GAZE_LOG_DATA_OFFSET)
+        return 0;
+
+    uint64_t end = GAZE_LOG_DATA_OFFSET;
+    size_t block_sz = sizeof(gaze_log_block_t);
+    gaze_log_block_t block;
+
+    // Index present, so validate it and every block's bounds
+    if (header->index_offset) {
+        if (header->index_offset > sz ||
+            header->n_blocks > (sz - header->index_offset) / block_sz)
+            return 0;
+
+        const char *index = data + header->index_offset;
+
+        for (uint64_t i = 0; i < header->n_blocks; i++) {
+            memcpy(&block, index + i * block_sz, block_sz);
+
+            // Compared as lens, so a corrupt offset can't wrap the sum
+            if (block.offset < end + block_sz ||
+                block.offset > header->index_offset ||
+                block.n_records > GAZE_PACK_BLOCK_SZ ||
+                block.label > GAZE_LOG_MAX_LABELS ||
+                block.n_records * sizeof(gaze_packed_t) >
+                    header->index_offset - block.offset)
+                return 0;
+
+            end = block.offset + block.n_records * sizeof(gaze_packed_t);
+            blocks->push_back(block);
+        }
+
+        return end;
+    }
+
+    // Else scan the blocks
+    while (end + block_sz <= sz) {
+        memcpy(&block, data + end, block_sz);
+
+        if (block.offset != end + block_sz ||
+            block.n_records == 0 ||
+            block.n_records > GAZE_PACK_BLOCK_SZ ||
+            block.offset > sz ||
+            block.label > GAZE_LOG_MAX_LABELS ||
+            block.n_records * sizeof(gaze_packed_t) > sz - block.offset)
+            break;
+
+        end = block.offset + block.n_records * sizeof(gaze_packed_t);
+        blocks->push_back(block);
+    }
+
+    return end;
+}
+
+// Populates labels w/ the label dictionary of the given log file contents,
+// label id i at index i - 1. ASSUMES: gaze_log_blocks() found the log valid.
+static void gaze_log_labels(const char *data, vector<string> *labels) {
+    const gaze_log_label_t *dict =
+        (const gaze_log_label_t*)(data + sizeof(gaze_log_header_t));
+
+    labels->clear();
+
+    for (int i = 0; i < GAZE_LOG_MAX_LABELS && dict[i].name[0]; i++)
+        labels->push_back(string(dict[i].name,
+                                 strnlen(dict[i].name, GAZE_LOG_LABEL_SZ)));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+// Appends gaze samples to a binary gaze log, creating it if needed.
+class GazeLogWriter {
+    public:
+        bool open(const char*);
+        int set_label(const char*);
+        void append(gaze_data_t const&);
+        bool close();
+
+        GazeLogWriter();
+        ~GazeLogWriter();
+
+    protected:
+        int m_fd;
+        vector<string> m_labels;    // The log's dictionary
+        uint32_t m_label;           // Of subsequently appended samples
+        uint64_t m_end;             // Offset of the end of the last block
+        vector<gaze_log_block_t> m_blocks;
+        gaze_log_block_t m_block;   // The block being appended to
+        vector<gaze_packed_t> m_records;
+        bool m_is_ok;
+
+        void write_at(uint64_t, const void*, size_t);
+        void flush_block();
+};
+
+// Default constructor. Nothing is written until open().
+GazeLogWriter::GazeLogWriter() {
+    m_fd = -1;
+    m_label = 0;
+    m_end = 0;
+    m_is_ok = false;
+    m_records.reserve(GAZE_PACK_BLOCK_SZ);
+}
+
+// Destructor
+GazeLogWriter::~GazeLogWriter() {
+    close();
+}
+
+// Writes the given bytes at the given file offset, denoting any failure.
+void GazeLogWriter::write_at(uint64_t offset, const void *data, size_t sz) {
+    if (pwrite(m_fd, data, sz, offset) != (ssize_t)sz)
+        m_is_ok = false;
+}
+
+// Opens the log at the given path for appending, creating it if missing.
+// Returns false if it couldn't be opened or isn't a valid log.
+bool GazeLogWriter::open(const char *log_path) {
+    close();
+
+    m_fd = ::open(log_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        error("Gaze log open failed (could not open file).\n");
+        return false;
+    }
+
+    struct stat st;
+    fstat(m_fd, &st);
+
+    gaze_log_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GAZE_LOG_MAGIC, sizeof(header.magic));
+    header.version = GAZE_LOG_VERSION;
+    header.rec_sz = sizeof(gaze_packed_t);
+
+    m_is_ok = true;
+    m_label = 0;
+    m_end = GAZE_LOG_DATA_OFFSET;
+    m_labels.clear();
+    m_blocks.clear();
+    m_records.clear();
+
+    // Resume an existing log after its last block
+    if (st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, m_fd, 0);
+
+        if (map != MAP_FAILED) {
+            m_end = gaze_log_blocks((const char*)map, st.st_size, &m_blocks);
+            if (m_end)
+                gaze_log_labels((const char*)map, &m_labels);
+            munmap(map, st.st_size);
+        } else {
+            m_end = 0;
+        }
+
+        if (!m_end) {
+            ::close(m_fd);
+            m_fd = -1;
+            m_is_ok = false;
+            error("Gaze log open failed (invalid file).\n");
+            return false;
+        }
+    }
+
+    // The index is about to be overwritten, so invalidate it until close()
+    write_at(0, &header, sizeof(header));
+
+    // A new log's dictionary is empty
+    if (st.st_size == 0) {
+        gaze_log_label_t dict[GAZE_LOG_MAX_LABELS];
+        memset(dict, 0, sizeof(dict));
+        write_at(sizeof(header), dict, sizeof(dict));
+    }
+
+    return m_is_ok;
+}
+
+// Labels subsequently appended samples w/ the given label, interning it in
+// the log's dictionary, or unlabels them if NULL or empty. Labels are
+// truncated to GAZE_LOG_LABEL_SZ - 1 chars. Returns the label's id, or 0 if
+// unlabeled, e.g. as the dictionary is full.
+int GazeLogWriter::set_label(const char *label) {
+    if (m_fd < 0)
+        return 0;
+
+    string name = label ? label : "";
+    name = name.substr(0, GAZE_LOG_LABEL_SZ - 1);
+
+    uint32_t id = 0;
+
+    if (!name.empty()) {
+        auto it = std::find(m_labels.begin(), m_labels.end(), name);
+
+        if (it != m_labels.end()) {
+            id = it - m_labels.begin() + 1;
+        } else if (m_labels.size() == GAZE_LOG_MAX_LABELS) {
+            warn("Gaze log label ignored (label dictionary full).\n");
+        } else {
+            gaze_log_label_t slot;
+            memset(&slot, 0, sizeof(slot));
+            memcpy(slot.name, name.data(), name.size());
+            write_at(sizeof(gaze_log_header_t) +
+                        m_labels.size() * sizeof(gaze_log_label_t),
+                     &slot,
+                     sizeof(slot));
+            m_labels.push_back(name);
+            id = m_labels.size();
+        }
+    }
+
+    // A block's samples share a label
+    if (id != m_label)
+        flush_block();
+
+    m_label = id;
+
+    return id;
+}
+
+// Appends the given sample to the log.
+void GazeLogWriter::append(gaze_data_t const &cgd) {
+    if (m_fd < 0)
+        return;
+
+    if (m_records.size() == GAZE_PACK_BLOCK_SZ || (!m_records.empty() &&
+        !gaze_pack_fits(cgd, m_block.base_us, m_block.base_seq)))
+        flush_block();
+
+    if (m_records.empty()) {
+        memset(&m_block, 0, sizeof(m_block));
+        m_block.base_us = cgd.unixtime_us;
+        m_block.base_seq = cgd.seq;
+        m_block.min_us = cgd.unixtime_us;
+        m_block.max_us = cgd.unixtime_us;
+    }
+
+    gaze_packed_t rec;
+    gaze_pack(cgd, m_block.base_us, m_block.base_seq, &rec);
+    m_records.push_back(rec);
+
+    m_block.min_us = min(m_block.min_us, cgd.unixtime_us);
+    m_block.max_us = max(m_block.max_us, cgd.unixtime_us);
+}
+
+// Writes the block being appended to, if any.
+void GazeLogWriter::flush_block() {
+    if (m_records.empty())
+        return;
+
+    m_block.offset = m_end + sizeof(m_block);
+    m_block.n_records = m_records.size();
+    m_block.label = m_label;
+
+    write_at(m_end, &m_block, sizeof(m_block));
+    write_at(m_block.offset,
+             m_records.data(),
+             m_records.size() * sizeof(gaze_packed_t));
+
+    m_end = m_block.offset + m_records.size() * sizeof(gaze_packed_t);
+    m_blocks.push_back(m_block);
+    m_records.clear();
+}
+
+// Writes any pending samples and the index, then closes the log. Returns
+// false if any write failed since open().
+bool GazeLogWriter::close() {
+    if (m_fd < 0)
+        return false;
+
+    flush_block();
+
+    gaze_log_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GAZE_LOG_MAGIC, sizeof(header.magic));
+    header.version = GAZE_LOG_VERSION;
+    header.rec_sz = sizeof(gaze_packed_t);
+    header.index_offset = m_end;
+    header.n_blocks = m_blocks.size();
+
+    size_t index_sz = m_blocks.size() * sizeof(gaze_log_block_t);
+
+    write_at(m_end, m_blocks.data(), index_sz);
+    if (ftruncate(m_fd, m_end + index_sz))
+        m_is_ok = false;
+    write_at(0, &header, sizeof(header));
+
+    ::close(m_fd);
+    m_fd = -1;
+
+    if (!m_is_ok)
+        error("Gaze log write failed.\n");
+
+    return m_is_ok;
+}
+
+// Reads a binary gaze log, memory-mapped.
+class GazeLogReader {
+    public:
+        bool open(const char*);
+        int n_blocks();
+        gaze_log_block_t const& block(int);
+        int64_t n_records();
+        gaze_packed_t const* record(int, int);
+        void read(int, int, gaze_data_t*);
+        int64_t unixtime_us(int, int);
+        bool find(int64_t, int*, int*);
+        int n_labels();
+        const char* label(int);
+        int label_id(const char*);
+
+        GazeLogReader();
+        ~GazeLogReader();
+
+    protected:
+        void *m_map;
+        size_t m_map_sz;
+        vector<gaze_log_block_t> m_blocks;
+        vector<string> m_labels;    // The log's dictionary
+        int64_t m_n_records;
+
+    private:
+        void unmap();
+};
+
+// Default constructor. The log is empty until open().
+GazeLogReader::GazeLogReader() {
+    m_map = NULL;
+    m_map_sz = 0;
+    m_n_records = 0;
+}
+
+// Destructor
+GazeLogReader::~GazeLogReader() {
+    unmap();
+}
+
+// Unmaps the log file, if mapped.
+void GazeLogReader::unmap() {
+    if (m_map)
+        munmap(m_map, m_map_sz);
+
+    m_map = NULL;
+    m_map_sz = 0;
+    m_blocks.clear();
+    m_labels.clear();
+    m_n_records = 0;
+}
+
+// Memory-maps the log at the given path. Returns false if the file is
+// missing or malformed, in which case the log is empty.
+bool GazeLogReader::open(const char *log_path) {
+    unmap();
+
+    int fd = ::open(log_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(gaze_log_header_t)) {
+        ::close(fd);
+        warn("Gaze log load failed (file too small).\n");
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (map == MAP_FAILED) {
+        warn("Gaze log load failed (mmap failed).\n");
+        return false;
+    }
+
+    if (!gaze_log_blocks((const char*)map, st.st_size, &m_blocks)) {
+        munmap(map, st.st_size);
+        warn("Gaze log load failed (invalid file).\n");
+        return false;
+    }
+
+    m_map = map;
+    m_map_sz = st.st_size;
+    gaze_log_labels((const char*)map, &m_labels);
+
+    for (auto &block : m_blocks)
+        m_n_records += block.n_records;
+
+    return true;
+}
+
+// Returns the number of blocks in the log.
+int GazeLogReader::n_blocks() {
+    return m_blocks.size();
+}
+
+// Returns the i'th block's header.
+gaze_log_block_t const& GazeLogReader::block(int i) {
+    return m_blocks[i];
+}
+
+// Returns the number of samples in the log.
+int64_t GazeLogReader::n_records() {
+    return m_n_records;
+}
+
+// Returns a ptr to the i'th record of the given block.
+gaze_packed_t const* GazeLogReader::record(int block, int i) {
+    return (gaze_packed_t const*)(
+        (const char*)m_map + m_blocks[block].offset) + i;
+}
+
+// Populates cgd with the i'th sample of the given block.
+void GazeLogReader::read(int block, int i, gaze_data_t *cgd) {
+    gaze_unpack(*record(block, i),
+                m_blocks[block].base_us,
+                m_blocks[block].base_seq,
+                cgd);
+}
+
+// Returns the timestamp of the i'th sample of the given block.
+int64_t GazeLogReader::unixtime_us(int block, int i) {
+    return m_blocks[block].base_us + record(block, i)->dt_us;
+}
+
+// Populates block and i with the location of the first sample at or after
+// the given time. Returns false if there is none.
+// ASSUMES: Samples were logged in chronological order.
+bool GazeLogReader::find(int64_t unixtime_us, int *block, int *i) {
+    auto it = lower_bound(
+        m_blocks.begin(), m_blocks.end(), unixtime_us,
+        [](gaze_log_block_t const &b, int64_t t) { return b.max_us < t; });
+
+    if (it == m_blocks.end())
+        return false;
+
+    int lo = 0;
+    int hi = it->n_records - 1;   // Has a sample at or after, by max_us
+
+    *block = it - m_blocks.begin();
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (this->unixtime_us(*block, mid) < unixtime_us)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    *i = lo;
+
+    return true;
+}
+
+// Returns the number of labels in the log's dictionary.
+int GazeLogReader::n_labels() {
+    return m_labels.size();
+}
+
+// Returns the name of the label w/ the given id, or "" if unlabeled or not
+// in the dictionary.
+const char* GazeLogReader::label(int id) {
+    if (id < 1 || id > (int)m_labels.size())
+        return "";
+
+    return m_labels[id - 1].c_str();
+}
+
+// Returns the id of the given label, for comparing against blocks' labels,
+// 0 if NULL or empty (i.e. unlabeled), or -1 if not in the dictionary.
+int GazeLogReader::label_id(const char *label) {
+    if (!label || !label[0])
+        return 0;
+
+    string name = string(label).substr(0, GAZE_LOG_LABEL_SZ - 1);
+    auto it = std::find(m_labels.begin(), m_labels.end(), name);
+
+    return it == m_labels.end() ? -1 : it - m_labels.begin() + 1;
+}
@@ -0,0 +1,165 @@
+/////////////////////////////////////////////////////////////////////////////
+// Packing of gaze samples to and from their compact, fixed-point form
+// (gaze_packed_t, 72 bytes vs. gaze_data_t's 144), for high-rate and
+// long-retention uses, e.g. the ring and the binary gaze log.
+//
+// Each float field is stored as an int16 multiple of a per-field power of
+// two scale, rounded to nearest (even), so the error bound per field is half
+// its scale, within its range:
+//
+//      Fields              Scale       Range           Max error
+//      *_normed_*          2^-14       +/- 2           3.1e-5
+//      *_pupildiameter_mm  2^-10       +/- 32 mm       4.9e-4 mm
+//      Other *_mm_*        2^-4        +/- 2048 mm     0.031 mm
+//
+// Out of range values saturate to their range and NaNs (e.g. an invalid
+// eye's fields) are preserved, being packed as INT16_MIN. Timestamps, as
+// microsecond deltas from a per-block base, sequence numbers, as deltas
+// from a per-block base seq, and combined gaze points, in +/- 32767 px, are
+// exact.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define GAZE_PACK_N_FIELDS 30           // As gaze_packed_t.fields
+#define GAZE_PACK_NAN INT16_MIN
+#define GAZE_PACK_MAX 32767
+#define GAZE_PACK_MAX_DSEQ 65535
+#define GAZE_PACK_BLOCK_SZ 256          // Max records per block of bases
+#define GAZE_PACK_SCALE_NORMED (1.0f / 16384)
+#define GAZE_PACK_SCALE_PUPIL (1.0f / 1024)
+#define GAZE_PACK_SCALE_MM (1.0f / 16)
+
+static_assert(sizeof(gaze_packed_t) == 72, "gaze_packed_t must be 72 bytes");
+static_assert(offsetof(gaze_data_t, right_gazepoint_normed_y) ==
+              offsetof(gaze_data_t, left_eyeposition_normed_x) +
+              (GAZE_PACK_N_FIELDS - 1) * sizeof(float),
+              "gaze_data_t float fields must be contiguous");
+
+// Per-field scales, in gaze_data_t float field order, padded to a multiple
+// of 4 fields
+static const float g_gaze_pack_scales[GAZE_PACK_N_FIELDS + 2] = {
+    GAZE_PACK_SCALE_NORMED, GAZE_PACK_SCALE_NORMED, GAZE_PACK_SCALE_NORMED,
+    GAZE_PACK_SCALE_NORMED, GAZE_PACK_SCALE_NORMED, GAZE_PACK_SCALE_NORMED,
+    GAZE_PACK_SCALE_PUPIL, GAZE_PACK_SCALE_PUPIL,
+    GAZE_PACK_SCALE_MM, GAZE_PACK_SCALE_MM, GAZE_PACK_SCALE_MM,
+    GAZE_PACK_SCALE_MM, GAZE_PACK_SCALE_MM, GAZE_PACK_SCALE_MM,
+    GAZE_PACK_SCALE_MM, GAZE_PACK_SCALE_MM, GAZE_PACK_SCALE_MM,
+    GAZE_PACK_SCALE_MM, GAZE_PACK_SCALE_MM, GAZE_PACK_SCALE_MM,
+    GAZE_PACK_SCALE_MM, GAZE_PACK_SCALE_MM, GAZE_PACK_SCALE_MM,
+    GAZE_PACK_SCALE_MM, GAZE_PACK_SCALE_MM, GAZE_PACK_SCALE_MM,
+    GAZE_PACK_SCALE_NORMED, GAZE_PACK_SCALE_NORMED,
+    GAZE_PACK_SCALE_NORMED, GAZE_PACK_SCALE_NORMED,
+    1.0f, 1.0f
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// Packing
+
+// Returns true iff the given sample's timestamp and seq are packable against
+// the given bases.
+inline bool gaze_pack_fits(gaze_data_t const &cgd,
+                           int64_t base_us,
+                           uint32_t base_seq) {
+    int64_t dt_us = cgd.unixtime_us - base_us;
+    return dt_us >= INT32_MIN && dt_us <= INT32_MAX &&
+           cgd.seq - base_seq <= GAZE_PACK_MAX_DSEQ;
+}
+
+// Returns the given int saturated to the packed range.
+static inline int16_t gaze_pack_int(int v) {
+    return (int16_t)max(-GAZE_PACK_MAX, min(GAZE_PACK_MAX, v));
+}
+
+// Packs the given sample into out, its timestamp and seq relative to the
+// given bases.
+// ASSUMES: gaze_pack_fits(cgd, base_us, base_seq)
+void gaze_pack(gaze_data_t const &cgd,
+               int64_t base_us,
+               uint32_t base_seq,
+               gaze_packed_t *out) {
+    float const *src = &cgd.left_eyeposition_normed_x;
+    int16_t packed[GAZE_PACK_N_FIELDS + 2];
+    __m128 lo = _mm_set1_ps(-GAZE_PACK_MAX);
+    __m128 hi = _mm_set1_ps(GAZE_PACK_MAX);
+    __m128i words[2];
+
+    out->dt_us = (int32_t)(cgd.unixtime_us - base_us);
+    out->combined_gazepoint_x = gaze_pack_int(cgd.combined_gazepoint_x);
+    out->combined_gazepoint_y = gaze_pack_int(cgd.combined_gazepoint_y);
+    out->validity = cgd.validity;
+    out->flags = cgd.flags;
+    out->dseq = cgd.seq - base_seq;
+
+    // 8 fields at a time. Max/min keep NaNs, which then convert to INT_MIN
+    // and saturate to GAZE_PACK_NAN.
+    for (int i = 0; i < GAZE_PACK_N_FIELDS + 2; i += 8) {
+        for (int j = 0; j < 2; j++) {
+            int k = i + j * 4;
+            __m128 v = k + 4 <= GAZE_PACK_N_FIELDS ?
+                _mm_loadu_ps(src + k) :
+                _mm_loadl_pi(_mm_setzero_ps(), (__m64 const*)(src + k));
+
+            v = _mm_div_ps(v, _mm_loadu_ps(g_gaze_pack_scales + k));
+            v = _mm_min_ps(hi, _mm_max_ps(lo, v));
+            words[j] = _mm_cvtps_epi32(v);
+        }
+
+        _mm_storeu_si128(
+            (__m128i*)&packed[i], _mm_packs_epi32(words[0], words[1]));
+    }
+
+    memcpy(out->fields, packed, sizeof(out->fields));
+}
+
+// Unpacks the given packed sample into cgd, given its block's bases.
+void gaze_unpack(gaze_packed_t const &in,
+                 int64_t base_us,
+                 uint32_t base_seq,
+                 gaze_data_t *cgd) {
+    float *dst = &cgd->left_eyeposition_normed_x;
+    int16_t packed[GAZE_PACK_N_FIELDS + 2] = {};
+    __m128i nan_word = _mm_set1_epi32(GAZE_PACK_NAN);
+    __m128 nan = _mm_set1_ps(NAN);
+
+    memset(cgd, 0, offsetof(gaze_data_t, left_eyeposition_normed_x));
+    cgd->unixtime_us = base_us + in.dt_us;
+    cgd->combined_gazepoint_x = in.combined_gazepoint_x;
+    cgd->combined_gazepoint_y = in.combined_gazepoint_y;
+    cgd->validity = in.validity;
+    cgd->flags = in.flags;
+    cgd->seq = base_seq + in.dseq;
+
+    memcpy(packed, in.fields, sizeof(in.fields));
+
+    for (int i = 0; i < GAZE_PACK_N_FIELDS + 2; i += 8) {
+        __m128i v = _mm_loadu_si128((__m128i const*)&packed[i]);
+
+        for (int j = 0; j < 2; j++) {
+            int k = i + j * 4;
+
+            // Sign-extend 4 words to ints, then scale, restoring NaNs
+            __m128i w = _mm_srai_epi32(j ? _mm_unpackhi_epi16(v, v) :
+                                           _mm_unpacklo_epi16(v, v), 16);
+            __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(w),
+                                  _mm_loadu_ps(g_gaze_pack_scales + k));
+            __m128 is_nan = _mm_castsi128_ps(_mm_cmpeq_epi32(w, nan_word));
+            f = _mm_or_ps(_mm_and_ps(is_nan, nan), _mm_andnot_ps(is_nan, f));
+
+            if (k + 4 <= GAZE_PACK_N_FIELDS)
+                _mm_storeu_ps(dst + k, f);
+            else
+                _mm_storel_pi((__m64*)(dst + k), f);
+        }
+    }
+}
@@ -0,0 +1,48 @@
+/////////////////////////////////////////////////////////////////////////////
+// USDT (SystemTap-style) static tracepoints in the gaze hot path, for
+// profiling in production w/ perf or bpftrace, without rebuilding. E.g.
+//
+//      bpftrace -e 'usdt:/opt/app/src/lib/so/eyetracker_gaze.so:aeye:enque
+//                   { @n = count(); }'
+//
+// Unattached, a probe is a nop, its args being left wherever they already
+// are. Probes, of provider "aeye", and their args:
+//
+//      sample          At receipt: seq, tracker_us, system_us (the device's
+//                      timestamps)
+//      enque           seq, unixtime_us, x, y, flags
+//      smooth          Iff any samples were smoothed: the newest sample's
+//                      seq and unixtime_us, n_samples, x, y
+//      predict         seq, x, y (device), x_pred, y_pred (ML)
+//      marker          x, y, is_cursor
+//      export_start    kind (GAZE_PROBE_EXPORT_*), n_samples, path
+//      export_end      kind, n_written, path
+//
+// Coordinates are in display px. Probes are compiled in iff sys/sdt.h is
+// present (e.g. from Ubuntu's systemtap-sdt-dev), else compile to nothing.
+// See lib/bt/ for bpftrace scripts producing latency histograms from them.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define GAZE_PROBES_ENABLED
+#endif
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define GAZE_PROBE_EXPORT_CSV 0
+#define GAZE_PROBE_EXPORT_LOG 1
+
+#ifdef GAZE_PROBES_ENABLED
+#define GAZE_PROBE3(name, a, b, c) DTRACE_PROBE3(aeye, name, a, b, c)
+#define GAZE_PROBE5(name, a, b, c, d, e) DTRACE_PROBE5(aeye, name, a, b, c, d, e)
+#else
+#define GAZE_PROBE3(name, a, b, c)
+#define GAZE_PROBE5(name, a, b, c, d, e)
+#endif
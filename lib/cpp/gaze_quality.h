@@ -0,0 +1,267 @@
+/////////////////////////////////////////////////////////////////////////////
+// A streaming gaze data-quality monitor. From every gaze sample (valid or
+// not) it maintains, over rolling windows of the most recent samples:
+//
+//  - Precision, as the RMS sample-to-sample distance of the gaze point
+//    during fixations (i.e. while gaze velocity is below a threshold),
+//    along with its baseline (the first full window's value), so drift
+//    away from the post-calibration precision is visible.
+//  - The invalid-sample ratio, per eye.
+//  - Dropout bursts (runs of samples w/ no valid gaze point) and their
+//    lengths.
+//
+// Each window keeps running sums, so per-sample cost is O(1). When the
+// configured thresholds are crossed a GAZE_EVENT_RECALIBRATE event is raised,
+// once, and is not raised again until quality has recovered.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define QUALITY_BURST_WINDOW 64         // Most recent dropout bursts kept
+#define QUALITY_REARM_FRAC 0.8          // Recovery needed to re-arm event
+#define QUALITY_LEFT_INVALID 0x1
+#define QUALITY_RIGHT_INVALID 0x2
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class GazeQuality {
+    public:
+        void configure(int, float, float, float);
+        void reset();
+        bool update(int64_t, bool, bool, int, int, gaze_event_t*);
+        void metrics(gaze_quality_t*);
+        bool is_degraded();
+
+        GazeQuality();
+
+    protected:
+        int m_window;
+        float m_fixation_px_s;
+        float m_max_rms_px;
+        float m_max_invalid;
+
+        int64_t m_n_samples;
+        int64_t m_prev_us;
+        int m_prev_x;
+        int m_prev_y;
+        bool m_is_prev_valid;
+        bool m_is_degraded;
+        float m_baseline_rms;
+
+        vector<uint8_t> m_invalid;      // Per-sample invalid flags ring
+        int m_invalid_pos;
+        int m_invalid_n;
+        int m_n_left_invalid;
+        int m_n_right_invalid;
+
+        vector<int64_t> m_s2s;          // Squared s2s dists (px^2) ring
+        int m_s2s_pos;
+        int m_s2s_n;
+        int64_t m_s2s_sum;
+
+        vector<int> m_bursts;           // Dropout burst lens ring
+        int m_bursts_pos;
+        int m_bursts_n;
+        int64_t m_bursts_sum;
+        int m_burst_curr;
+
+        float rms();
+        bool check(bool);
+};
+
+// Default constructor. Thresholds are disabled until configure().
+GazeQuality::GazeQuality() {
+    configure(900, 1000, 0, 1);
+}
+
+// Sets the window size (in samples), the velocity (in px/s) below which
+// gaze is considered fixated, and the thresholds beyond which recalibration
+// is suggested: RMS precision (in px, 0 disables) and per-eye invalid ratio
+// (1 disables). Resets all metrics.
+void GazeQuality::configure(int window,
+                            float fixation_px_s,
+                            float max_rms_px,
+                            float max_invalid) {
+    m_window = max(window, 1);
+    m_fixation_px_s = fixation_px_s;
+    m_max_rms_px = max_rms_px;
+    m_max_invalid = max_invalid;
+    reset();
+}
+
+// Clears all metrics, e.g. after recalibrating, so a new baseline is taken.
+void GazeQuality::reset() {
+    m_n_samples = 0;
+    m_prev_us = 0;
+    m_prev_x = 0;
+    m_prev_y = 0;
+    m_is_prev_valid = false;
+    m_is_degraded = false;
+    m_baseline_rms = -1;
+
+    m_invalid.assign(m_window, 0);
+    m_invalid_pos = 0;
+    m_invalid_n = 0;
+    m_n_left_invalid = 0;
+    m_n_right_invalid = 0;
+
+    m_s2s.assign(m_window, 0);
+    m_s2s_pos = 0;
+    m_s2s_n = 0;
+    m_s2s_sum = 0;
+
+    m_bursts.assign(QUALITY_BURST_WINDOW, 0);
+    m_bursts_pos = 0;
+    m_bursts_n = 0;
+    m_bursts_sum = 0;
+    m_burst_curr = 0;
+}
+
+// Returns the RMS sample-to-sample distance over the window, in px.
+float GazeQuality::rms() {
+    return m_s2s_n > 0 ? sqrt((double)m_s2s_sum / m_s2s_n) : 0;
+}
+
+// Updates metrics from a gaze sample at time t_us, given each eye's validity
+// and, iff either is valid, the display coords (x, y). Precision is taken
+// from binocular samples only. If the sample crosses the quality thresholds,
+// populates event and returns true.
+bool GazeQuality::update(int64_t t_us,
+                         bool is_left_valid,
+                         bool is_right_valid,
+                         int x,
+                         int y,
+                         gaze_event_t *event) {
+    bool is_valid = is_left_valid && is_right_valid;
+    bool is_dropout = !is_left_valid && !is_right_valid;
+    m_n_samples++;
+
+    // Per-eye invalid ratio, dropping the oldest sample from the window
+    uint8_t flags = (is_left_valid ? 0 : QUALITY_LEFT_INVALID) |
+                    (is_right_valid ? 0 : QUALITY_RIGHT_INVALID);
+
+    if (m_invalid_n == m_window) {
+        uint8_t oldest = m_invalid[m_invalid_pos];
+        m_n_left_invalid -= (oldest & QUALITY_LEFT_INVALID) ? 1 : 0;
+        m_n_right_invalid -= (oldest & QUALITY_RIGHT_INVALID) ? 1 : 0;
+    } else {
+        m_invalid_n++;
+    }
+
+    m_invalid[m_invalid_pos] = flags;
+    m_invalid_pos = (m_invalid_pos + 1) % m_window;
+    m_n_left_invalid += is_left_valid ? 0 : 1;
+    m_n_right_invalid += is_right_valid ? 0 : 1;
+
+    // Dropout bursts
+    if (is_dropout) {
+        m_burst_curr++;
+    } else if (m_burst_curr > 0) {
+        if (m_bursts_n == QUALITY_BURST_WINDOW)
+            m_bursts_sum -= m_bursts[m_bursts_pos];
+        else
+            m_bursts_n++;
+
+        m_bursts[m_bursts_pos] = m_burst_curr;
+        m_bursts_pos = (m_bursts_pos + 1) % QUALITY_BURST_WINDOW;
+        m_bursts_sum += m_burst_curr;
+        m_burst_curr = 0;
+    }
+
+    // Sample-to-sample precision, from consecutive valid samples in fixation
+    int64_t dt_us = t_us - m_prev_us;
+
+    if (is_valid && m_is_prev_valid && dt_us > 0 &&
+        dt_us <= DWELL_MAX_SAMPLE_GAP_US) {
+            int64_t dx = x - m_prev_x;
+            int64_t dy = y - m_prev_y;
+            int64_t dist_sq = dx * dx + dy * dy;
+            double max_dist = m_fixation_px_s * dt_us / 1e6;
+
+            if (dist_sq <= max_dist * max_dist) {
+                if (m_s2s_n == m_window)
+                    m_s2s_sum -= m_s2s[m_s2s_pos];
+                else
+                    m_s2s_n++;
+
+                m_s2s[m_s2s_pos] = dist_sq;
+                m_s2s_pos = (m_s2s_pos + 1) % m_window;
+                m_s2s_sum += dist_sq;
+
+                if (m_baseline_rms < 0 && m_s2s_n == m_window)
+                    m_baseline_rms = rms();
+            }
+    }
+
+    m_prev_us = t_us;
+    m_prev_x = x;
+    m_prev_y = y;
+    m_is_prev_valid = is_valid;
+
+    // Raise an event only on becoming degraded
+    bool was_degraded = m_is_degraded;
+    m_is_degraded = check(was_degraded);
+
+    if (!m_is_degraded || was_degraded)
+        return false;
+
+    event->type = GAZE_EVENT_RECALIBRATE;
+    event->key_idx = HUD_KEY_NONE;
+    event->unixtime_us = t_us;
+    event->duration_us = 0;
+
+    return true;
+}
+
+// Returns true iff full windows cross the thresholds. If currently degraded,
+// metrics must recover past a margin (QUALITY_REARM_FRAC) to return false.
+bool GazeQuality::check(bool is_degraded) {
+    float margin = is_degraded ? QUALITY_REARM_FRAC : 1;
+
+    if (m_invalid_n == m_window) {
+        float max_invalid = m_max_invalid * margin;
+
+        if (m_n_left_invalid > max_invalid * m_window ||
+            m_n_right_invalid > max_invalid * m_window)
+                return true;
+    }
+
+    return m_max_rms_px > 0 && m_s2s_n == m_window &&
+        rms() > m_max_rms_px * margin;
+}
+
+// Returns true iff the thresholds are currently crossed.
+bool GazeQuality::is_degraded() {
+    return m_is_degraded;
+}
+
+// Populates quality with the current metrics.
+void GazeQuality::metrics(gaze_quality_t *quality) {
+    int burst_max = 0;
+    for (int i = 0; i < m_bursts_n; i++)
+        burst_max = max(burst_max, m_bursts[i]);
+
+    quality->n_samples = m_n_samples;
+    quality->rms_s2s_px = rms();
+    quality->rms_s2s_baseline_px = max(m_baseline_rms, 0.0f);
+    quality->left_invalid_ratio =
+        m_invalid_n > 0 ? (float)m_n_left_invalid / m_invalid_n : 0;
+    quality->right_invalid_ratio =
+        m_invalid_n > 0 ? (float)m_n_right_invalid / m_invalid_n : 0;
+    quality->n_bursts = m_bursts_n;
+    quality->burst_max = burst_max;
+    quality->burst_mean =
+        m_bursts_n > 0 ? (float)m_bursts_sum / m_bursts_n : 0;
+    quality->burst_current = m_burst_curr;
+    quality->is_degraded = m_is_degraded;
+}
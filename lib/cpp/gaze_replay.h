@@ -0,0 +1,489 @@
+/////////////////////////////////////////////////////////////////////////////
+// Offline replay of binary gaze logs (see gaze_log.h) through the live
+// pipeline's ML correction and smoothing (see gaze_smooth.h), quality
+// monitor and blink detector, e.g. to compare smoothing params or retrained
+// models over archived logs. Each log's results are written to a CSV of the
+// same base name (a log whose base name is an earlier one's is skipped), one
+// row per logged sample, of the sample's logged columns followed by the
+// pipeline's:
+//
+//      unixtime_us, seq, validity, x, y,
+//      corrected_x, corrected_y, smoothed_x, smoothed_y, n_smoothed,
+//      is_degraded, blink_us
+//
+// where (x, y) is the device's gaze point, (corrected_x, corrected_y) the
+// point smoothed over (ML-corrected iff models are given), (smoothed_x,
+// smoothed_y) the gaze point as marked live after the sample, is_degraded
+// the quality monitor's state and blink_us the duration of any blink ended
+// by the sample, else 0.
+//
+// Logs are split into shards of a fixed time span, replayed in parallel by
+// a pool of threads and written in order. A shard starts at the log's first
+// block at or after its boundary, so idle gaps in a log don't make empty
+// shards. Each shard first replays, w/o output, the warm-up span preceding
+// it, so its state continues from the preceding shard's. The smoothing
+// window and blink detector need only a few samples (or BLINK_MAX_US) of
+// warm-up; the quality monitor needs at least its window. Its precision
+// baseline, however, is the first full window's, which live is that of the
+// session and in a shard that of its warm-up, so for exact is_degraded
+// results use one shard per log.
+//
+// Logs hold only samples w/ either eye valid, so the invalid samples seen
+// live, by the quality monitor and blink detector, are recovered from seq
+// deltas and replayed at interpolated times. Samples lost otherwise (e.g.
+// overwritten in the buffer before export) are likewise replayed as
+// invalid. A seq or time regression, or a seq delta implausible for its
+// time delta (e.g. a new session appended to the log), restarts the
+// pipeline, as live.
+//
+// ML predictions are made by Python and so serialize on the GIL; replay is
+// otherwise lock-free and scales w/ the number of threads until I/O bound.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <boost/circular_buffer.hpp>
+
+using namespace std;
+using namespace std::chrono;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define GAZE_REPLAY_MAX_HZ 1200         // Max plausible sample rate
+#define GAZE_REPLAY_ROW_SZ 128          // Max CSV row len
+
+typedef struct gaze_replay_shard {
+        int log;                    // Idx of the shard's log
+        int64_t t0_us;              // Start of output, inclusive
+        int64_t t1_us;              // End of output, exclusive
+        bool is_first;              // Of its log's shards?
+        bool is_last;
+	    } gaze_replay_shard_t;
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+// The pipeline state of a replay, fed one logged sample at a time.
+class GazeReplayPipeline {
+    public:
+        void update(gaze_data_t const&, char*);
+        void restart();
+
+        GazeReplayPipeline(gaze_replay_params_t const&,
+                           EyeTrackerCoordPredict*,
+                           EyeTrackerCoordPredict*,
+                           boost::mutex*);
+
+    protected:
+        EyeTrackerCoordPredict *m_x_ml, *m_y_ml;
+        boost::mutex *m_ml_mutex;
+        GazeQuality m_quality;
+        BlinkDetect m_blinks;
+
+        boost::circular_buffer<int> m_window_x;
+        boost::circular_buffer<int> m_window_y;
+        int64_t m_sum_x;
+        int64_t m_sum_y;
+
+        bool m_is_prev;                 // Has a sample been fed?
+        uint32_t m_prev_seq;
+        int64_t m_prev_us;
+
+        void update_invalid(int64_t);
+};
+
+// Replays logs, sharded, on a pool of threads.
+class GazeReplay {
+    public:
+        int64_t run(const char**, int, const char*, gaze_replay_stats_t*);
+
+        GazeReplay(gaze_replay_params_t const&, const char*, const char*);
+
+    protected:
+        gaze_replay_params_t m_params;
+        EyeTrackerCoordPredict *m_x_ml, *m_y_ml;
+        boost::mutex m_ml_mutex;
+
+        vector<shared_ptr<GazeLogReader>> m_logs;
+        vector<string> m_out_paths;
+        vector<gaze_replay_shard_t> m_shards;
+        atomic<int> m_next_shard;
+        atomic<int64_t> m_n_warmup;
+
+        // Ordered output, guarded by m_mutex
+        boost::mutex m_mutex;
+        map<int, pair<int64_t, shared_ptr<string>>> m_pending;  // By shard
+        vector<int> m_next_commit;      // Shard idx, per log
+        vector<FILE*> m_files;
+        vector<bool> m_is_failed;
+        int64_t m_n_samples;
+
+        void worker();
+        int64_t replay(gaze_replay_shard_t const&, string*);
+        void commit(int, int64_t, shared_ptr<string>);
+        void shard(int);
+};
+
+// Returns the ML predictor of the model at the given path, loading it on
+// first use. Predictors live for the process, as their destruction
+// finalizes Python.
+EyeTrackerCoordPredict* gaze_replay_model(const char *model_path) {
+    static map<string, EyeTrackerCoordPredict*> models;
+    static boost::mutex models_mutex;
+
+    boost::mutex::scoped_lock lock(models_mutex);
+    EyeTrackerCoordPredict *&model = models[model_path];
+
+    if (!model)
+        model = new EyeTrackerCoordPredict(model_path);
+
+    return model;
+}
+
+// Constructor. Iff both models are given, predictions through them are
+// serialized on ml_mutex.
+GazeReplayPipeline::GazeReplayPipeline(gaze_replay_params_t const &params,
+                                       EyeTrackerCoordPredict *x_ml,
+                                       EyeTrackerCoordPredict *y_ml,
+                                       boost::mutex *ml_mutex)
+    : m_window_x(max(params.smooth_over, 1)),
+      m_window_y(max(params.smooth_over, 1)) {
+    m_x_ml = x_ml;
+    m_y_ml = y_ml;
+    m_ml_mutex = ml_mutex;
+    m_quality.configure(params.quality_window,
+                        params.quality_fixation_px_s,
+                        params.quality_max_rms_px,
+                        params.quality_max_invalid);
+    restart();
+}
+
+// Clears all state, as on a new session.
+void GazeReplayPipeline::restart() {
+    m_quality.reset();
+    m_blinks = BlinkDetect();
+    m_window_x.clear();
+    m_window_y.clear();
+    m_sum_x = 0;
+    m_sum_y = 0;
+    m_is_prev = false;
+    m_prev_seq = 0;
+    m_prev_us = 0;
+}
+
+// Feeds an invalid (i.e. unlogged) sample at the given time.
+void GazeReplayPipeline::update_invalid(int64_t unixtime_us) {
+    gaze_event_t event;
+
+    m_quality.update(unixtime_us, False, False, 0, 0, &event);
+    m_blinks.update(unixtime_us, 0, NULL);
+}
+
+// Feeds the given logged sample, preceded by any invalid samples implied by
+// its seq, and populates row w/ its CSV row (of at most GAZE_REPLAY_ROW_SZ
+// chars, incl. the newline).
+void GazeReplayPipeline::update(gaze_data_t const &cgd, char *row) {
+    gaze_event_t event;
+
+    if (m_is_prev) {
+        int64_t dseq = (int64_t)cgd.seq - m_prev_seq;
+        int64_t dt_us = cgd.unixtime_us - m_prev_us;
+
+        if (dseq <= 0 || dt_us < 0 ||
+            (dseq - 1) * 1000000 > dt_us * GAZE_REPLAY_MAX_HZ) {
+            restart();
+        } else {
+            for (int64_t i = 1; i < dseq; i++)
+                update_invalid(m_prev_us + dt_us * i / dseq);
+        }
+    }
+
+    m_is_prev = true;
+    m_prev_seq = cgd.seq;
+    m_prev_us = cgd.unixtime_us;
+
+    m_quality.update(cgd.unixtime_us,
+                     cgd.validity & GAZE_VALID_LEFT,
+                     cgd.validity & GAZE_VALID_RIGHT,
+                     cgd.combined_gazepoint_x,
+                     cgd.combined_gazepoint_y,
+                     &event);
+
+    int64_t blink_us = 0;
+    if (m_blinks.update(cgd.unixtime_us, cgd.validity, &event))
+        blink_us = event.duration_us;
+
+    // Smooth over the latest samples, as get_gazepoint_smoothed()
+    int x, y;
+
+    if (m_x_ml && m_y_ml && cgd.validity == GAZE_VALID_BOTH) {
+        boost::mutex::scoped_lock lock(*m_ml_mutex);
+        gaze_smooth_coords(cgd, m_x_ml, m_y_ml, &x, &y);
+    } else {
+        gaze_smooth_coords(cgd, NULL, NULL, &x, &y);
+    }
+
+    if (m_window_x.full()) {
+        m_sum_x -= m_window_x.front();
+        m_sum_y -= m_window_y.front();
+    }
+
+    m_window_x.push_back(x);
+    m_window_y.push_back(y);
+    m_sum_x += x;
+    m_sum_y += y;
+
+    int n_smoothed = m_window_x.size();
+
+    snprintf(row, GAZE_REPLAY_ROW_SZ,
+             "%ld, %u, %d, %d, %d, %d, %d, %d, %d, %d, %d, %ld\n",
+             (long)cgd.unixtime_us,
+             cgd.seq,
+             cgd.validity,
+             cgd.combined_gazepoint_x,
+             cgd.combined_gazepoint_y,
+             x,
+             y,
+             (int)(m_sum_x / n_smoothed),
+             (int)(m_sum_y / n_smoothed),
+             n_smoothed,
+             m_quality.is_degraded(),
+             (long)blink_us);
+}
+
+// Constructor. Iff both model paths are given, samples are ML-corrected.
+GazeReplay::GazeReplay(gaze_replay_params_t const &params,
+                       const char *ml_x_path,
+                       const char *ml_y_path) {
+    m_params = params;
+    m_x_ml = NULL;
+    m_y_ml = NULL;
+
+    if (ml_x_path && ml_y_path) {
+        m_x_ml = gaze_replay_model(ml_x_path);
+        m_y_ml = gaze_replay_model(ml_y_path);
+    }
+}
+
+// Replays the logs at the given paths, writing each's results to out_dir
+// (see above), overwriting any existing. Populates stats, if given. Returns
+// the number of samples written.
+int64_t GazeReplay::run(const char **log_paths,
+                        int n_logs,
+                        const char *out_dir,
+                        gaze_replay_stats_t *stats) {
+    steady_clock::time_point t_start = steady_clock::now();
+    int n_failed = 0;
+    set<string> out_paths;
+
+    m_logs.clear();
+    m_out_paths.clear();
+    m_shards.clear();
+
+    // Open the logs, and shard each by time from its first sample
+    for (int i = 0; i < n_logs; i++) {
+        shared_ptr<GazeLogReader> log = make_shared<GazeLogReader>();
+
+        if (!log->open(log_paths[i])) {
+            warn("Gaze replay skipped a log (failed to open).\n");
+            n_failed++;
+            continue;
+        }
+
+        if (!log->n_blocks())
+            continue;
+
+        string name = log_paths[i];
+        name = name.substr(name.find_last_of('/') + 1);
+        name = name.substr(0, name.find_last_of('.'));
+        string out_path = string(out_dir) + "/" + name + ".csv";
+
+        if (!out_paths.insert(out_path).second) {
+            warn("Gaze replay skipped a log (base name already replayed).\n");
+            n_failed++;
+            continue;
+        }
+
+        int log_idx = m_logs.size();
+        int64_t t0_us = log->block(0).min_us;
+        int64_t end_us = log->block(log->n_blocks() - 1).max_us;
+        int block = 0;
+
+        do {
+            gaze_replay_shard_t shard;
+            shard.log = log_idx;
+            shard.t0_us = t0_us;
+            shard.t1_us = m_params.shard_us > 0 ?
+                t0_us + m_params.shard_us : INT64_MAX;
+            shard.is_first = t0_us == log->block(0).min_us;
+            shard.is_last = shard.t1_us > end_us;
+            m_shards.push_back(shard);
+
+            t0_us = shard.t1_us;
+
+            // Start the next at the first block at or after the boundary
+            while (!shard.is_last && log->block(block).max_us < t0_us)
+                block++;
+            t0_us = max(t0_us, log->block(block).min_us);
+        } while (!m_shards.back().is_last);
+
+        m_logs.push_back(log);
+        m_out_paths.push_back(out_path);
+    }
+
+    m_next_commit.assign(m_logs.size(), 0);
+    m_files.assign(m_logs.size(), NULL);
+    m_is_failed.assign(m_logs.size(), false);
+    m_pending.clear();
+    m_n_samples = 0;
+    m_n_warmup = 0;
+    m_next_shard = 0;
+
+    for (int i = m_shards.size() - 1; i >= 0; i--)
+        m_next_commit[m_shards[i].log] = i;
+
+    // Replay on the pool, the calling thread being one of its workers
+    int n_threads = m_params.n_threads > 0 ?
+        m_params.n_threads : boost::thread::hardware_concurrency();
+    n_threads = max(1, min(n_threads, (int)m_shards.size()));
+
+    boost::thread_group workers;
+    for (int i = 1; i < n_threads; i++)
+        workers.create_thread(boost::bind(&GazeReplay::worker, this));
+
+    worker();
+    workers.join_all();
+
+    for (bool is_failed : m_is_failed)
+        n_failed += is_failed;
+
+    if (stats) {
+        stats->n_samples = m_n_samples;
+        stats->n_warmup = m_n_warmup;
+        stats->n_logs = m_logs.size();
+        stats->n_failed = n_failed;
+        stats->n_shards = m_shards.size();
+        stats->n_threads = n_threads;
+        stats->elapsed_us = duration_cast<microseconds>(
+            steady_clock::now() - t_start).count();
+    }
+
+    return m_n_samples;
+}
+
+// Replays shards until none remain.
+void GazeReplay::worker() {
+    g_gaze_trace.name_thread("gaze_replay");
+
+    for (int i = m_next_shard++; i < (int)m_shards.size(); i = m_next_shard++)
+        shard(i);
+}
+
+// Replays the given shard and commits its output.
+void GazeReplay::shard(int shard_idx) {
+    GazeTraceScope trace("replay_shard");
+    shared_ptr<string> out = make_shared<string>();
+
+    int64_t n_rows = replay(m_shards[shard_idx], out.get());
+    gaze_trace_counter("replay_rows", n_rows);
+    commit(shard_idx, n_rows, out);
+}
+
+// Replays the given shard, its warm-up then its span, appending its CSV rows
+// to out. Returns the number of rows.
+int64_t GazeReplay::replay(gaze_replay_shard_t const &shard, string *out) {
+    GazeLogReader *log = m_logs[shard.log].get();
+    GazeReplayPipeline pipeline(m_params, m_x_ml, m_y_ml, &m_ml_mutex);
+
+    int block, i;
+    if (!log->find(shard.t0_us - (shard.is_first ? 0 : m_params.warmup_us),
+                   &block, &i))
+        return 0;
+
+    gaze_data_t cgd;
+    char row[GAZE_REPLAY_ROW_SZ];
+    int64_t n_rows = 0;
+    int64_t n_warmup = 0;
+
+    for (; block < log->n_blocks(); block++, i = 0) {
+        int n_records = log->block(block).n_records;
+
+        for (; i < n_records; i++) {
+            log->read(block, i, &cgd);
+
+            if (cgd.unixtime_us >= shard.t1_us) {
+                m_n_warmup += n_warmup;
+                return n_rows;
+            }
+
+            pipeline.update(cgd, row);
+
+            if (cgd.unixtime_us < shard.t0_us) {
+                n_warmup++;
+            } else {
+                out->append(row);
+                n_rows++;
+            }
+        }
+    }
+
+    m_n_warmup += n_warmup;
+    return n_rows;
+}
+
+// Writes the given shard's output, of n_rows rows, and that of any of its
+// log's subsequent shards already replayed, iff its log's preceding shards
+// have been written, else holds it until they have.
+void GazeReplay::commit(int shard_idx, int64_t n_rows, shared_ptr<string> out) {
+    boost::mutex::scoped_lock lock(m_mutex);
+    int log_idx = m_shards[shard_idx].log;
+
+    m_pending[shard_idx] = make_pair(n_rows, out);
+
+    while (m_pending.count(m_next_commit[log_idx])) {
+        int idx = m_next_commit[log_idx]++;
+        gaze_replay_shard_t const &shard = m_shards[idx];
+        shared_ptr<string> rows = m_pending[idx].second;
+        n_rows = m_pending[idx].first;
+        m_pending.erase(idx);
+
+        if (shard.is_first) {
+            m_files[log_idx] = fopen(m_out_paths[log_idx].c_str(), "w");
+
+            if (!m_files[log_idx]) {
+                warn("Gaze replay failed to open an output file.\n");
+                m_is_failed[log_idx] = true;
+            }
+        }
+
+        FILE *f = m_files[log_idx];
+
+        if (f && fwrite(rows->data(), 1, rows->size(), f) == rows->size())
+            m_n_samples += n_rows;
+        else if (f)
+            m_is_failed[log_idx] = true;
+
+        if (shard.is_last && f) {
+            if (fclose(f) != 0) {
+                warn("Gaze replay failed to write an output file.\n");
+                m_is_failed[log_idx] = true;
+            }
+            m_files[log_idx] = NULL;
+        }
+
+        // The next shard idx is the next log's
+        if (shard.is_last)
+            break;
+    }
+}
@@ -0,0 +1,199 @@
+/////////////////////////////////////////////////////////////////////////////
+// The full-rate gaze sample buffer: A fixed-capacity ring of gaze sample
+// records in one contiguous allocation. Each record holds only a prefix of
+// gaze_data_t (per the ingest field mode, see GAZE_FIELDS_*), so modes
+// needing fewer fields get proportionally smaller records. Records are read
+// back as whole gaze_data_t's, w/ fields outside the prefix zeroed.
+//
+// Alternatively, records may be held packed (see gaze_pack.h), at half the
+// size of a full record. Packed records' timestamps and seqs are relative to
+// bases per run of up to GAZE_PACK_BLOCK_SZ records, a new run being started
+// early if a record doesn't fit against the current run's bases.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <deque>
+#include <vector>
+#include <cstring>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+// A run of packed records sharing timestamp and seq bases
+typedef struct gaze_ring_run {
+        int64_t first;              // Idx, of all records pushed, of its first
+        int64_t base_us;
+        uint32_t base_seq;
+	    } gaze_ring_run_t;
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class GazeRing {
+    public:
+        void push_back(gaze_data_t const&);
+        void at(int, gaze_data_t*);
+        int64_t unixtime_us_at(int);
+        uint32_t seq_at(int);
+        int size();
+        int capacity();
+        bool empty();
+        bool full();
+        size_t record_sz();
+        bool is_packed();
+
+        GazeRing(int, size_t, bool);
+
+    protected:
+        vector<uint64_t> m_words;   // Records, 8-byte aligned
+        size_t m_rec_sz;            // Bytes of gaze_data_t held per record
+        size_t m_stride;            // Words per record
+        int m_capacity;
+        int m_head;                 // Idx of the oldest record
+        int m_size;
+        bool m_is_packed;
+        int64_t m_n_pushed;         // Records ever pushed, i.e. the next's idx
+        deque<gaze_ring_run_t> m_bases;
+
+        char* record(int);
+        gaze_ring_run_t const& run_at(int);
+};
+
+// Constructor. Holds up to capacity records, of the first rec_sz bytes of
+// each gaze_data_t, else of whole gaze_data_t's packed iff is_packed (in
+// which case rec_sz must be sizeof(gaze_packed_t)).
+GazeRing::GazeRing(int capacity, size_t rec_sz, bool is_packed=false) {
+    assert(capacity > 0 && rec_sz >= sizeof(int64_t));
+    assert(rec_sz <= sizeof(gaze_data_t));
+    assert(!is_packed || rec_sz == sizeof(gaze_packed_t));
+
+    m_rec_sz = rec_sz;
+    m_is_packed = is_packed;
+    m_n_pushed = 0;
+    m_stride = (rec_sz + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    m_capacity = capacity;
+    m_head = 0;
+    m_size = 0;
+    m_words.resize(m_stride * capacity);
+}
+
+// Returns a ptr to the i'th record, counting from the oldest.
+char* GazeRing::record(int i) {
+    int slot = m_head + i;
+    if (slot >= m_capacity)
+        slot -= m_capacity;
+
+    return (char*)&m_words[slot * m_stride];
+}
+
+// Returns the run of the i'th (packed) record, counting from the oldest.
+gaze_ring_run_t const& GazeRing::run_at(int i) {
+    int64_t idx = m_n_pushed - m_size + i;
+
+    auto run = upper_bound(
+        m_bases.begin(), m_bases.end(), idx,
+        [](int64_t idx, gaze_ring_run_t const &r) { return idx < r.first; });
+
+    return *prev(run);
+}
+
+// Appends the given sample, overwriting the oldest if full.
+void GazeRing::push_back(gaze_data_t const &cgd) {
+    char *rec;
+
+    if (m_size == m_capacity) {
+        rec = record(0);
+        m_head = m_head + 1 == m_capacity ? 0 : m_head + 1;
+    } else {
+        rec = record(m_size);
+        m_size++;
+    }
+
+    if (!m_is_packed) {
+        memcpy(rec, &cgd, m_rec_sz);
+        m_n_pushed++;
+        return;
+    }
+
+    // Start a new run if the current is full or its base too distant
+    if (m_bases.empty() ||
+        m_n_pushed - m_bases.back().first >= GAZE_PACK_BLOCK_SZ ||
+        !gaze_pack_fits(cgd, m_bases.back().base_us, m_bases.back().base_seq))
+        m_bases.push_back(gaze_ring_run_t{m_n_pushed, cgd.unixtime_us, cgd.seq});
+
+    gaze_ring_run_t const &run = m_bases.back();
+    gaze_pack(cgd, run.base_us, run.base_seq, (gaze_packed_t*)rec);
+    m_n_pushed++;
+
+    // Drop runs no longer holding any records
+    while (m_bases.size() > 1 && m_bases[1].first <= m_n_pushed - m_size)
+        m_bases.pop_front();
+}
+
+// Populates cgd with the i'th sample, counting from the oldest.
+void GazeRing::at(int i, gaze_data_t *cgd) {
+    if (m_is_packed) {
+        gaze_ring_run_t const &run = run_at(i);
+        gaze_unpack(*(gaze_packed_t*)record(i), run.base_us, run.base_seq, cgd);
+        return;
+    }
+
+    memcpy(cgd, record(i), m_rec_sz);
+    memset((char*)cgd + m_rec_sz, 0, sizeof(gaze_data_t) - m_rec_sz);
+}
+
+// Returns the timestamp of the i'th sample, counting from the oldest.
+int64_t GazeRing::unixtime_us_at(int i) {
+    if (m_is_packed)
+        return run_at(i).base_us + ((gaze_packed_t*)record(i))->dt_us;
+
+    int64_t unixtime_us;
+    memcpy(&unixtime_us, record(i), sizeof(unixtime_us));
+
+    return unixtime_us;
+}
+
+// Returns the seq of the i'th sample, counting from the oldest.
+uint32_t GazeRing::seq_at(int i) {
+    if (m_is_packed)
+        return run_at(i).base_seq + ((gaze_packed_t*)record(i))->dseq;
+
+    uint32_t seq;
+    memcpy(&seq, record(i) + offsetof(gaze_data_t, seq), sizeof(seq));
+
+    return seq;
+}
+
+// Returns the number of samples held.
+int GazeRing::size() {
+    return m_size;
+}
+
+// Returns the max number of samples held.
+int GazeRing::capacity() {
+    return m_capacity;
+}
+
+// Returns true iff no samples are held.
+bool GazeRing::empty() {
+    return m_size == 0;
+}
+
+// Returns true iff the next push_back() overwrites the oldest sample.
+bool GazeRing::full() {
+    return m_size == m_capacity;
+}
+
+// Returns the bytes held per record.
+size_t GazeRing::record_sz() {
+    return m_rec_sz;
+}
+
+// Returns true iff records are held packed.
+bool GazeRing::is_packed() {
+    return m_is_packed;
+}
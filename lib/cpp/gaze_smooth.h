@@ -0,0 +1,41 @@
+/////////////////////////////////////////////////////////////////////////////
+// Gaze point smoothing, shared by the live gaze point (see
+// EyeTrackerGaze::get_gazepoint_smoothed()) and offline replay (see
+// gaze_replay.h), so both give the same results: the smoothed gaze point is
+// the mean, truncated toward zero, of the most recent samples' coords, as
+// given by gaze_smooth_coords().
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Smoothing
+
+// Populates x and y w/ the given sample's coords to smooth over. Iff models
+// are given and both eyes are valid, these are ML-corrected (the models take
+// both eyes' features), else they're the device's.
+void gaze_smooth_coords(gaze_data_t const &cgd,
+                        EyeTrackerCoordPredict *x_ml,
+                        EyeTrackerCoordPredict *y_ml,
+                        int *x,
+                        int *y) {
+    if (!x_ml || !y_ml || cgd.validity != GAZE_VALID_BOTH) {
+        *x = cgd.combined_gazepoint_x;
+        *y = cgd.combined_gazepoint_y;
+        return;
+    }
+
+    GazeTraceScope trace("predict");
+    *x = x_ml->predict((gaze_data_t*)&cgd);
+    *y = y_ml->predict((gaze_data_t*)&cgd);
+
+    GAZE_PROBE5(predict,
+                cgd.seq,
+                cgd.combined_gazepoint_x,
+                cgd.combined_gazepoint_y,
+                *x,
+                *y);
+}
@@ -0,0 +1,294 @@
+/////////////////////////////////////////////////////////////////////////////
+// A low-overhead trace recorder, for finding where the gaze pipeline's time
+// goes, e.g. when the marker stutters: in the device, the buffer mutex,
+// Python (the ML predictor) or X. Always compiled in but off by default,
+// when each trace point costs a relaxed load and a branch, inlined even in
+// unoptimized builds (as the lib's).
+//
+// When on, each thread records begin/end (GazeTraceScope) and counter
+// (gaze_trace_counter()) events to its own buffer, lock-free, holding its
+// most recent GAZE_TRACE_BUFF_SZ events. Buffers outlive their threads and
+// are reused by later threads, e.g. successive export writers, so their
+// number is bounded by the number of concurrently tracing threads.
+//
+// dump() writes all buffered events as Chrome trace JSON, viewable in
+// chrome://tracing or ui.perfetto.dev. Tracing may continue during a dump,
+// in which case events overwritten mid-dump are dropped.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <boost/thread/mutex.hpp>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define GAZE_TRACE_BUFF_SZ 65536    // Events per thread buffer, a power of 2
+#define GAZE_TRACE_BEGIN 'B'
+#define GAZE_TRACE_END 'E'
+#define GAZE_TRACE_COUNTER 'C'
+#define GAZE_TRACE_INLINE inline __attribute__((always_inline))
+
+static_assert((GAZE_TRACE_BUFF_SZ & (GAZE_TRACE_BUFF_SZ - 1)) == 0,
+              "GAZE_TRACE_BUFF_SZ must be a power of 2");
+
+typedef struct gaze_trace_event {
+        int64_t t_ns;               // Monotonic clock time
+        const char *name;           // A string literal
+        int64_t value;              // Counters only
+        int32_t tid;
+        char phase;                 // One of GAZE_TRACE_*
+	    } gaze_trace_event_t;
+
+typedef struct gaze_trace_buff {
+        gaze_trace_event_t events[GAZE_TRACE_BUFF_SZ];
+        atomic<uint64_t> head;      // Number of events ever recorded
+	    } gaze_trace_buff_t;
+
+// A thread's tracing state
+typedef struct gaze_trace_thread {
+        gaze_trace_buff_t *buff;    // Or NULL until its first event
+        int32_t tid;
+        const char *name;           // Or NULL if unnamed
+
+        ~gaze_trace_thread();
+	    } gaze_trace_thread_t;
+
+static thread_local gaze_trace_thread_t t_gaze_trace = {NULL, 0, NULL};
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class GazeTrace {
+    public:
+        void enable(bool);
+        int dump(const char*);
+        void name_thread(const char*);
+        void release(gaze_trace_buff_t*);
+
+        // Returns true iff tracing is on.
+        GAZE_TRACE_INLINE bool is_enabled() {
+            return __atomic_load_n(&m_enabled, __ATOMIC_RELAXED);
+        }
+
+        // Records an event of the given phase, name and value to the calling
+        // thread's buffer.
+        inline void record(char phase, const char *name, int64_t value) {
+            gaze_trace_thread_t *t = &t_gaze_trace;
+
+            if (!t->buff)
+                acquire(t);
+
+            gaze_trace_buff_t *buff = t->buff;
+            uint64_t head = buff->head.load(memory_order_relaxed);
+            gaze_trace_event_t *e =
+                &buff->events[head & (GAZE_TRACE_BUFF_SZ - 1)];
+
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+
+            e->t_ns = ts.tv_sec * 1000000000L + ts.tv_nsec;
+            e->name = name;
+            e->value = value;
+            e->tid = t->tid;
+            e->phase = phase;
+
+            buff->head.store(head + 1, memory_order_release);
+        }
+
+        GazeTrace();
+
+    protected:
+        bool m_enabled;                         // Accessed atomically
+        vector<gaze_trace_buff_t*> m_buffs;    // Live for the process
+        vector<gaze_trace_buff_t*> m_free;  // Buffers of exited threads
+        map<int32_t, const char*> m_thread_names;
+        boost::mutex m_mutex;
+
+        void acquire(gaze_trace_thread_t*);
+};
+
+static GazeTrace g_gaze_trace;
+
+// Records the begin and end events of a span, from construction to
+// destruction, iff tracing is on at construction.
+class GazeTraceScope {
+    public:
+        GAZE_TRACE_INLINE GazeTraceScope(const char *name) {
+            m_name = NULL;
+
+            if (g_gaze_trace.is_enabled()) {
+                m_name = name;
+                g_gaze_trace.record(GAZE_TRACE_BEGIN, m_name, 0);
+            }
+        }
+
+        GAZE_TRACE_INLINE ~GazeTraceScope() {
+            if (m_name)
+                g_gaze_trace.record(GAZE_TRACE_END, m_name, 0);
+        }
+
+    protected:
+        const char *m_name;
+};
+
+// Records the given counter's value, iff tracing is on.
+GAZE_TRACE_INLINE void gaze_trace_counter(const char *name, int64_t value) {
+    if (g_gaze_trace.is_enabled())
+        g_gaze_trace.record(GAZE_TRACE_COUNTER, name, value);
+}
+
+// Default constructor
+GazeTrace::GazeTrace() {
+    m_enabled = False;
+}
+
+// Returns the thread's buffer, if any, for reuse on its exit.
+gaze_trace_thread::~gaze_trace_thread() {
+    if (buff)
+        g_gaze_trace.release(buff);
+}
+
+// Turns tracing on or off. Buffered events are kept either way.
+void GazeTrace::enable(bool enabled) {
+    __atomic_store_n(&m_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+// Names the calling thread in the trace, e.g. "gaze_stream". The given name
+// must be a string literal.
+void GazeTrace::name_thread(const char *name) {
+    gaze_trace_thread_t *t = &t_gaze_trace;
+    t->name = name;
+
+    if (t->buff) {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_thread_names[t->tid] = name;
+    }
+}
+
+// Assigns the given thread a buffer, reusing that of an exited thread if
+// any, on its first event.
+void GazeTrace::acquire(gaze_trace_thread_t *t) {
+    boost::mutex::scoped_lock lock(m_mutex);
+
+    if (!m_free.empty()) {
+        t->buff = m_free.back();
+        m_free.pop_back();
+    } else {
+        t->buff = new gaze_trace_buff_t();
+        t->buff->head = 0;
+        m_buffs.push_back(t->buff);
+    }
+
+    t->tid = syscall(SYS_gettid);
+
+    if (t->name)
+        m_thread_names[t->tid] = t->name;
+}
+
+// Denotes the given buffer's thread has exited, its events being kept.
+void GazeTrace::release(gaze_trace_buff_t *buff) {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_free.push_back(buff);
+}
+
+// Writes all buffered events, oldest first per buffer, to the given path as
+// Chrome trace JSON, overwriting it if exists. Returns the number of events
+// written, or -1 on failure.
+int GazeTrace::dump(const char *path) {
+    vector<gaze_trace_event_t> events;
+    map<int32_t, const char*> thread_names;
+
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        thread_names = m_thread_names;
+
+        for (gaze_trace_buff_t *buff : m_buffs) {
+            uint64_t head = buff->head.load(memory_order_acquire);
+            uint64_t from = head - min(head, (uint64_t)GAZE_TRACE_BUFF_SZ);
+            size_t n_prev = events.size();
+
+            for (uint64_t i = from; i < head; i++)
+                events.push_back(buff->events[i & (GAZE_TRACE_BUFF_SZ - 1)]);
+
+            // Drop any events overwritten while copying, including any being
+            // recorded as head_after was read
+            uint64_t head_after = buff->head.load(memory_order_acquire);
+            uint64_t n_overwritten = 0;
+
+            if (head_after + 1 > from + GAZE_TRACE_BUFF_SZ)
+                n_overwritten = min(
+                    head - from, head_after + 1 - from - GAZE_TRACE_BUFF_SZ);
+
+            events.erase(events.begin() + n_prev,
+                         events.begin() + n_prev + n_overwritten);
+        }
+    }
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        warn("Failed to open trace file for writing.\n");
+        return -1;
+    }
+
+    int pid = getpid();
+    int n_written = 0;
+    map<int32_t, int> depths;   // Open spans, per thread
+
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+    for (auto const &name : thread_names) {
+        fprintf(f,
+                "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, "
+                "\"tid\": %d, \"args\": {\"name\": \"%s\"}},\n",
+                pid, name.first, name.second);
+    }
+
+    // Process name, also ending the metadata w/o a trailing comma
+    fprintf(f,
+            "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, "
+            "\"args\": {\"name\": \"aeye_typer\"}}",
+            pid);
+
+    for (gaze_trace_event_t const &e : events) {
+        // Skip ends whose begins were overwritten
+        if (e.phase == GAZE_TRACE_BEGIN) {
+            depths[e.tid]++;
+        } else if (e.phase == GAZE_TRACE_END) {
+            if (!depths[e.tid])
+                continue;
+            depths[e.tid]--;
+        }
+
+        fprintf(f,
+                ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, "
+                "\"pid\": %d, \"tid\": %d",
+                e.name, e.phase, e.t_ns / 1000.0, pid, e.tid);
+
+        if (e.phase == GAZE_TRACE_COUNTER)
+            fprintf(f, ", \"args\": {\"value\": %ld}", (long)e.value);
+
+        fprintf(f, "}");
+        n_written++;
+    }
+
+    fprintf(f, "\n]}\n");
+
+    if (fclose(f)) {
+        warn("Failed to write trace file.\n");
+        return -1;
+    }
+
+    return n_written;
+}
@@ -0,0 +1,214 @@
+/////////////////////////////////////////////////////////////////////////////
+// A compiled hit-test index over the HUD's on-screen keyboard layout. The
+// layout json (see HUD_KEYB_JSON) is loaded once and rasterized, together
+// with the HUD window geometry, into a flat uniform grid of key indexes so
+// that mapping a gaze point to the key under it is O(1).
+//
+// Key indexes are the 0-based position of each button in the layout json,
+// in row-major order and including spacers (i.e. the same order as
+// HUDKeyboardPanel._panel_btns). Spacers and gaps map to HUD_KEY_NONE.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define HUD_KEY_NONE -1
+#define HUD_KEYMAP_CELL_PX 4
+#define HUD_KEYMAP_SPACER_TEXT "_spacer_"
+
+// Returns the HUD's on-screen origin along one axis, given the display and
+// HUD sizes along it and the axis' HUD coord divisor. Matches hud.py's
+// (disp / div) - (hud / div), i.e. float division, truncated by its '%d'.
+static int hud_origin(int disp_px, int hud_px, int div) {
+    return (int)((double)disp_px / div - (double)hud_px / div);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class HUDKeyMap {
+    public:
+        bool load(const char*, int, int, int, int, int, int);
+        int key_at(int, int);
+        bool key_rect(int, hud_key_t*);
+        int key_count();
+
+        HUDKeyMap();
+
+    protected:
+        int m_origin_x;
+        int m_origin_y;
+        int m_width;
+        int m_height;
+        int m_grid_cols;
+        int m_grid_rows;
+        vector<int16_t> m_grid;
+        vector<hud_key_t> m_keys;
+};
+
+// Default constructor. The map is empty (all lookups miss) until load().
+HUDKeyMap::HUDKeyMap() {
+    m_origin_x = 0;
+    m_origin_y = 0;
+    m_width = 0;
+    m_height = 0;
+    m_grid_cols = 0;
+    m_grid_rows = 0;
+}
+
+// Loads the keyboard layout at json_path and compiles the hit-test grid.
+// The HUD's on-screen position is derived from the display and HUD sizes
+// and the HUD coord divisors, as hud.py computes its window position (see
+// hud_origin()).
+// Key widths are proportional to their layout width units, with the widest
+// row spanning the full HUD width, and each layout row gets an equal share
+// of the HUD height. Returns false (leaving the map unchanged) on failure.
+bool HUDKeyMap::load(const char *json_path,
+                     int disp_width_px,
+                     int disp_height_px,
+                     int hud_width_px,
+                     int hud_height_px,
+                     int hud_div_x,
+                     int hud_div_y) {
+    boost::property_tree::ptree layout;
+
+    try {
+        boost::property_tree::read_json(json_path, layout);
+    } catch (boost::property_tree::json_parser_error&) {
+        error("Keymap load failed - Could not parse the layout json.\n");
+        return false;
+    }
+
+    if (layout.empty() || hud_width_px <= 0 || hud_height_px <= 0 ||
+        hud_div_x <= 0 || hud_div_y <= 0) {
+        error("Keymap load failed - Empty layout or invalid HUD geometry.\n");
+        return false;
+    }
+
+    // Find the widest row, in layout width units
+    int max_row_units = 0;
+    for (auto &row : layout) {
+        int row_units = 0;
+        for (auto &btn : row.second)
+            row_units += btn.second.get<int>("width", 1);
+        max_row_units = max(max_row_units, row_units);
+    }
+
+    if (max_row_units <= 0) {
+        error("Keymap load failed - Layout has no key widths.\n");
+        return false;
+    }
+
+    // Lay out each key's on-screen rect, relative to the HUD's origin
+    int n_rows = layout.size();
+    float px_per_unit = (float)hud_width_px / max_row_units;
+    vector<hud_key_t> keys;
+    vector<bool> is_spacer;
+
+    int i = 0;
+    for (auto &row : layout) {
+        int y0 = (i * hud_height_px) / n_rows;
+        int y1 = ((i + 1) * hud_height_px) / n_rows;
+        int units = 0;
+
+        for (auto &btn : row.second) {
+            int width = btn.second.get<int>("width", 1);
+            hud_key_t key;
+
+            key.x = units * px_per_unit;
+            key.y = y0;
+            key.width = (int)((units + width) * px_per_unit) - key.x;
+            key.height = y1 - y0;
+            keys.push_back(key);
+            is_spacer.push_back(
+                btn.second.get<string>("text", "") == HUD_KEYMAP_SPACER_TEXT);
+
+            units += width;
+        }
+        i++;
+    }
+
+    // Rasterize the keys into the grid, by the key under each cell's center
+    int cols = (hud_width_px + HUD_KEYMAP_CELL_PX - 1) / HUD_KEYMAP_CELL_PX;
+    int rows = (hud_height_px + HUD_KEYMAP_CELL_PX - 1) / HUD_KEYMAP_CELL_PX;
+    vector<int16_t> grid(cols * rows, HUD_KEY_NONE);
+
+    for (int k = 0; k < (int)keys.size(); k++) {
+        if (is_spacer[k])
+            continue;
+
+        hud_key_t *key = &keys[k];
+        int c0 = key->x / HUD_KEYMAP_CELL_PX;
+        int c1 = (key->x + key->width - 1) / HUD_KEYMAP_CELL_PX;
+        int r0 = key->y / HUD_KEYMAP_CELL_PX;
+        int r1 = (key->y + key->height - 1) / HUD_KEYMAP_CELL_PX;
+
+        for (int r = r0; r <= r1 && r < rows; r++) {
+            int cy = r * HUD_KEYMAP_CELL_PX + HUD_KEYMAP_CELL_PX / 2;
+            if (cy < key->y || cy >= key->y + key->height)
+                continue;
+
+            for (int c = c0; c <= c1 && c < cols; c++) {
+                int cx = c * HUD_KEYMAP_CELL_PX + HUD_KEYMAP_CELL_PX / 2;
+                if (cx >= key->x && cx < key->x + key->width)
+                    grid[r * cols + c] = k;
+            }
+        }
+    }
+
+    // Convert key rects to display coords and commit the new map
+    m_origin_x = hud_origin(disp_width_px, hud_width_px, hud_div_x);
+    m_origin_y = hud_origin(disp_height_px, hud_height_px, hud_div_y);
+    m_width = hud_width_px;
+    m_height = hud_height_px;
+
+    for (auto &key : keys) {
+        key.x += m_origin_x;
+        key.y += m_origin_y;
+    }
+
+    m_grid_cols = cols;
+    m_grid_rows = rows;
+    m_grid.swap(grid);
+    m_keys.swap(keys);
+
+    return true;
+}
+
+// Returns the index of the key at the given display coords, or HUD_KEY_NONE.
+int HUDKeyMap::key_at(int x, int y) {
+    // Unsigned compare rejects both negative and too-large offsets at once
+    unsigned int dx = x - m_origin_x;
+    unsigned int dy = y - m_origin_y;
+
+    if (dx >= (unsigned int)m_width || dy >= (unsigned int)m_height)
+        return HUD_KEY_NONE;
+
+    return m_grid[
+        (dy / HUD_KEYMAP_CELL_PX) * m_grid_cols + dx / HUD_KEYMAP_CELL_PX];
+}
+
+// Populates rect with the display coords of the given key. Returns false if
+// no such key exists.
+bool HUDKeyMap::key_rect(int key, hud_key_t *rect) {
+    if (key < 0 || key >= (int)m_keys.size())
+        return false;
+
+    *rect = m_keys[key];
+    return true;
+}
+
+// Returns the number of keys (including spacers) in the loaded layout.
+int HUDKeyMap::key_count() {
+    return m_keys.size();
+}
@@ -0,0 +1,124 @@
+/////////////////////////////////////////////////////////////////////////////
+// Tests the HUD keymap's placement of the HUD on the display against
+// hud.py's, for odd display and HUD sizes (where integer and float division
+// disagree), and its hit-testing at the HUD's edges. Expected origins are
+// as hud.py computes them, i.e. '%d' % ((disp / div) - (hud / div)).
+// Exits non-zero on any failure.
+//
+// Build and run with lib/sh/test_hud_keymap.sh
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "app.h"
+#include "eyetracker_structdef.h"
+#include "hud_keymap.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define TEST_LAYOUT_JSON \
+    "[[{\"text\": \"a\"}, {\"text\": \"b\", \"width\": 2}]," \
+    " [{\"text\": \"_spacer_\"}, {\"text\": \"c\", \"width\": 2}]]"
+
+typedef struct test_geom {
+        int disp_width_px;
+        int disp_height_px;
+        int hud_width_px;
+        int hud_height_px;
+        int hud_div_x;
+        int hud_div_y;
+        int origin_x;               // As hud.py places the HUD
+        int origin_y;
+	    } test_geom_t;
+
+static int g_n_failed = 0;
+
+// Denotes a failure iff the given condition is false.
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool is_ok, const char *expr, int line) {
+    if (!is_ok) {
+        printf("FAIL (line %d): %s\n", line, expr);
+        g_n_failed++;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Tests
+
+// The HUD's origin matches hud.py's, key_at() hits its first key at that
+// origin but not a pixel before it and misses just past the HUD.
+static void test_origin(const char *json_path, test_geom_t const &g) {
+    HUDKeyMap keymap;
+    hud_key_t rect;
+
+    CHECK(keymap.load(json_path,
+                      g.disp_width_px,
+                      g.disp_height_px,
+                      g.hud_width_px,
+                      g.hud_height_px,
+                      g.hud_div_x,
+                      g.hud_div_y));
+    CHECK(keymap.key_count() == 4);
+    CHECK(keymap.key_rect(0, &rect));
+
+    if (rect.x != g.origin_x || rect.y != g.origin_y)
+        printf("  disp %dx%d, hud %dx%d, div %d/%d: origin %d,%d != %d,%d\n",
+               g.disp_width_px, g.disp_height_px,
+               g.hud_width_px, g.hud_height_px,
+               g.hud_div_x, g.hud_div_y,
+               rect.x, rect.y, g.origin_x, g.origin_y);
+    CHECK(rect.x == g.origin_x);
+    CHECK(rect.y == g.origin_y);
+
+    CHECK(keymap.key_at(g.origin_x, g.origin_y) == 0);
+    CHECK(keymap.key_at(g.origin_x - 1, g.origin_y) == HUD_KEY_NONE);
+    CHECK(keymap.key_at(g.origin_x, g.origin_y - 1) == HUD_KEY_NONE);
+    CHECK(keymap.key_rect(3, &rect));
+    CHECK(keymap.key_at(rect.x + rect.width / 2,
+                        rect.y + rect.height / 2) == 3);
+    CHECK(keymap.key_at(g.origin_x + g.hud_width_px,
+                        g.origin_y) == HUD_KEY_NONE);
+    CHECK(keymap.key_at(g.origin_x,
+                        g.origin_y + g.hud_height_px - 1) == HUD_KEY_NONE);
+}
+
+int main() {
+    char json_path[] = "/tmp/hud_keymap_test_XXXXXX";
+    int fd = mkstemp(json_path);
+    FILE *f = fd >= 0 ? fdopen(fd, "w") : NULL;
+
+    if (!f) {
+        error("Could not create the test layout json.\n");
+        return 1;
+    }
+    fputs(TEST_LAYOUT_JSON, f);
+    fclose(f);
+
+    // disp w, h, hud w, h, div x, y, origin x, y
+    test_geom_t geoms[] = {
+        {1920, 1080, 1745, 253, 2, 1, 87, 827},     // _config.yaml's
+        {1920, 1080, 1001, 301, 2, 2, 459, 389},
+        {1921, 1081, 1000, 300, 2, 2, 460, 390},
+        {1366, 768, 767, 255, 3, 3, 199, 171},
+        {1080, 1080, 1081, 300, 2, 1, 0, 780},      // Wider than the disp
+        {1920, 1080, 1920, 1080, 1, 1, 0, 0},
+    };
+
+    for (auto &g : geoms)
+        test_origin(json_path, g);
+
+    unlink(json_path);
+    printf("%s\n", g_n_failed ? "FAILED" : "OK");
+
+    return g_n_failed ? 1 : 0;
+}
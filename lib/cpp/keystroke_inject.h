@@ -0,0 +1,328 @@
+/////////////////////////////////////////////////////////////////////////////
+// Batched keystroke injection via the XTest extension. A whole UTF-8 string
+// (or a single keysym) is injected as one batch of fake key events on a
+// dedicated X connection, with a single XFlush. Keysym to keycode lookups
+// are cached, and keysyms with no keycode on the current keyboard layout
+// are typed by temporarily binding them to spare keycodes. Each such keysym
+// gets its own spare keycode for the batch, so no key event is queued
+// against a binding that's changed before it's processed, and the spares'
+// original bindings are restored after the batch.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+
+using namespace std;
+using namespace std::chrono;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define KEYSYM_UNICODE_OFFSET 0x01000000
+#define KEYSTROKE_MAX_SPARES 16     // Spare keycodes used, at most
+
+typedef struct key_stroke {
+        KeyCode keycode;
+        bool shift;
+	    } key_stroke_t;
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class KeystrokeInject {
+    public:
+        int64_t inject_text(const char*, unsigned int);
+        int64_t inject_keysym(KeySym, unsigned int);
+
+        KeystrokeInject();
+        ~KeystrokeInject();
+
+    protected:
+        Display *m_disp;
+        vector<KeyCode> m_spare_keycodes;
+        unordered_map<KeySym, KeyCode> m_spare_bound;   // In this batch
+        unordered_map<KeyCode, vector<KeySym>> m_spare_orig;
+        unordered_map<KeySym, key_stroke_t> m_keycodes;
+        boost::mutex m_mutex;
+
+        bool keystroke_from_keysym(KeySym, key_stroke_t*);
+        void press_modifiers(unsigned int, bool);
+        void press_keysym(KeySym, unsigned int);
+        KeyCode bind_spare_keycode(KeySym);
+        void restore_spare_keycodes();
+
+    private:
+        bool is_spare_keycode(KeyCode);
+        void find_spare_keycodes();
+};
+
+// Default constructor
+KeystrokeInject::KeystrokeInject() {
+    int event_base, error_base, major, minor;
+
+    // Keep a dedicated connection, since Xlib conns aren't thread safe
+    m_disp = XOpenDisplay(NULL);
+
+    if (m_disp && !XTestQueryExtension(
+            m_disp, &event_base, &error_base, &major, &minor)) {
+        warn("XTest unavailable. Native keystroke injection disabled.\n");
+        XCloseDisplay(m_disp);
+        m_disp = NULL;
+    }
+
+    if (m_disp)
+        find_spare_keycodes();
+}
+
+// Destructor
+KeystrokeInject::~KeystrokeInject() {
+    if (m_disp)
+        XCloseDisplay(m_disp);
+}
+
+// Injects the given UTF-8 string as keystrokes, with the given modifiers
+// (an X11 modifier mask, e.g. ShiftMask | ControlMask) held throughout.
+// Returns the injection latency in microseconds, or -1 on failure. Invalid
+// UTF-8 sequences are skipped.
+int64_t KeystrokeInject::inject_text(const char *utf8, unsigned int modifiers) {
+    if (!m_disp || !utf8)
+        return -1;
+
+    auto t_start = steady_clock::now();
+    const unsigned char *c = (const unsigned char*)utf8;
+
+    boost::mutex::scoped_lock lock(m_mutex);
+    press_modifiers(modifiers, True);
+
+    while (*c) {
+        // Decode the next code point
+        uint32_t cp;
+        int n_cont;
+
+        if (*c < 0x80)                { cp = *c;        n_cont = 0; }
+        else if ((*c & 0xE0) == 0xC0) { cp = *c & 0x1F; n_cont = 1; }
+        else if ((*c & 0xF0) == 0xE0) { cp = *c & 0x0F; n_cont = 2; }
+        else if ((*c & 0xF8) == 0xF0) { cp = *c & 0x07; n_cont = 3; }
+        else { c++; continue; }
+
+        c++;
+        for (; n_cont > 0 && (*c & 0xC0) == 0x80; n_cont--, c++)
+            cp = (cp << 6) | (*c & 0x3F);
+
+        if (n_cont > 0)
+            continue;  // Truncated sequence
+
+        // Convert the code point to its keysym
+        KeySym keysym;
+        if (cp == '\n')
+            keysym = XK_Return;
+        else if (cp == '\t')
+            keysym = XK_Tab;
+        else if (cp == '\b')
+            keysym = XK_BackSpace;
+        else if ((cp >= 0x20 && cp < 0x7F) || (cp >= 0xA0 && cp <= 0xFF))
+            keysym = cp;  // Latin-1 keysyms equal their code points
+        else
+            keysym = KEYSYM_UNICODE_OFFSET | cp;
+
+        press_keysym(keysym, modifiers);
+    }
+
+    press_modifiers(modifiers, False);
+    restore_spare_keycodes();
+    XFlush(m_disp);
+
+    return duration_cast<microseconds>(steady_clock::now() - t_start).count();
+}
+
+// Injects a single press/release of the given keysym, with the given
+// modifiers held. Returns the injection latency in microseconds, or -1.
+int64_t KeystrokeInject::inject_keysym(KeySym keysym, unsigned int modifiers) {
+    if (!m_disp)
+        return -1;
+
+    auto t_start = steady_clock::now();
+
+    boost::mutex::scoped_lock lock(m_mutex);
+    press_modifiers(modifiers, True);
+    press_keysym(keysym, modifiers);
+    press_modifiers(modifiers, False);
+    restore_spare_keycodes();
+    XFlush(m_disp);
+
+    return duration_cast<microseconds>(steady_clock::now() - t_start).count();
+}
+
+// Populates ks with the keycode (and whether shift is required) for the given
+// keysym, consulting the cache first. Returns false if the keysym has no
+// keycode on the current layout.
+bool KeystrokeInject::keystroke_from_keysym(KeySym keysym, key_stroke_t *ks) {
+    auto cached = m_keycodes.find(keysym);
+    if (cached != m_keycodes.end()) {
+        *ks = cached->second;
+        return True;
+    }
+
+    // Note spare keycodes' bindings are transient, so are never cached
+    KeyCode keycode = XKeysymToKeycode(m_disp, keysym);
+    if (keycode == 0 || is_spare_keycode(keycode))
+        return False;
+
+    ks->keycode = keycode;
+    ks->shift = XkbKeycodeToKeysym(m_disp, keycode, 0, 0) != keysym &&
+                XkbKeycodeToKeysym(m_disp, keycode, 0, 1) == keysym;
+    m_keycodes[keysym] = *ks;
+
+    return True;
+}
+
+// Presses (or releases) the modifier keys denoted by the given modifier mask.
+void KeystrokeInject::press_modifiers(unsigned int modifiers, bool is_press) {
+    static const KeySym mod_keysyms[][2] = {
+        {ShiftMask, XK_Shift_L},
+        {ControlMask, XK_Control_L},
+        {Mod1Mask, XK_Alt_L},
+        {Mod4Mask, XK_Super_L}};
+
+    for (auto &mod : mod_keysyms) {
+        if (!(modifiers & mod[0]))
+            continue;
+
+        key_stroke_t ks;
+        if (keystroke_from_keysym(mod[1], &ks))
+            XTestFakeKeyEvent(m_disp, ks.keycode, is_press, CurrentTime);
+    }
+}
+
+// Queues a press and release of the given keysym, adding shift iff the keysym
+// requires it and it isn't already held by the given modifiers.
+void KeystrokeInject::press_keysym(KeySym keysym, unsigned int modifiers) {
+    key_stroke_t ks;
+
+    // If no keycode, temporarily bind the keysym to a spare keycode
+    if (!keystroke_from_keysym(keysym, &ks)) {
+        ks.keycode = bind_spare_keycode(keysym);
+        ks.shift = False;
+
+        if (!ks.keycode)
+            return;
+    }
+
+    bool add_shift = ks.shift && !(modifiers & ShiftMask);
+    if (add_shift)
+        press_modifiers(ShiftMask, True);
+
+    XTestFakeKeyEvent(m_disp, ks.keycode, True, CurrentTime);
+    XTestFakeKeyEvent(m_disp, ks.keycode, False, CurrentTime);
+
+    if (add_shift)
+        press_modifiers(ShiftMask, False);
+}
+
+// Returns the spare keycode the given keysym is bound to for this batch,
+// binding it to the next unused one (saving that one's original binding)
+// if not yet bound. If all are in use, first syncs so the key events queued
+// against them are processed, then reuses them. Returns 0 if there are no
+// spare keycodes.
+KeyCode KeystrokeInject::bind_spare_keycode(KeySym keysym) {
+    auto bound = m_spare_bound.find(keysym);
+    if (bound != m_spare_bound.end())
+        return bound->second;
+
+    if (m_spare_keycodes.empty())
+        return 0;
+
+    if (m_spare_bound.size() == m_spare_keycodes.size()) {
+        XSync(m_disp, False);
+        m_spare_bound.clear();
+    }
+
+    KeyCode keycode = m_spare_keycodes[m_spare_bound.size()];
+
+    if (!m_spare_orig.count(keycode)) {
+        int keysyms_per_keycode;
+        KeySym *orig = XGetKeyboardMapping(
+            m_disp, keycode, 1, &keysyms_per_keycode);
+
+        m_spare_orig[keycode] = orig ?
+            vector<KeySym>(orig, orig + keysyms_per_keycode) :
+            vector<KeySym>(2, NoSymbol);
+        if (orig)
+            XFree(orig);
+    }
+
+    // Sync so the mapping change is in effect before the keystroke is
+    // processed
+    KeySym keysyms[] = {keysym, keysym};
+    XChangeKeyboardMapping(m_disp, keycode, 2, keysyms, 1);
+    XSync(m_disp, False);
+    m_spare_bound[keysym] = keycode;
+
+    return keycode;
+}
+
+// Restores the original bindings of any spare keycodes bound in this batch,
+// after syncing so the key events queued against them are processed first.
+void KeystrokeInject::restore_spare_keycodes() {
+    if (m_spare_orig.empty())
+        return;
+
+    XSync(m_disp, False);
+
+    for (auto &orig : m_spare_orig)
+        XChangeKeyboardMapping(m_disp,
+                               orig.first,
+                               orig.second.size(),
+                               orig.second.data(),
+                               1);
+
+    m_spare_bound.clear();
+    m_spare_orig.clear();
+}
+
+// Returns true iff the given keycode is one of the spare keycodes.
+bool KeystrokeInject::is_spare_keycode(KeyCode keycode) {
+    for (auto spare : m_spare_keycodes)
+        if (spare == keycode)
+            return True;
+
+    return False;
+}
+
+// Finds up to KEYSTROKE_MAX_SPARES keycodes having no keysyms bound to them.
+void KeystrokeInject::find_spare_keycodes() {
+    int min_keycode, max_keycode, keysyms_per_keycode;
+
+    XDisplayKeycodes(m_disp, &min_keycode, &max_keycode);
+    KeySym *keysyms = XGetKeyboardMapping(m_disp,
+                                          min_keycode,
+                                          max_keycode - min_keycode + 1,
+                                          &keysyms_per_keycode);
+
+    // Search from the top, where unused keycodes typically are
+    for (int k = max_keycode;
+         k >= min_keycode && m_spare_keycodes.size() < KEYSTROKE_MAX_SPARES;
+         k--) {
+        bool is_empty = True;
+        int row = (k - min_keycode) * keysyms_per_keycode;
+
+        for (int j = 0; j < keysyms_per_keycode && is_empty; j++)
+            is_empty = keysyms[row + j] == NoSymbol;
+
+        if (is_empty)
+            m_spare_keycodes.push_back(k);
+    }
+
+    XFree(keysyms);
+}
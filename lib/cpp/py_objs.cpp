@@ -79,8 +79,10 @@ EyeTrackerCoordPredict::~EyeTrackerCoordPredict() {
 
 long int EyeTrackerCoordPredict::predict(gaze_data *gaze_data) {
         // Acquire gill lock iff needed
-        if (!PyGILState_Check())
+        if (!PyGILState_Check()) {
+            GazeTraceScope trace("predict_gil");
             m_py_gilstate = PyGILState_Ensure();
+        }
 
         // Call python obj's predict method
         PyObject *p_result = PyObject_CallMethod(
@@ -0,0 +1,193 @@
+/////////////////////////////////////////////////////////////////////////////
+// A small executor for running initialization stages concurrently. Each
+// stage is a function plus the stages it depends on; run() executes every
+// stage on a pool of threads as soon as its dependencies have completed,
+// and blocks until all stages are done. Stages may be pinned to the thread
+// calling run(), e.g. those calling into Python, which the pool's threads
+// are unknown to. The start time, duration and thread of each stage are
+// recorded as a timeline, for startup profiling.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#include <boost/thread.hpp>
+
+using namespace std;
+using namespace std::chrono;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define STARTUP_MAX_WORKERS 4
+
+typedef struct startup_task {
+        function<void()> fn;
+        vector<int> dependents;     // Idxs of stages depending on this one
+        int n_pending;              // Dependencies not yet completed
+        bool is_on_caller;          // Pinned to the thread calling run()?
+        startup_stage_t stage;
+	    } startup_task_t;
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class StartupExecutor {
+    public:
+        int add(const char*, function<void()>, vector<int> = {});
+        int add_on_caller(const char*, function<void()>, vector<int> = {});
+        void run();
+        int timeline(startup_stage_t*, int);
+        int64_t elapsed_us();
+
+        StartupExecutor();
+
+    protected:
+        vector<startup_task_t> m_tasks;
+        deque<int> m_ready;
+        int m_n_done;
+        int64_t m_elapsed_us;
+        steady_clock::time_point m_t_start;
+        boost::mutex m_mutex;
+        boost::condition_variable m_cond;
+
+        void worker(int);
+        int next_ready(int);
+        int64_t since_start_us();
+};
+
+// Default constructor
+StartupExecutor::StartupExecutor() {
+    m_n_done = 0;
+    m_elapsed_us = 0;
+}
+
+// Adds a stage of the given name, running fn after the given stages (as
+// idxs returned by previous calls) have completed. Returns the stage's idx.
+int StartupExecutor::add(const char *name,
+                         function<void()> fn,
+                         vector<int> deps) {
+    int idx = m_tasks.size();
+    startup_task_t task;
+
+    task.fn = fn;
+    task.n_pending = deps.size();
+    task.is_on_caller = false;
+    memset(&task.stage, 0, sizeof(task.stage));
+    strncpy(task.stage.name, name, sizeof(task.stage.name) - 1);
+    task.stage.worker = -1;
+    m_tasks.push_back(task);
+
+    for (int dep : deps) {
+        assert(dep >= 0 && dep < idx);
+        m_tasks[dep].dependents.push_back(idx);
+    }
+
+    return idx;
+}
+
+// As add(), but the stage is run on the thread calling run().
+int StartupExecutor::add_on_caller(const char *name,
+                                   function<void()> fn,
+                                   vector<int> deps) {
+    int idx = add(name, fn, deps);
+    m_tasks[idx].is_on_caller = true;
+
+    return idx;
+}
+
+// Runs all stages, respecting dependencies, and blocks until done.
+void StartupExecutor::run() {
+    int n_workers = min((int)m_tasks.size(), STARTUP_MAX_WORKERS);
+
+    m_t_start = steady_clock::now();
+    m_n_done = 0;
+
+    for (int i = 0; i < (int)m_tasks.size(); i++)
+        if (m_tasks[i].n_pending == 0)
+            m_ready.push_back(i);
+
+    boost::thread_group workers;
+    for (int i = 1; i < n_workers; i++)
+        workers.create_thread(boost::bind(&StartupExecutor::worker, this, i));
+
+    worker(0);  // The calling thread is worker 0
+    workers.join_all();
+
+    m_elapsed_us = since_start_us();
+}
+
+// Returns the time since run() began, in microseconds.
+int64_t StartupExecutor::since_start_us() {
+    return duration_cast<microseconds>(steady_clock::now() - m_t_start).count();
+}
+
+// Returns the position in m_ready of the next stage the given worker may
+// run, preferring those pinned to it iff it's the calling thread, or -1.
+int StartupExecutor::next_ready(int worker_idx) {
+    int next = -1;
+
+    for (int i = 0; i < (int)m_ready.size(); i++) {
+        bool is_on_caller = m_tasks[m_ready[i]].is_on_caller;
+
+        if (is_on_caller && worker_idx == 0)
+            return i;
+        if (!is_on_caller && next < 0)
+            next = i;
+    }
+
+    return next;
+}
+
+// Runs ready stages until all stages are done.
+void StartupExecutor::worker(int worker_idx) {
+    boost::mutex::scoped_lock lock(m_mutex);
+
+    while (m_n_done < (int)m_tasks.size()) {
+        int next = next_ready(worker_idx);
+
+        if (next < 0) {
+            m_cond.wait(lock);
+            continue;
+        }
+
+        startup_task_t *task = &m_tasks[m_ready[next]];
+        m_ready.erase(m_ready.begin() + next);
+
+        lock.unlock();
+        int64_t start_us = since_start_us();
+        task->fn();
+        int64_t end_us = since_start_us();
+        lock.lock();
+
+        task->stage.start_us = start_us;
+        task->stage.duration_us = end_us - start_us;
+        task->stage.worker = worker_idx;
+        m_n_done++;
+
+        for (int dependent : task->dependents)
+            if (--m_tasks[dependent].n_pending == 0)
+                m_ready.push_back(dependent);
+
+        m_cond.notify_all();
+    }
+}
+
+// Copies to out (at most) n stages' timings, in the order stages were added.
+// Returns the total number of stages.
+int StartupExecutor::timeline(startup_stage_t *out, int n) {
+    for (int i = 0; i < min(n, (int)m_tasks.size()); i++)
+        out[i] = m_tasks[i].stage;
+
+    return m_tasks.size();
+}
+
+// Returns the wall time, in microseconds, of the last run().
+int64_t StartupExecutor::elapsed_us() {
+    return m_elapsed_us;
+}
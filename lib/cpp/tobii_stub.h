@@ -0,0 +1,330 @@
+/////////////////////////////////////////////////////////////////////////////
+// A stub of the (subset of the) Tobii stream engine used by EyeTracker and
+// the gaze stream loop, for exercising them w/o a device. A single stub
+// device is enumerated, opens (elevated iff a license is given) and has no
+// calibration. It produces synthetic binocular gaze samples at a fixed rate,
+// fixating a new point every TOBII_STUB_FIXATION_N samples, and may be made
+// to drop its connection for a given duration, as if its USB link dropped. While down, its calls fail w/ TOBII_ERROR_CONNECTION_FAILED,
+// subscriptions are lost, and reconnects fail until the link is back up.
+//
+// For use in place of (i.e. not linked with) libtobii_stream_engine.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstring>
+
+#include <boost/thread.hpp>
+
+#include <tobii/tobii.h>
+#include <tobii/tobii_config.h>
+#include <tobii/tobii_licensing.h>
+#include <tobii/tobii_advanced.h>
+
+using namespace std;
+using namespace std::chrono;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define TOBII_STUB_SAMPLE_US 11111      // 90 Hz
+#define TOBII_STUB_FIXATION_N 27        // ~300 ms
+#define TOBII_STUB_WAIT_MAX_US 100000
+#define TOBII_STUB_URL "tobii-stub://0"
+
+typedef struct tobii_stub {
+        boost::mutex mutex;
+        bool is_connected;
+        bool is_subscribed;
+        tobii_gaze_data_callback_t callback;
+        void *user_data;
+        int64_t next_sample_us;
+        int64_t link_up_us;             // When a dropped link comes back up
+        int64_t n_samples;
+        int64_t n_reconnects;
+	    } tobii_stub_t;
+
+static tobii_stub_t g_tobii_stub;
+static char g_tobii_stub_api;           // Its address is the stub api
+
+// Returns the stub's clock, in microseconds.
+static int64_t tobii_stub_now_us() {
+    return duration_cast<microseconds>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+// Populates data w/ the stub device's n'th gaze sample, of the given
+// timestamp. Each fixation's point is spread pseudo-randomly over the display.
+static void tobii_stub_sample(tobii_gaze_data_t *data, int64_t n, int64_t t_us) {
+    tobii_gaze_data_eye_t *eyes[] = {&data->left, &data->right};
+    int64_t fixation = n / TOBII_STUB_FIXATION_N;
+    float x = 0.1 + 0.8 * ((fixation * 37) % 100) / 100;
+    float y = 0.1 + 0.8 * ((fixation * 61) % 100) / 100;
+
+    memset(data, 0, sizeof(*data));
+    data->timestamp_system_us = t_us;
+    data->timestamp_tracker_us = t_us;
+
+    for (int e = 0; e < 2; e++) {
+        tobii_gaze_data_eye_t *eye = eyes[e];
+        float side = e ? 1 : -1;
+
+        eye->gaze_origin_validity = TOBII_VALIDITY_VALID;
+        eye->gaze_point_validity = TOBII_VALIDITY_VALID;
+        eye->eyeball_center_validity = TOBII_VALIDITY_VALID;
+        eye->pupil_validity = TOBII_VALIDITY_VALID;
+
+        eye->gaze_origin_from_eye_tracker_mm_xyz[0] = side * 30;
+        eye->gaze_origin_from_eye_tracker_mm_xyz[2] = 600;
+        eye->eye_position_in_track_box_normalized_xyz[0] = 0.5 + side * 0.05;
+        eye->eye_position_in_track_box_normalized_xyz[1] = 0.5;
+        eye->eye_position_in_track_box_normalized_xyz[2] = 0.5;
+        eye->gaze_point_from_eye_tracker_mm_xyz[0] = (x - 0.5) * 600;
+        eye->gaze_point_from_eye_tracker_mm_xyz[1] = (1 - y) * 340;
+        eye->gaze_point_on_display_normalized_xy[0] = x;
+        eye->gaze_point_on_display_normalized_xy[1] = y;
+        eye->eyeball_center_from_eye_tracker_mm_xyz[0] = side * 30;
+        eye->eyeball_center_from_eye_tracker_mm_xyz[2] = 610;
+        eye->pupil_diameter_mm = 3.5;
+    }
+}
+
+// Returns the stub device, to be passed to the stubbed functions.
+tobii_device_t* tobii_stub_device() {
+    g_tobii_stub.is_connected = true;
+    g_tobii_stub.next_sample_us = tobii_stub_now_us();
+
+    return reinterpret_cast<tobii_device_t*>(&g_tobii_stub);
+}
+
+// Drops the stub device's connection for the given duration. Returns the
+// time, on the stub's clock, at which the link comes back up.
+int64_t tobii_stub_disconnect(int64_t down_us) {
+    boost::mutex::scoped_lock lock(g_tobii_stub.mutex);
+
+    g_tobii_stub.is_connected = false;
+    g_tobii_stub.is_subscribed = false;
+    g_tobii_stub.link_up_us = tobii_stub_now_us() + down_us;
+
+    return g_tobii_stub.link_up_us;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Stubbed stream engine functions
+
+extern "C" {
+    tobii_error_t tobii_wait_for_callbacks(int, tobii_device_t* const*) {
+        int64_t wait_us;
+        {
+            boost::mutex::scoped_lock lock(g_tobii_stub.mutex);
+            if (!g_tobii_stub.is_connected)
+                return TOBII_ERROR_CONNECTION_FAILED;
+
+            wait_us = g_tobii_stub.next_sample_us - tobii_stub_now_us();
+        }
+
+        if (wait_us > TOBII_STUB_WAIT_MAX_US)
+            wait_us = TOBII_STUB_WAIT_MAX_US;
+        if (wait_us > 0)
+            boost::this_thread::sleep_for(boost::chrono::microseconds{wait_us});
+
+        boost::mutex::scoped_lock lock(g_tobii_stub.mutex);
+        return g_tobii_stub.is_connected ?
+            TOBII_ERROR_NO_ERROR : TOBII_ERROR_CONNECTION_FAILED;
+    }
+
+    tobii_error_t tobii_device_process_callbacks(tobii_device_t*) {
+        boost::mutex::scoped_lock lock(g_tobii_stub.mutex);
+        int64_t now_us = tobii_stub_now_us();
+
+        if (!g_tobii_stub.is_connected)
+            return TOBII_ERROR_CONNECTION_FAILED;
+
+        while (g_tobii_stub.next_sample_us <= now_us) {
+            int64_t sample_us = g_tobii_stub.next_sample_us;
+            g_tobii_stub.next_sample_us += TOBII_STUB_SAMPLE_US;
+
+            if (!g_tobii_stub.is_subscribed)
+                continue;
+
+            tobii_gaze_data_t data;
+            tobii_stub_sample(&data, g_tobii_stub.n_samples++, sample_us);
+
+            g_tobii_stub.callback(&data, g_tobii_stub.user_data);
+        }
+
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_device_reconnect(tobii_device_t*) {
+        boost::mutex::scoped_lock lock(g_tobii_stub.mutex);
+        int64_t now_us = tobii_stub_now_us();
+
+        if (now_us < g_tobii_stub.link_up_us)
+            return TOBII_ERROR_CONNECTION_FAILED;
+
+        // Samples during the outage are lost, not delivered late
+        g_tobii_stub.is_connected = true;
+        g_tobii_stub.next_sample_us = now_us;
+        g_tobii_stub.n_reconnects++;
+
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_gaze_data_subscribe(tobii_device_t*,
+                                            tobii_gaze_data_callback_t callback,
+                                            void* user_data) {
+        boost::mutex::scoped_lock lock(g_tobii_stub.mutex);
+
+        if (!g_tobii_stub.is_connected)
+            return TOBII_ERROR_CONNECTION_FAILED;
+        if (g_tobii_stub.is_subscribed)
+            return TOBII_ERROR_ALREADY_SUBSCRIBED;
+
+        g_tobii_stub.is_subscribed = true;
+        g_tobii_stub.callback = callback;
+        g_tobii_stub.user_data = user_data;
+
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_gaze_data_unsubscribe(tobii_device_t*) {
+        boost::mutex::scoped_lock lock(g_tobii_stub.mutex);
+
+        if (!g_tobii_stub.is_connected)
+            return TOBII_ERROR_CONNECTION_FAILED;
+        if (!g_tobii_stub.is_subscribed)
+            return TOBII_ERROR_NOT_SUBSCRIBED;
+
+        g_tobii_stub.is_subscribed = false;
+
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_update_timesync(tobii_device_t*) {
+        boost::mutex::scoped_lock lock(g_tobii_stub.mutex);
+
+        return g_tobii_stub.is_connected ?
+            TOBII_ERROR_NO_ERROR : TOBII_ERROR_CONNECTION_FAILED;
+    }
+
+    tobii_error_t tobii_api_create(tobii_api_t** api,
+                                   tobii_custom_alloc_t const*,
+                                   tobii_custom_log_t const*) {
+        *api = reinterpret_cast<tobii_api_t*>(&g_tobii_stub_api);
+
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_api_destroy(tobii_api_t*) {
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_system_clock(tobii_api_t*, int64_t* timestamp_us) {
+        *timestamp_us = tobii_stub_now_us();
+
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_enumerate_local_device_urls(
+        tobii_api_t*, tobii_device_url_receiver_t receiver, void* user_data) {
+            receiver(TOBII_STUB_URL, user_data);
+
+            return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_device_create(tobii_api_t*,
+                                      char const*,
+                                      tobii_device_t** device) {
+        *device = tobii_stub_device();
+
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_device_create_ex(
+        tobii_api_t*,
+        char const*,
+        tobii_license_key_t const*,
+        int license_count,
+        tobii_license_validation_result_t* validation_results,
+        tobii_device_t** device) {
+            for (int i = 0; i < license_count; i++)
+                validation_results[i] = TOBII_LICENSE_VALIDATION_RESULT_OK;
+            *device = tobii_stub_device();
+
+            return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_device_destroy(tobii_device_t*) {
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_get_device_info(tobii_device_t*,
+                                        tobii_device_info_t* device_info) {
+        memset(device_info, 0, sizeof(*device_info));
+        strcpy(device_info->serial_number, "STUB-0");
+        strcpy(device_info->model, "Stub");
+
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_get_feature_group(
+        tobii_device_t*, tobii_feature_group_t* feature_group) {
+            *feature_group = TOBII_FEATURE_GROUP_CONSUMER;
+
+            return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_stream_supported(tobii_device_t*,
+                                         tobii_stream_t stream,
+                                         tobii_supported_t* supported) {
+        *supported = stream == TOBII_STREAM_GAZE_DATA ?
+            TOBII_SUPPORTED : TOBII_NOT_SUPPORTED;
+
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_get_geometry_mounting(
+        tobii_device_t*, tobii_geometry_mounting_t* geometry) {
+            memset(geometry, 0, sizeof(*geometry));
+
+            return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_calculate_display_area_basic(
+        tobii_api_t*,
+        float width_mm,
+        float height_mm,
+        float offset_x_mm,
+        tobii_geometry_mounting_t const*,
+        tobii_display_area_t* display_area) {
+            memset(display_area, 0, sizeof(*display_area));
+            display_area->top_left_mm_xyz[0] = offset_x_mm - width_mm / 2;
+            display_area->top_left_mm_xyz[1] = height_mm;
+            display_area->top_right_mm_xyz[0] = offset_x_mm + width_mm / 2;
+            display_area->top_right_mm_xyz[1] = height_mm;
+            display_area->bottom_left_mm_xyz[0] = offset_x_mm - width_mm / 2;
+
+            return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_set_display_area(
+        tobii_device_t*, tobii_display_area_t const*) {
+            return TOBII_ERROR_NO_ERROR;
+    }
+
+    // The stub device has no calibration, i.e. receiver is never called
+    tobii_error_t tobii_calibration_retrieve(tobii_device_t*,
+                                             tobii_data_receiver_t,
+                                             void*) {
+        return TOBII_ERROR_NO_ERROR;
+    }
+
+    tobii_error_t tobii_calibration_apply(tobii_device_t*,
+                                          void const*,
+                                          size_t) {
+        return TOBII_ERROR_NO_ERROR;
+    }
+}
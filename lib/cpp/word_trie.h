@@ -0,0 +1,379 @@
+/////////////////////////////////////////////////////////////////////////////
+// A frequency-ranked word-completion trie. Tries are built offline from a
+// word list into a compact, flat file, which is then memory-mapped (not
+// parsed) on load, its nodes' child ranges only bounds checked in one pass,
+// so loading is fast regardless of size.
+// Prefix completions are returned best-first, highest frequency first.
+//
+// File format: A word_trie_header_t followed by n_nodes word_trie_node_t's,
+// with node 0 the root. Each node's children are contiguous, follow it and
+// are sorted by label (one byte of the UTF-8 encoded word), and each node
+// records the max frequency of any word beneath it, allowing top-k search to
+// visit only the branches that can contribute to the result.
+//
+// Author: Dustin Fast <dustin.fast@hotmail.com>
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// Defs
+
+#define WORD_TRIE_MAGIC "AEYTRIE1"
+#define WORD_TRIE_VERSION 1
+#define WORD_TRIE_MAX_WORD_LEN 64
+
+typedef struct word_trie_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t n_nodes;
+        uint32_t n_words;
+        uint32_t reserved;
+	    } word_trie_header_t;
+
+typedef struct word_trie_node {
+        uint32_t first_child;
+        uint32_t freq;          // Nonzero iff a word ends at this node
+        uint32_t max_freq;      // Max freq of any word in this subtree
+        uint16_t n_children;
+        uint8_t label;
+        uint8_t reserved;
+	    } word_trie_node_t;
+
+/////////////////////////////////////////////////////////////////////////////
+// Class
+
+class WordTrie {
+    public:
+        bool load(const char*);
+        int complete(const char*, int, char*, int);
+        int word_count();
+        static int build(const char*, const char*);
+
+        WordTrie();
+        ~WordTrie();
+
+    protected:
+        void *m_map;
+        size_t m_map_sz;
+        const word_trie_header_t *m_header;
+        const word_trie_node_t *m_nodes;
+
+        const word_trie_node_t* child(const word_trie_node_t*, uint8_t);
+
+    private:
+        void unload();
+};
+
+// Default constructor. The trie is empty until load().
+WordTrie::WordTrie() {
+    m_map = NULL;
+    m_map_sz = 0;
+    m_header = NULL;
+    m_nodes = NULL;
+}
+
+// Destructor
+WordTrie::~WordTrie() {
+    unload();
+}
+
+// Memory-maps the trie file at the given path, replacing any loaded trie.
+// Returns false if the file is missing or malformed.
+bool WordTrie::load(const char *trie_path) {
+    unload();
+
+    int fd = open(trie_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        warn("Word trie load failed (file not found).\n");
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(word_trie_header_t)) {
+        close(fd);
+        warn("Word trie load failed (file too small).\n");
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        warn("Word trie load failed (mmap failed).\n");
+        return false;
+    }
+
+    // Validate header and size before trusting any node offsets
+    const word_trie_header_t *header = (const word_trie_header_t*)map;
+    size_t expected_sz = sizeof(word_trie_header_t) +
+        (size_t)header->n_nodes * sizeof(word_trie_node_t);
+
+    if (memcmp(header->magic, WORD_TRIE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != WORD_TRIE_VERSION ||
+        header->n_nodes == 0 ||
+        expected_sz != (size_t)st.st_size) {
+            munmap(map, st.st_size);
+            warn("Word trie load failed (invalid file).\n");
+            return false;
+    }
+
+    // Every node's children must lie after it and w/in the file, so lookups
+    // stay in bounds and searches terminate
+    const word_trie_node_t *nodes = (const word_trie_node_t*)(header + 1);
+
+    for (uint32_t i = 0; i < header->n_nodes; i++) {
+        if (nodes[i].n_children &&
+            (nodes[i].first_child <= i ||
+             (uint64_t)nodes[i].first_child + nodes[i].n_children >
+                header->n_nodes)) {
+            munmap(map, st.st_size);
+            warn("Word trie load failed (invalid node).\n");
+            return false;
+        }
+    }
+
+    m_map = map;
+    m_map_sz = st.st_size;
+    m_header = header;
+    m_nodes = nodes;
+
+    return true;
+}
+
+// Unmaps the currently loaded trie, if any.
+void WordTrie::unload() {
+    if (m_map)
+        munmap(m_map, m_map_sz);
+
+    m_map = NULL;
+    m_map_sz = 0;
+    m_header = NULL;
+    m_nodes = NULL;
+}
+
+// Returns the number of words in the loaded trie.
+int WordTrie::word_count() {
+    return m_header ? m_header->n_words : 0;
+}
+
+// Returns the given node's child having the given label, or NULL.
+const word_trie_node_t* WordTrie::child(const word_trie_node_t *node,
+                                        uint8_t label) {
+    // Binary search the node's (label-sorted) children
+    int lo = node->first_child;
+    int hi = lo + node->n_children - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+
+        if (m_nodes[mid].label == label)
+            return &m_nodes[mid];
+        else if (m_nodes[mid].label < label)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return NULL;
+}
+
+// Writes up to k completions of the given prefix to out, most frequent first,
+// as a newline-separated, null-terminated string of at most out_sz bytes.
+// Returns the number of completions written.
+int WordTrie::complete(const char *prefix, int k, char *out, int out_sz) {
+    // Search entries are either a subtree to expand (ranked by its max freq)
+    // or a word found (ranked by its freq)
+    typedef struct entry {
+        uint32_t rank;
+        bool is_word;
+        const word_trie_node_t *node;
+        string word;
+
+        bool operator<(const struct entry &other) const {
+            // On ties, words pop before subtrees
+            return rank < other.rank ||
+                (rank == other.rank && is_word < other.is_word);
+        }
+    } entry_t;
+
+    if (out_sz <= 0)
+        return 0;
+    *out = '\0';
+
+    if (!m_nodes || k <= 0)
+        return 0;
+
+    // Walk to the prefix's node
+    const word_trie_node_t *node = &m_nodes[0];
+    for (const char *c = prefix; *c && node; c++)
+        node = child(node, *c);
+
+    if (!node || node->max_freq == 0)
+        return 0;
+
+    // Best-first search from the prefix node
+    priority_queue<entry_t> frontier;
+    frontier.push(entry_t{node->max_freq, false, node, string(prefix)});
+
+    int n_found = 0;
+    int n_written = 0;
+
+    while (!frontier.empty() && n_found < k) {
+        entry_t e = frontier.top();
+        frontier.pop();
+
+        if (e.is_word) {
+            // Append the word iff it (plus separator and null) fits
+            int len = e.word.size();
+            int sep = n_found > 0 ? 1 : 0;
+
+            if (n_written + sep + len + 1 > out_sz)
+                break;
+
+            if (sep)
+                out[n_written++] = '\n';
+            memcpy(out + n_written, e.word.c_str(), len);
+            n_written += len;
+            out[n_written] = '\0';
+            n_found++;
+            continue;
+        }
+
+        if (e.node->freq > 0)
+            frontier.push(entry_t{e.node->freq, true, e.node, e.word});
+
+        const word_trie_node_t *c = &m_nodes[e.node->first_child];
+        for (int j = 0; j < e.node->n_children; j++, c++)
+            frontier.push(entry_t{
+                c->max_freq, false, c, e.word + (char)c->label});
+    }
+
+    return n_found;
+}
+
+// Builds a trie file at trie_path from the word list at wordlist_path. Each
+// line of the word list is a word, optionally followed by whitespace and its
+// (integer) frequency. Words w/out a freq are ranked by line order, most
+// frequent first. Duplicate words keep their highest freq. Returns the
+// number of words written, or -1 on failure.
+int WordTrie::build(const char *wordlist_path, const char *trie_path) {
+    typedef struct build_node {
+        uint32_t freq;
+        uint32_t max_freq;
+        map<uint8_t, uint32_t> children;
+    } build_node_t;
+
+    ifstream f_in(wordlist_path);
+    if (!f_in) {
+        error("Word trie build failed (word list not found).\n");
+        return -1;
+    }
+
+    // Read the words into an in-memory trie
+    vector<build_node_t> nodes(1);
+    vector<pair<string, long>> words;
+    string line;
+
+    while (getline(f_in, line)) {
+        size_t end = line.find_first_of(" \t\r");
+        string word = line.substr(0, end);
+
+        if (word.empty() || word.size() > WORD_TRIE_MAX_WORD_LEN)
+            continue;
+
+        long freq = -1;
+        if (end != string::npos)
+            freq = strtol(line.c_str() + end, NULL, 10);
+
+        words.push_back(make_pair(word, freq));
+    }
+    f_in.close();
+
+    uint32_t n_words = 0;
+    uint32_t n_lines = words.size();
+
+    for (uint32_t i = 0; i < n_lines; i++) {
+        uint32_t freq = words[i].second > 0 ?
+            (uint32_t)min(words[i].second, (long)UINT32_MAX) : n_lines - i;
+        uint32_t idx = 0;
+
+        for (uint8_t c : words[i].first) {
+            auto it = nodes[idx].children.find(c);
+            if (it != nodes[idx].children.end()) {
+                idx = it->second;
+            } else {
+                nodes.push_back(build_node_t{0, 0, {}});
+                nodes[idx].children[c] = nodes.size() - 1;
+                idx = nodes.size() - 1;
+            }
+        }
+
+        if (nodes[idx].freq == 0)
+            n_words++;
+        nodes[idx].freq = max(nodes[idx].freq, freq);
+    }
+
+    // Propagate subtree max freqs. Children always follow their parents.
+    for (int i = nodes.size() - 1; i >= 0; i--) {
+        nodes[i].max_freq = nodes[i].freq;
+        for (auto &c : nodes[i].children)
+            nodes[i].max_freq = max(nodes[i].max_freq, nodes[c.second].max_freq);
+    }
+
+    // Flatten breadth first, so each node's children are contiguous
+    vector<word_trie_node_t> flat(nodes.size());
+    vector<uint32_t> order;  // Flat idx -> build idx
+    vector<uint8_t> labels;
+
+    order.push_back(0);
+    labels.push_back(0);
+
+    for (size_t i = 0; i < order.size(); i++) {
+        build_node_t *bn = &nodes[order[i]];
+
+        flat[i].first_child = order.size();
+        flat[i].freq = bn->freq;
+        flat[i].max_freq = bn->max_freq;
+        flat[i].n_children = bn->children.size();
+        flat[i].label = labels[i];
+        flat[i].reserved = 0;
+
+        for (auto &c : bn->children) {
+            order.push_back(c.second);
+            labels.push_back(c.first);
+        }
+    }
+
+    // Write the header and nodes
+    word_trie_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WORD_TRIE_MAGIC, sizeof(header.magic));
+    header.version = WORD_TRIE_VERSION;
+    header.n_nodes = flat.size();
+    header.n_words = n_words;
+
+    ofstream f_out(trie_path, ios::out | ios::binary | ios::trunc);
+    f_out.write((char*)&header, sizeof(header));
+    f_out.write((char*)flat.data(), flat.size() * sizeof(word_trie_node_t));
+    f_out.close();
+
+    if (!f_out) {
+        error("Word trie build failed (could not write trie file).\n");
+        return -1;
+    }
+
+    return n_words;
+}
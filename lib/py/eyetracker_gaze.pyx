@@ -4,8 +4,10 @@
 
 __author__ = 'Dustin Fast <dustin.fast@outlook.com>'
 
+import os
 import ctypes
-from pathlib import Path
+
+import numpy as np
 from subprocess import Popen, PIPE
 
 from lib.py.app import config, info, warn, error
@@ -17,28 +19,281 @@ DISP_HEIGHT_MM = _conf['DISP_HEIGHT_MM']
 DISP_WIDTH_PX = _conf['DISP_WIDTH_PX']
 DISP_HEIGHT_PX = _conf['DISP_HEIGHT_PX']
 GAZE_BUFF_SZ = _conf['EYETRACKER_BUFF_SZ']
+GAZE_SAMPLE_HZ = _conf['EYETRACKER_SAMPLE_HZ']
 GAZE_MARK_INTERVAL = _conf['EYETRACKER_MARK_INTERVAL']
 GAZE_PREP_PATH = _conf['EYETRACKER_PREP_SCRIPT_PATH']
 GAZE_SMOOTH_OVER = _conf['EYETRACKER_SMOOTH_OVER']
+GAZE_CALIB_PROFILE = _conf['EYETRACKER_CALIB_PROFILE']
+HEATMAP_CELL_PX = _conf['EYETRACKER_HEATMAP_CELL_PX']
+HEATMAP_SIGMA_PX = _conf['EYETRACKER_HEATMAP_SIGMA_PX']
+HEATMAP_HALFLIFE_MS = _conf['EYETRACKER_HEATMAP_HALFLIFE_MS']
+HISTORY_BYTES = _conf['EYETRACKER_HISTORY_BYTES']
+COLD_BYTES = _conf['EYETRACKER_COLD_BYTES']
+COLD_MANTISSA_BITS = _conf['EYETRACKER_COLD_MANTISSA_BITS']
+QUALITY_WINDOW = _conf['EYETRACKER_QUALITY_WINDOW']
+QUALITY_FIXATION_PX_S = _conf['EYETRACKER_QUALITY_FIXATION_PX_S']
+QUALITY_MAX_RMS_PX = _conf['EYETRACKER_QUALITY_MAX_RMS_PX']
+QUALITY_MAX_INVALID = _conf['EYETRACKER_QUALITY_MAX_INVALID']
+WORDTRIE_PATH = _conf['HUD_WORDTRIE_PATH']
+HUD_DISP_WIDTH = _conf['HUD_DISP_WIDTH_PX']
+HUD_DISP_HEIGHT = _conf['HUD_DISP_HEIGHT_PX']
+HUD_DISP_DIV_X = _conf['HUD_DISP_COORD_DIVISOR_X']
+HUD_DISP_DIV_Y = _conf['HUD_DISP_COORD_DIVISOR_Y']
 del _conf
 
-GAZE_CALIB_PATH = '/opt/app/data/eyetracker.calib'
+GAZE_CALIB_DEFAULT_PROFILE = 'default'
+GAZE_CALIB_PROFILES_BUFF_SZ = 4096
+HUD_KEY_NONE = -1
+WORDTRIE_COMPLETIONS_BUFF_SZ = 4096
+GAZE_INDEX_HITS_BUFF_SZ = 4096
+GAZE_EVENT_KEY_SELECTED = 1
+GAZE_EVENT_RECALIBRATE = 2
+GAZE_EVENT_BLINK = 3
+GAZE_EVENT_DISCONNECTED = 4
+GAZE_EVENT_RECONNECTED = 5
+GAZE_VALID_LEFT = 0x1
+GAZE_VALID_RIGHT = 0x2
+GAZE_VALID_BOTH = GAZE_VALID_LEFT | GAZE_VALID_RIGHT
+GAZE_FLAG_GAP = 0x1
+GAZE_GAP_DEVICE = 1         # Samples lost on the device side
+GAZE_GAP_DISCONNECT = 2     # Samples lost to a device connection outage
+GAZE_GAP_OVERWRITE = 3      # Samples overwritten in the buff, unexported
+GAZE_FIELDS_MINIMAL = 0x0   # Timestamp, gaze point and validity only
+GAZE_FIELDS_HUD = 0x1       # Plus eye positions (for the user pos guide)
+GAZE_FIELDS_ML = 0x3        # Plus all other per-eye fields
+GAZE_FIELDS_FULL = 0x3      # All fields (e.g. for logging to CSV)
+GAZE_FIELDS_PACKED = 0x7    # All fields, buffered packed (fixed-point)
 
 
 class gaze_point(ctypes.Structure):
     """ An abstraction of a gaze point, including the number of samples gaze
-        samples it was smoothed over.
+        samples it was smoothed over and the index of the HUD key under it.
     """
     _fields_ = [
         ('n_samples', ctypes.c_int), 
         ('x', ctypes.c_int), 
-        ('y', ctypes.c_int)]
+        ('y', ctypes.c_int),
+        ('key_idx', ctypes.c_int)]
+
+
+class gaze_event(ctypes.Structure):
+    """ An abstraction of a gaze event, e.g. a dwell key selection.
+    """
+    _fields_ = [
+        ('type', ctypes.c_int),
+        ('key_idx', ctypes.c_int),
+        ('unixtime_us', ctypes.c_int64),
+        ('duration_us', ctypes.c_int64)]
+
+
+class aoi_stats(ctypes.Structure):
+    """ An abstraction of an area of interest's time-on-target counters.
+        first_entry_us is the latency from the AOI's addition (or last
+        counter reset) to the gaze first entering it, or -1 if it hasn't.
+    """
+    _fields_ = [
+        ('id', ctypes.c_int),
+        ('x', ctypes.c_int),
+        ('y', ctypes.c_int),
+        ('width', ctypes.c_int),
+        ('height', ctypes.c_int),
+        ('n_entries', ctypes.c_int),
+        ('dwell_us', ctypes.c_int64),
+        ('first_entry_us', ctypes.c_int64)]
+
+
+class gaze_agg(ctypes.Structure):
+    """ An abstraction of gaze samples aggregated over a period. A raw sample
+        is represented as a period of duration 0 having one sample.
+    """
+    _fields_ = [
+        ('unixtime_us', ctypes.c_int64),
+        ('duration_us', ctypes.c_int64),
+        ('n_samples', ctypes.c_int),
+        ('valid_frac', ctypes.c_float),
+        ('mean_x', ctypes.c_float),
+        ('mean_y', ctypes.c_float),
+        ('min_x', ctypes.c_int),
+        ('max_x', ctypes.c_int),
+        ('min_y', ctypes.c_int),
+        ('max_y', ctypes.c_int)]
+
+
+class gaze_cold_stats(ctypes.Structure):
+    """ An abstraction of the compressed cold history's size and throughput.
+    """
+    _fields_ = [
+        ('n_samples', ctypes.c_int64),
+        ('n_pages', ctypes.c_int64),
+        ('bytes_used', ctypes.c_int64),
+        ('bytes_raw', ctypes.c_int64),
+        ('encode_ns', ctypes.c_double),
+        ('decode_ns', ctypes.c_double)]
+
+
+class gaze_quality(ctypes.Structure):
+    """ An abstraction of the gaze data-quality metrics, over the most recent
+        window of samples. Precision (rms_s2s_px) is the RMS sample-to-sample
+        distance during fixations, and its baseline is that of the first full
+        window since the metrics were reset.
+    """
+    _fields_ = [
+        ('n_samples', ctypes.c_int64),
+        ('rms_s2s_px', ctypes.c_float),
+        ('rms_s2s_baseline_px', ctypes.c_float),
+        ('left_invalid_ratio', ctypes.c_float),
+        ('right_invalid_ratio', ctypes.c_float),
+        ('n_bursts', ctypes.c_int),
+        ('burst_max', ctypes.c_int),
+        ('burst_mean', ctypes.c_float),
+        ('burst_current', ctypes.c_int),
+        ('is_degraded', ctypes.c_int)]
+
+
+class device_conn_stats(ctypes.Structure):
+    """ An abstraction of the eyetracker device connection's statistics.
+        Outages span from connection loss to the gaze stream's resumption.
+    """
+    _fields_ = [
+        ('n_disconnects', ctypes.c_int64),
+        ('n_attempts', ctypes.c_int64),
+        ('last_outage_us', ctypes.c_int64),
+        ('max_outage_us', ctypes.c_int64),
+        ('is_connected', ctypes.c_int)]
+
+
+class startup_stage(ctypes.Structure):
+    """ An abstraction of a device initialization stage's timing. start_us is
+        relative to the start of initialization.
+    """
+    _fields_ = [
+        ('name', ctypes.c_char * 32),
+        ('start_us', ctypes.c_int64),
+        ('duration_us', ctypes.c_int64),
+        ('worker', ctypes.c_int)]
+
+
+class gaze_gap(ctypes.Structure):
+    """ An abstraction of a gap in gaze samples, of type GAZE_GAP_*. seq is
+        that of the first sample after the gap, or if overwritten of the
+        first sample lost. n_samples is estimated unless overwritten.
+    """
+    _fields_ = [
+        ('type', ctypes.c_int),
+        ('seq', ctypes.c_uint32),
+        ('unixtime_us', ctypes.c_int64),
+        ('duration_us', ctypes.c_int64),
+        ('n_samples', ctypes.c_int64)]
+
+
+class gaze_index_hit(ctypes.Structure):
+    """ An abstraction of a logged gaze sample matching an index query.
+    """
+    _fields_ = [
+        ('unixtime_us', ctypes.c_int64),
+        ('seq', ctypes.c_uint32),
+        ('x', ctypes.c_int),
+        ('y', ctypes.c_int),
+        ('validity', ctypes.c_int)]
+
+
+class gaze_index_stats(ctypes.Structure):
+    """ An abstraction of the cost of an index query: the number of log
+        blocks in the logs queried, those scanned (i.e. not pruned by time or
+        region) and the records they held.
+    """
+    _fields_ = [
+        ('n_blocks', ctypes.c_int64),
+        ('n_blocks_scanned', ctypes.c_int64),
+        ('n_records_scanned', ctypes.c_int64),
+        ('n_hits', ctypes.c_int64),
+        ('n_logs', ctypes.c_int),
+        ('n_failed', ctypes.c_int),
+        ('elapsed_us', ctypes.c_int64)]
+
+
+class gaze_csv_stats(ctypes.Structure):
+    """ An abstraction of the results of a CSV to binary log conversion.
+        Malformed rows (e.g. of the wrong column count) are skipped, and
+        first_malformed is the line number (from 1) of the first, or 0.
+    """
+    _fields_ = [
+        ('n_rows', ctypes.c_int64),
+        ('n_labeled', ctypes.c_int64),
+        ('n_malformed', ctypes.c_int64),
+        ('first_malformed', ctypes.c_int64),
+        ('n_bytes', ctypes.c_int64),
+        ('n_threads', ctypes.c_int),
+        ('elapsed_us', ctypes.c_int64)]
+
+
+class gaze_replay_params(ctypes.Structure):
+    """ An abstraction of the params of an offline log replay. A shard_us of
+        0 denotes one shard per log, and an n_threads of 0 one per core.
+    """
+    _fields_ = [
+        ('smooth_over', ctypes.c_int),
+        ('quality_window', ctypes.c_int),
+        ('quality_fixation_px_s', ctypes.c_float),
+        ('quality_max_rms_px', ctypes.c_float),
+        ('quality_max_invalid', ctypes.c_float),
+        ('n_threads', ctypes.c_int),
+        ('shard_us', ctypes.c_int64),
+        ('warmup_us', ctypes.c_int64)]
+
+
+class gaze_replay_stats(ctypes.Structure):
+    """ An abstraction of the results of an offline log replay. n_warmup is
+        the number of samples replayed for shard warm-up only, and n_failed
+        the number of logs failing to open or be written.
+    """
+    _fields_ = [
+        ('n_samples', ctypes.c_int64),
+        ('n_warmup', ctypes.c_int64),
+        ('n_logs', ctypes.c_int),
+        ('n_failed', ctypes.c_int),
+        ('n_shards', ctypes.c_int),
+        ('n_threads', ctypes.c_int),
+        ('elapsed_us', ctypes.c_int64)]
 
 
 class EyeTrackerGaze(object):
-    def __init__(self, ml_x_path=None, ml_y_path=None):
-        # Build external .so file
-        prep_proc = Popen([GAZE_PREP_PATH], stderr=PIPE)
+    # The lib, and the script building it. Overridden by synthetic backends.
+    _prep_path = GAZE_PREP_PATH
+    _lib_path = LIB_PATH
+
+    def __init__(self, ml_x_path=None, ml_y_path=None, fields=None,
+                 offline=False):
+        """ If fields is None, the ingest field mode is GAZE_FIELDS_ML iff ML
+            model paths are given, else GAZE_FIELDS_FULL. If offline, the
+            device may not be opened, and only the operations not requiring
+            it (e.g. csv_to_log()) are available. The lib is then used as
+            last built, and the eyetracker service is not started.
+        """
+        # Build external .so file, unless offline and already built
+        if not offline or not os.path.exists(self._lib_path):
+            self._prep(build_only=offline)
+
+        self._lib = self._init_lib(self._lib_path)
+        self._offline = offline
+        self._obj = None  # Populated on open()
+        self._ml_x_path = ml_x_path
+        self._ml_y_path = ml_y_path
+
+        if fields is None:
+            fields = GAZE_FIELDS_ML if ml_x_path else GAZE_FIELDS_FULL
+        self._fields = fields
+
+    def _prep(self, build_only=False):
+        """ Runs the prep script, building the external .so file and, unless
+            build_only, starting the eyetracker service iff needed. Exits on
+            build errors.
+        """
+        prep_args = [self._prep_path]
+        if build_only:
+            prep_args.append('--build-only')
+
+        prep_proc = Popen(prep_args, stderr=PIPE)
         stderr = prep_proc.communicate()[1]
         prep_proc.wait()
 
@@ -47,11 +302,6 @@ class EyeTrackerGaze(object):
             error(f'Eyetracker .so build failed with:\n {stderr}')
             exit()
 
-        self._lib = self._init_lib(LIB_PATH)
-        self._obj = None  # Populated on open()
-        self._ml_x_path = ml_x_path
-        self._ml_y_path = ml_y_path
-
     @staticmethod
     def _init_lib(lib_path):
         """ Loads the external lib, inits callables, and returns a ctypes.cdll.
@@ -74,6 +324,11 @@ class EyeTrackerGaze(object):
             ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int, ctypes.c_char_p]
         lib.eye_gaze_data_tocsv.restype = ctypes.c_int
 
+        # Data to binary log
+        lib.eye_gaze_data_tolog.argtypes = [
+            ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int, ctypes.c_char_p]
+        lib.eye_gaze_data_tolog.restype = ctypes.c_int
+
         # Start
         lib.eye_gaze_start.argtypes = [ctypes.c_void_p]
         lib.eye_gaze_start.restype = ctypes.c_void_p
@@ -102,9 +357,30 @@ class EyeTrackerGaze(object):
         lib.eye_cursor_cap.argtypes = [ctypes.c_void_p, ctypes.c_int]
         lib.eye_cursor_cap.restype = ctypes.c_void_p
 
+        # Ingest field mode
+        lib.eye_gaze_fields.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        lib.eye_gaze_fields.restype = ctypes.c_bool
+
         # Device calibration writer
-        lib.eye_write_calibration.argtypes = [ctypes.c_void_p]
-        lib.eye_write_calibration.restype = ctypes.c_void_p
+        lib.eye_write_calibration.argtypes = [ctypes.c_void_p,
+                                              ctypes.c_char_p]
+        lib.eye_write_calibration.restype = ctypes.c_bool
+
+        # Device calibration profile apply
+        lib.eye_calibration_apply.argtypes = [ctypes.c_void_p,
+                                              ctypes.c_char_p]
+        lib.eye_calibration_apply.restype = ctypes.c_bool
+
+        # Device calibration profile remove
+        lib.eye_calibration_remove.argtypes = [ctypes.c_void_p,
+                                               ctypes.c_char_p]
+        lib.eye_calibration_remove.restype = ctypes.c_bool
+
+        # Device calibration profile names
+        lib.eye_calibration_profiles.argtypes = [ctypes.c_void_p,
+                                                 ctypes.c_char_p,
+                                                 ctypes.c_int]
+        lib.eye_calibration_profiles.restype = ctypes.c_int
 
         # GazePoint
         lib.eye_gaze_point.argtypes = [ctypes.c_void_p]
@@ -114,6 +390,201 @@ class EyeTrackerGaze(object):
         lib.eye_gaze_point_free.argtypes = [ctypes.c_void_p]
         lib.eye_gaze_point_free.restype = ctypes.c_void_p
 
+        # HUD keymap load
+        lib.eye_keymap_load.argtypes = [
+            ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int, ctypes.c_int,
+                ctypes.c_int, ctypes.c_int]
+        lib.eye_keymap_load.restype = ctypes.c_int
+
+        # HUD key under gaze
+        lib.eye_gaze_key.argtypes = [ctypes.c_void_p]
+        lib.eye_gaze_key.restype = ctypes.c_int
+
+        # Dwell selection config
+        lib.eye_dwell_config.argtypes = [
+            ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_int]
+        lib.eye_dwell_config.restype = ctypes.c_void_p
+
+        # Gaze event fd
+        lib.eye_event_fd.argtypes = [ctypes.c_void_p]
+        lib.eye_event_fd.restype = ctypes.c_int
+
+        # Next gaze event
+        lib.eye_event_next.argtypes = [
+            ctypes.c_void_p, ctypes.POINTER(gaze_event)]
+        lib.eye_event_next.restype = ctypes.c_int
+
+        # Keystroke injection, text
+        lib.eye_inject_text.argtypes = [
+            ctypes.c_void_p, ctypes.c_char_p, ctypes.c_uint]
+        lib.eye_inject_text.restype = ctypes.c_int64
+
+        # Keystroke injection, keysym
+        lib.eye_inject_keysym.argtypes = [
+            ctypes.c_void_p, ctypes.c_ulong, ctypes.c_uint]
+        lib.eye_inject_keysym.restype = ctypes.c_int64
+
+        # Word completion trie build
+        lib.eye_trie_build.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+        lib.eye_trie_build.restype = ctypes.c_int
+
+        # Word completion trie load
+        lib.eye_trie_load.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        lib.eye_trie_load.restype = ctypes.c_int
+
+        # Word completions
+        lib.eye_trie_complete.argtypes = [
+            ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int, ctypes.c_char_p,
+                ctypes.c_int]
+        lib.eye_trie_complete.restype = ctypes.c_int
+
+        # Gaze heatmap config
+        lib.eye_heatmap_config.argtypes = [
+            ctypes.c_void_p, ctypes.c_int, ctypes.c_float, ctypes.c_int]
+        lib.eye_heatmap_config.restype = ctypes.c_void_p
+
+        # Gaze heatmap
+        lib.eye_heatmap.argtypes = [
+            ctypes.c_void_p,
+            ctypes.POINTER(ctypes.c_int),
+            ctypes.POINTER(ctypes.c_int),
+            ctypes.POINTER(ctypes.c_int)]
+        lib.eye_heatmap.restype = ctypes.POINTER(ctypes.c_float)
+
+        # Area of interest add
+        lib.eye_aoi_add.argtypes = [
+            ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_int,
+                ctypes.c_int]
+        lib.eye_aoi_add.restype = ctypes.c_int
+
+        # Area of interest remove
+        lib.eye_aoi_remove.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        lib.eye_aoi_remove.restype = ctypes.c_int
+
+        # Area of interest counters snapshot
+        lib.eye_aoi_stats.argtypes = [
+            ctypes.c_void_p, ctypes.POINTER(aoi_stats), ctypes.c_int]
+        lib.eye_aoi_stats.restype = ctypes.c_int
+
+        # Area of interest counters reset
+        lib.eye_aoi_reset.argtypes = [ctypes.c_void_p]
+        lib.eye_aoi_reset.restype = ctypes.c_void_p
+
+        # Gaze history config
+        lib.eye_history_config.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        lib.eye_history_config.restype = ctypes.c_void_p
+
+        # Gaze history query
+        lib.eye_history.argtypes = [
+            ctypes.c_void_p, ctypes.c_int64, ctypes.c_int64,
+                ctypes.POINTER(gaze_agg), ctypes.c_int,
+                    ctypes.POINTER(ctypes.c_int64)]
+        lib.eye_history.restype = ctypes.c_int
+
+        # Cold gaze history config
+        lib.eye_cold_history_config.argtypes = [
+            ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int]
+        lib.eye_cold_history_config.restype = ctypes.c_void_p
+
+        # Cold gaze history stats
+        lib.eye_cold_history_stats.argtypes = [
+            ctypes.c_void_p, ctypes.POINTER(gaze_cold_stats)]
+        lib.eye_cold_history_stats.restype = ctypes.c_int
+
+        # Gaze quality monitor config
+        lib.eye_quality_config.argtypes = [
+            ctypes.c_void_p, ctypes.c_int, ctypes.c_float, ctypes.c_float,
+                ctypes.c_float]
+        lib.eye_quality_config.restype = ctypes.c_void_p
+
+        # Gaze quality metrics
+        lib.eye_quality.argtypes = [
+            ctypes.c_void_p, ctypes.POINTER(gaze_quality)]
+        lib.eye_quality.restype = ctypes.c_void_p
+
+        # Gaze quality metrics reset
+        lib.eye_quality_reset.argtypes = [ctypes.c_void_p]
+        lib.eye_quality_reset.restype = ctypes.c_void_p
+
+        # Gaze sample counts, by validity
+        lib.eye_validity_counts.argtypes = [
+            ctypes.c_void_p, ctypes.POINTER(ctypes.c_int64)]
+        lib.eye_validity_counts.restype = ctypes.c_void_p
+
+        # Blink count
+        lib.eye_blink_count.argtypes = [ctypes.c_void_p]
+        lib.eye_blink_count.restype = ctypes.c_int64
+
+        # Device connection stats
+        lib.eye_connection_stats.argtypes = [
+            ctypes.c_void_p, ctypes.POINTER(device_conn_stats)]
+        lib.eye_connection_stats.restype = ctypes.c_void_p
+
+        # Startup timeline
+        lib.eye_startup_timeline.argtypes = [ctypes.c_void_p,
+                                             ctypes.POINTER(startup_stage),
+                                             ctypes.c_int,
+                                             ctypes.POINTER(ctypes.c_int64)]
+        lib.eye_startup_timeline.restype = ctypes.c_int
+
+        # Nominal sample rate, for device-side gap detection
+        lib.eye_sample_rate.argtypes = [ctypes.c_void_p, ctypes.c_float]
+        lib.eye_sample_rate.restype = ctypes.c_void_p
+
+        # Gap log
+        lib.eye_gap_log.argtypes = [
+            ctypes.c_void_p, ctypes.POINTER(gaze_gap), ctypes.c_int]
+        lib.eye_gap_log.restype = ctypes.c_int
+
+        # Lost sample count
+        lib.eye_lost_count.argtypes = [ctypes.c_void_p]
+        lib.eye_lost_count.restype = ctypes.c_int64
+
+        # Trace recorder on/off
+        lib.eye_trace_enable.argtypes = [ctypes.c_bool]
+        lib.eye_trace_enable.restype = ctypes.c_void_p
+
+        # Trace recorder dump
+        lib.eye_trace_dump.argtypes = [ctypes.c_char_p]
+        lib.eye_trace_dump.restype = ctypes.c_int
+
+        # Gaze log index update
+        lib.eye_index_build.argtypes = [
+            ctypes.c_char_p, ctypes.c_int, ctypes.c_int]
+        lib.eye_index_build.restype = ctypes.c_int64
+
+        # Gaze log index query
+        lib.eye_index_query.argtypes = [ctypes.POINTER(ctypes.c_char_p),
+                                        ctypes.c_int,
+                                        ctypes.c_int64,
+                                        ctypes.c_int64,
+                                        ctypes.c_int,
+                                        ctypes.c_int,
+                                        ctypes.c_int,
+                                        ctypes.c_int,
+                                        ctypes.c_char_p,
+                                        ctypes.POINTER(gaze_index_hit),
+                                        ctypes.c_int64,
+                                        ctypes.POINTER(gaze_index_stats)]
+        lib.eye_index_query.restype = ctypes.c_int64
+
+        # CSV to binary log conversion
+        lib.eye_csv_to_log.argtypes = [ctypes.c_char_p,
+                                       ctypes.c_char_p,
+                                       ctypes.c_int,
+                                       ctypes.POINTER(gaze_csv_stats)]
+        lib.eye_csv_to_log.restype = ctypes.c_int64
+
+        # Offline log replay
+        lib.eye_replay_logs.argtypes = [ctypes.POINTER(ctypes.c_char_p),
+                                        ctypes.c_int,
+                                        ctypes.c_char_p,
+                                        ctypes.POINTER(gaze_replay_params),
+                                        ctypes.c_char_p,
+                                        ctypes.c_char_p,
+                                        ctypes.POINTER(gaze_replay_stats)]
+        lib.eye_replay_logs.restype = ctypes.c_int64
+
         return lib
 
     def _ensure_device_opened(self):
@@ -127,6 +598,10 @@ class EyeTrackerGaze(object):
             error('Eyetracker.open attempted but device already open.')
             return
 
+        if self._offline:
+            error('Eyetracker.open attempted but instance is offline.')
+            return
+
         try:
             ml_x_path = bytes(self._ml_x_path, encoding="ascii")
         except TypeError:
@@ -143,6 +618,23 @@ class EyeTrackerGaze(object):
                 GAZE_MARK_INTERVAL, GAZE_BUFF_SZ, GAZE_SMOOTH_OVER,
                     ml_x_path, ml_y_path)
 
+        self._lib.eye_gaze_fields(self._obj, self._fields)
+        self._lib.eye_sample_rate(self._obj, GAZE_SAMPLE_HZ)
+        self._lib.eye_heatmap_config(
+            self._obj, HEATMAP_CELL_PX, HEATMAP_SIGMA_PX, HEATMAP_HALFLIFE_MS)
+        self._lib.eye_history_config(self._obj, HISTORY_BYTES)
+        self._lib.eye_cold_history_config(
+            self._obj, COLD_BYTES, COLD_MANTISSA_BITS)
+        self._lib.eye_quality_config(self._obj,
+                                     QUALITY_WINDOW,
+                                     QUALITY_FIXATION_PX_S,
+                                     QUALITY_MAX_RMS_PX,
+                                     QUALITY_MAX_INVALID)
+
+        # The default profile is applied on device creation
+        if GAZE_CALIB_PROFILE != GAZE_CALIB_DEFAULT_PROFILE:
+            self.apply_calibration(GAZE_CALIB_PROFILE)
+
     def close(self):
         """ Closes the device.
         """
@@ -184,6 +676,19 @@ class EyeTrackerGaze(object):
                                       num_points,
                                       bytes(label, encoding="ascii"))
 
+    def to_log(self, file_path, num_points=0, label=''):
+        """ Writes up to the last n gaze data points to the binary gaze log at
+            the given file path, creating it if missing else appending to it.
+            If n == 0, all data points in the buffer are written. If label is
+            given, the points are labeled w/ it, interned in the log's label
+            dictionary (at most 255 labels per log, of 31 chars).
+        """
+        self._ensure_device_opened()
+        self._lib.eye_gaze_data_tolog(self._obj,
+                                      bytes(file_path, encoding="ascii"),
+                                      num_points,
+                                      bytes(label, encoding="ascii"))
+
     def gaze_data_sz(self):
         """ Returns the number of gaze point samples in the eyetracker's buff.
         """
@@ -204,21 +709,53 @@ class EyeTrackerGaze(object):
         self._ensure_device_opened()
         self._lib.eye_cursor_cap(self._obj, enabled)
 
-    def write_calibration(self):
-        """ Writes the eyetracker device's calibration data to file.
+    def write_calibration(self, profile=GAZE_CALIB_PROFILE):
+        """ Writes the eyetracker device's calibration data to the calibration
+            store as the given profile.
         """
         self._ensure_device_opened()
 
         # If exists, prompt for overwrite
-        if Path(GAZE_CALIB_PATH).exists():
-            warn('Calibration file exists! Overwrite it', end=' ')
+        if profile in self.calibration_profiles():
+            warn(f'Calibration profile \'{profile}\' exists! Overwrite it',
+                 end=' ')
             if input('[y/N]? ') != 'y':
                 info('Calibration aborted by user.')
                 return
 
-        # If not exists OR if overwrite confirmed, write to file
-        self._lib.eye_write_calibration(self._obj)
-        info('Calibration complete.')
+        # If not exists OR if overwrite confirmed, write to store
+        if self._lib.eye_write_calibration(self._obj,
+                                           bytes(profile, encoding='ascii')):
+            info('Calibration complete.')
+        else:
+            error('Calibration write failed.')
+
+    def apply_calibration(self, profile):
+        """ Sets the eyetracker device's calibration from the given profile of
+            the calibration store, e.g. on switching users. Returns True iff
+            successful.
+        """
+        self._ensure_device_opened()
+        return self._lib.eye_calibration_apply(
+            self._obj, bytes(profile, encoding='ascii'))
+
+    def remove_calibration(self, profile):
+        """ Removes the given profile from the calibration store. Returns True
+            iff it existed.
+        """
+        self._ensure_device_opened()
+        return self._lib.eye_calibration_remove(
+            self._obj, bytes(profile, encoding='ascii'))
+
+    def calibration_profiles(self):
+        """ Returns a list of the calibration store's profile names.
+        """
+        self._ensure_device_opened()
+        buff = ctypes.create_string_buffer(GAZE_CALIB_PROFILES_BUFF_SZ)
+        n = self._lib.eye_calibration_profiles(
+            self._obj, buff, GAZE_CALIB_PROFILES_BUFF_SZ)
+
+        return buff.value.decode('ascii').split('\n') if n else []
 
     def gaze_coords(self):
         """ Returns the current gaze point in display coords.
@@ -241,3 +778,429 @@ class EyeTrackerGaze(object):
             warn('Gaze point received from zero samples')
         
         return x, y
+
+    def load_keymap(self, json_path):
+        """ Loads the HUD keyboard layout at the given json path into the
+            native gaze-to-key index, using the configured HUD geometry.
+            Returns the number of keys loaded, or -1 on failure.
+        """
+        self._ensure_device_opened()
+        n_keys = self._lib.eye_keymap_load(self._obj,
+                                           bytes(json_path, encoding="ascii"),
+                                           HUD_DISP_WIDTH,
+                                           HUD_DISP_HEIGHT,
+                                           HUD_DISP_DIV_X,
+                                           HUD_DISP_DIV_Y)
+        if n_keys < 0:
+            error(f'Failed to load keymap from {json_path}')
+
+        return n_keys
+
+    def gaze_key(self):
+        """ Returns the index of the HUD key under the most recent gaze sample,
+            in keyboard layout order, or HUD_KEY_NONE.
+        """
+        self._ensure_device_opened()
+        return self._lib.eye_gaze_key(self._obj)
+
+    def set_dwell(self, dwell_ms, hysteresis_px=0, refractory_ms=0):
+        """ Configures native dwell selection of HUD keys (requires a loaded
+            keymap). A dwell_ms <= 0 disables dwell selection.
+        """
+        self._ensure_device_opened()
+        self._lib.eye_dwell_config(
+            self._obj, dwell_ms, hysteresis_px, refractory_ms)
+
+    def event_fd(self):
+        """ Returns a file descriptor that is readable (e.g., by select) while
+            gaze events are pending.
+        """
+        self._ensure_device_opened()
+        return self._lib.eye_event_fd(self._obj)
+
+    def events(self):
+        """ Returns a list of all pending gaze events, oldest first. Must only
+            be called from one thread at a time.
+        """
+        self._ensure_device_opened()
+        events = []
+        event = gaze_event()
+
+        while self._lib.eye_event_next(self._obj, ctypes.byref(event)):
+            events.append(gaze_event.from_buffer_copy(event))
+
+        return events
+
+    def inject_text(self, text, modifiers=0):
+        """ Types the given string into the focused window as a single batch
+            of native keystrokes, with the given X11 modifier mask held.
+            Returns the injection latency in microseconds, or -1 on failure.
+        """
+        self._ensure_device_opened()
+        return self._lib.eye_inject_text(
+            self._obj, bytes(text, encoding="utf-8"), modifiers)
+
+    def inject_keysym(self, keysym, modifiers=0):
+        """ Sends a single native keystroke of the given X11 keysym to the
+            focused window, with the given X11 modifier mask held. Returns the
+            injection latency in microseconds, or -1 on failure.
+        """
+        self._ensure_device_opened()
+        return self._lib.eye_inject_keysym(self._obj, keysym, modifiers)
+
+    def build_completions(self, wordlist_path, trie_path=WORDTRIE_PATH):
+        """ Builds a word completion trie file from the given word list, where
+            each line is a word optionally followed by its frequency. Does not
+            require the device be opened, so is available offline. Returns the
+            number of words written, or -1 on failure.
+        """
+        return self._lib.eye_trie_build(bytes(wordlist_path, encoding="utf-8"),
+                                        bytes(trie_path, encoding="utf-8"))
+
+    def load_completions(self, trie_path=WORDTRIE_PATH):
+        """ Memory-maps the given word completion trie file for use by
+            completions(). Returns the number of words loaded, or -1.
+        """
+        self._ensure_device_opened()
+        return self._lib.eye_trie_load(self._obj,
+                                       bytes(trie_path, encoding="utf-8"))
+
+    def completions(self, prefix, k=5):
+        """ Returns a list of up to k completions of the given prefix, most
+            frequent first.
+        """
+        self._ensure_device_opened()
+
+        try:
+            buff = self._completions_buff
+        except AttributeError:
+            self._completions_buff = ctypes.create_string_buffer(
+                WORDTRIE_COMPLETIONS_BUFF_SZ)
+            buff = self._completions_buff
+
+        n = self._lib.eye_trie_complete(self._obj,
+                                        bytes(prefix, encoding="utf-8"),
+                                        k,
+                                        buff,
+                                        WORDTRIE_COMPLETIONS_BUFF_SZ)
+
+        return buff.value.decode('utf-8').split('\n') if n > 0 else []
+
+    def set_heatmap(self,
+                    cell_px=HEATMAP_CELL_PX,
+                    sigma_px=HEATMAP_SIGMA_PX,
+                    halflife_ms=HEATMAP_HALFLIFE_MS):
+        """ Enables the gaze heatmap, with one cell per cell_px display pixels,
+            each gaze sample splatted as a gaussian of sigma_px std deviation,
+            and intensity halving every halflife_ms. A cell_px of 0 disables
+            it. Invalidates any array previously returned by heatmap().
+        """
+        self._ensure_device_opened()
+        self._lib.eye_heatmap_config(self._obj, cell_px, sigma_px, halflife_ms)
+
+    def heatmap(self):
+        """ Returns the gaze heatmap, decayed to the current time, as a 2D
+            numpy array of shape (rows, cols), or None if disabled. The array
+            is a zero-copy view of the live heatmap, so is updated in place
+            as gaze samples arrive -- copy it if a stable snapshot is needed.
+        """
+        self._ensure_device_opened()
+        cols, rows, stride = ctypes.c_int(), ctypes.c_int(), ctypes.c_int()
+
+        grid = self._lib.eye_heatmap(self._obj,
+                                     ctypes.byref(cols),
+                                     ctypes.byref(rows),
+                                     ctypes.byref(stride))
+        if not grid:
+            return None
+
+        grid = np.ctypeslib.as_array(grid, shape=(rows.value, stride.value))
+        return grid[:, :cols.value]
+
+    def add_aoi(self, x, y, width, height):
+        """ Adds an area of interest, given as a display rect, whose time on
+            target is counted natively from the gaze stream. Returns its id,
+            or -1 if the rect is empty.
+        """
+        self._ensure_device_opened()
+        return self._lib.eye_aoi_add(self._obj, x, y, width, height)
+
+    def remove_aoi(self, aoi_id):
+        """ Removes the area of interest having the given id. Returns False
+            if no such area exists.
+        """
+        self._ensure_device_opened()
+        return bool(self._lib.eye_aoi_remove(self._obj, aoi_id))
+
+    def aoi_stats(self):
+        """ Returns a list of aoi_stats, one per area of interest in the
+            order added, snapshotted in a single call.
+        """
+        self._ensure_device_opened()
+        n_buff = 0
+        buff = None
+
+        # Size the buff from the AOI count, retrying if AOIs were added since
+        while True:
+            n_aois = self._lib.eye_aoi_stats(self._obj, buff, n_buff)
+            if n_aois <= n_buff:
+                return list(buff[:n_aois]) if n_aois else []
+
+            n_buff = n_aois
+            buff = (aoi_stats * n_buff)()
+
+    def reset_aoi_stats(self):
+        """ Zeroes the counters of all areas of interest.
+        """
+        self._ensure_device_opened()
+        self._lib.eye_aoi_reset(self._obj)
+
+    def history(self, from_us, to_us):
+        """ Returns a tuple (period_us, records) of the gaze history over the
+            given range of unix timestamps (in microseconds), from the finest
+            resolution available back to from_us. Records are a numpy array
+            of gaze_agg records, in time order, each aggregating period_us,
+            or raw gaze samples if period_us is 0.
+        """
+        self._ensure_device_opened()
+        bin_us = ctypes.c_int64()
+        n_buff = 0
+        buff = None
+
+        # Size the buff from the record count, retrying if it has since grown
+        while True:
+            n = self._lib.eye_history(
+                self._obj, from_us, to_us, buff, n_buff, ctypes.byref(bin_us))
+            if n <= n_buff:
+                break
+
+            n_buff = n
+            buff = (gaze_agg * n_buff)()
+
+        if n == 0:
+            return bin_us.value, np.zeros(0, dtype=np.dtype(gaze_agg))
+
+        return bin_us.value, np.ctypeslib.as_array(buff)[:n]
+
+    def cold_history_stats(self):
+        """ Returns a gaze_cold_stats denoting the compressed cold history's
+            size, compression and encode/decode times, or None if disabled.
+        """
+        self._ensure_device_opened()
+        stats = gaze_cold_stats()
+
+        if not self._lib.eye_cold_history_stats(self._obj, ctypes.byref(stats)):
+            return None
+
+        return stats
+
+    def quality(self):
+        """ Returns a gaze_quality denoting the current gaze data quality.
+        """
+        self._ensure_device_opened()
+        quality = gaze_quality()
+        self._lib.eye_quality(self._obj, ctypes.byref(quality))
+
+        return quality
+
+    def reset_quality(self):
+        """ Clears the gaze quality metrics, e.g. after recalibration, so that
+            a new precision baseline is taken.
+        """
+        self._ensure_device_opened()
+        self._lib.eye_quality_reset(self._obj)
+
+    def validity_counts(self):
+        """ Returns a dict of the number of gaze samples seen, keyed by which
+            eyes were valid: 'none', 'left', 'right' and 'both'.
+        """
+        self._ensure_device_opened()
+        counts = (ctypes.c_int64 * (GAZE_VALID_BOTH + 1))()
+        self._lib.eye_validity_counts(self._obj, counts)
+
+        return {'none': counts[0],
+                'left': counts[GAZE_VALID_LEFT],
+                'right': counts[GAZE_VALID_RIGHT],
+                'both': counts[GAZE_VALID_BOTH]}
+
+    def blink_count(self):
+        """ Returns the number of blinks detected. Each blink also raises a
+            GAZE_EVENT_BLINK event denoting its onset and duration.
+        """
+        self._ensure_device_opened()
+        return self._lib.eye_blink_count(self._obj)
+
+    def connection_stats(self):
+        """ Returns a device_conn_stats denoting the device's disconnects and
+            outage durations. On disconnect, the gaze stream reconnects on
+            its own, raising GAZE_EVENT_DISCONNECTED then
+            GAZE_EVENT_RECONNECTED, and the first sample after the outage is
+            flagged w/ GAZE_FLAG_GAP.
+        """
+        self._ensure_device_opened()
+        stats = device_conn_stats()
+        self._lib.eye_connection_stats(self._obj, ctypes.byref(stats))
+
+        return stats
+
+    def startup_timeline(self):
+        """ Returns a tuple of the device's initialization wall time, in
+            microseconds, and a list of (name, start_us, duration_us, worker)
+            for each of its (possibly concurrent) initialization stages.
+        """
+        self._ensure_device_opened()
+        total_us = ctypes.c_int64()
+        n = self._lib.eye_startup_timeline(
+            self._obj, None, 0, ctypes.byref(total_us))
+        buff = (startup_stage * n)()
+        self._lib.eye_startup_timeline(
+            self._obj, buff, n, ctypes.byref(total_us))
+
+        return (total_us.value,
+                [(s.name.decode('ascii'), s.start_us, s.duration_us, s.worker)
+                 for s in buff])
+
+    def gap_log(self):
+        """ Returns a list of gaze_gap, oldest first, denoting the most recent
+            gaps in gaze samples, i.e. lost data as opposed to invalid
+            samples. Each sample's seq (in exports) counts invalid samples
+            too, and the first valid sample after a device or connection gap
+            is flagged w/ GAZE_FLAG_GAP.
+        """
+        self._ensure_device_opened()
+        n = self._lib.eye_gap_log(self._obj, None, 0)
+        buff = (gaze_gap * n)()
+        n = self._lib.eye_gap_log(self._obj, buff, n)
+
+        return list(buff[:n])
+
+    def lost_count(self):
+        """ Returns the number of gaze samples lost, over all gaps.
+        """
+        self._ensure_device_opened()
+        return self._lib.eye_lost_count(self._obj)
+
+    def trace(self, enabled=True):
+        """ Turns the native trace recorder on or off. When on, the stream
+            loop, callbacks, ingest, smoothing, ML prediction, marker and
+            export writers record timed spans and counters, per thread, e.g.
+            for diagnosing marker stutter. Does not require the device be
+            opened.
+        """
+        self._lib.eye_trace_enable(enabled)
+
+    def trace_dump(self, file_path):
+        """ Writes the trace recorder's buffered events (the most recent per
+            thread) to the given path as Chrome trace JSON, viewable in
+            chrome://tracing or ui.perfetto.dev. Returns the number of events
+            written, or -1 on failure.
+        """
+        return self._lib.eye_trace_dump(bytes(file_path, encoding="utf-8"))
+
+    def index_logs(self, log_paths):
+        """ Updates the spatio-temporal index of each of the given binary gaze
+            logs (see lib/cpp/gaze_index.h), indexing the blocks appended
+            since its last update. Logs written by to_log() are indexed as
+            written, so this is needed only for logs from elsewhere. Does not
+            require the device be opened, so is available offline. Returns a
+            list of the number of blocks indexed per log, or -1 for each
+            failing.
+        """
+        return [self._lib.eye_index_build(bytes(p, encoding="utf-8"),
+                                          DISP_WIDTH_PX,
+                                          DISP_HEIGHT_PX)
+                for p in log_paths]
+
+    def query_logs(self, log_paths, from_us, to_us, x, y, width, height,
+                   label=None):
+        """ Returns a tuple (records, stats) of the samples of the given binary
+            gaze logs in the given range of unix timestamps (in microseconds,
+            inclusive) whose gaze points fall in the given display region, and
+            iff label is given, of that label ('' for unlabeled samples).
+            Records are a numpy array of gaze_index_hit records, in log order
+            then time order, and stats a gaze_index_stats. Only log blocks of
+            the label whose index entries overlap the range and region are
+            scanned. Does not require the device be opened, so is available
+            offline.
+        """
+        paths = (ctypes.c_char_p * len(log_paths))(
+            *[bytes(p, encoding="utf-8") for p in log_paths])
+        if label is not None:
+            label = bytes(label, encoding="ascii")
+        stats = gaze_index_stats()
+        n_buff = GAZE_INDEX_HITS_BUFF_SZ
+        buff = (gaze_index_hit * n_buff)()
+
+        # Size the buff from the record count, retrying if it exceeded it
+        while True:
+            n = self._lib.eye_index_query(paths, len(log_paths), from_us,
+                                          to_us, x, y, width, height, label,
+                                          buff, n_buff, ctypes.byref(stats))
+            if n <= n_buff:
+                break
+
+            n_buff = n
+            buff = (gaze_index_hit * n_buff)()
+
+        return np.ctypeslib.as_array(buff)[:n], stats
+
+    def csv_to_log(self, csv_path, log_path, n_threads=0):
+        """ Converts the given gaze CSV, as written by to_csv(), to a binary
+            gaze log at log_path, overwriting it if exists, and indexes it.
+            Parses on n_threads threads, or one per core if 0. Row labels are
+            interned in the log's label dictionary. Does not require the device
+            be opened, so is available offline. Returns a gaze_csv_stats, or
+            None on failure.
+        """
+        stats = gaze_csv_stats()
+        n = self._lib.eye_csv_to_log(bytes(csv_path, encoding="utf-8"),
+                                     bytes(log_path, encoding="utf-8"),
+                                     n_threads,
+                                     ctypes.byref(stats))
+        if n < 0:
+            return None
+
+        self.index_logs([log_path])
+
+        return stats
+
+    def replay_logs(self, log_paths, out_dir, n_threads=0, shard_s=600,
+                    warmup_s=60, smooth_over=GAZE_SMOOTH_OVER):
+        """ Replays the given binary gaze logs through the gaze pipeline
+            (ML correction iff model paths were given, smoothing over
+            smooth_over samples, the quality monitor and blink detector),
+            writing each log's results to a CSV of the same base name in
+            out_dir (skipping any log whose base name an earlier one has,
+            as counted by n_failed). Logs are split into shards of shard_s
+            seconds (or one per log, if 0), replayed on n_threads threads (or
+            one per core, if 0), each shard first replaying the preceding
+            warmup_s seconds for state continuity. Does not require the device
+            be opened, so is available offline. Returns a gaze_replay_stats.
+        """
+        params = gaze_replay_params(smooth_over,
+                                    QUALITY_WINDOW,
+                                    QUALITY_FIXATION_PX_S,
+                                    QUALITY_MAX_RMS_PX,
+                                    QUALITY_MAX_INVALID,
+                                    n_threads,
+                                    int(shard_s * 1000000),
+                                    int(warmup_s * 1000000))
+        stats = gaze_replay_stats()
+        paths = (ctypes.c_char_p * len(log_paths))(
+            *[bytes(p, encoding="utf-8") for p in log_paths])
+
+        try:
+            ml_x_path = bytes(self._ml_x_path, encoding="ascii")
+            ml_y_path = bytes(self._ml_y_path, encoding="ascii")
+        except TypeError:
+            ml_x_path = ml_y_path = None
+
+        self._lib.eye_replay_logs(paths,
+                                  len(log_paths),
+                                  bytes(out_dir, encoding="utf-8"),
+                                  ctypes.byref(params),
+                                  ml_x_path,
+                                  ml_y_path,
+                                  ctypes.byref(stats))
+
+        return stats
@@ -6,6 +6,7 @@ __author__ = 'Dustin Fast <dustin.fast@outlook.com>'
 from time import sleep
 from threading import Thread
 import multiprocessing as mp
+from select import select
 from subprocess import Popen, PIPE
 
 import Xlib.display
@@ -22,7 +23,8 @@ from gi.repository import Wnck
 import pyximport; pyximport.install()  # Required for EyeTrackerGaze
 
 from lib.py.app import config, warn
-from lib.py.eyetracker_gaze import EyeTrackerGaze
+from lib.py.eyetracker_gaze import EyeTrackerGaze, GAZE_EVENT_KEY_SELECTED, \
+    GAZE_EVENT_RECALIBRATE, GAZE_FIELDS_HUD, GAZE_FIELDS_ML
 from lib.py.hud_panel import HUDKeyboardPanel, HUDStatusPanel
 from lib.py.hud_learn import HUDLearn
 
@@ -38,6 +40,9 @@ HUD_DISP_DIV_X = _conf['HUD_DISP_COORD_DIVISOR_X']
 HUD_DISP_DIV_Y = _conf['HUD_DISP_COORD_DIVISOR_Y'] 
 HUD_DISP_TITLE = _conf['HUD_DISP_TITLE']
 HUD_KEYB_JSON =  _conf['HUD_KEYB_JSON']
+HUD_DWELL_MS = _conf['HUD_DWELL_MS']
+HUD_DWELL_HYSTERESIS_PX = _conf['HUD_DWELL_HYSTERESIS_PX']
+HUD_DWELL_REFRACTORY_MS = _conf['HUD_DWELL_REFRACTORY_MS']
 del _conf
 
 # HUD styles
@@ -61,6 +66,7 @@ SIGNAL_REQUEST_ACTIVE_WINDOW = 0
 SIGNAL_REQUEST_PREV_ACTIVE_WINDOW = 1
 ASYNC_WIN_DELAY = .005
 ASYNC_POS_DELAY = .1
+ASYNC_DWELL_TIMEOUT = .5
 
 
 class HUD(tk.Tk):
@@ -198,7 +204,8 @@ class _HUDState(object):
         self._cursor_captured = False
         self._gazetracker = EyeTrackerGaze(
             self._learn.model_x_path if mode == 'infer' else None,
-            self._learn.model_y_path if mode == 'infer' else None)
+            self._learn.model_y_path if mode == 'infer' else None,
+            GAZE_FIELDS_ML if mode == 'infer' else GAZE_FIELDS_HUD)
 
         # Keyboard modifer state containers
         self._keyboard_active_modifier_btns = []
@@ -212,6 +219,10 @@ class _HUDState(object):
         # Async (via threading) user pos watcher attributes
         self._async_proc_pos = None
 
+        # Async (via threading) dwell selection watcher attributes
+        self._async_proc_dwell = None
+        self._async_stop_dwell = False
+
     @property
     def active_window(self):
         """ Returns an Xlib.Window obj for the currently active window.
@@ -299,6 +310,25 @@ class _HUDState(object):
             hud_status_panel.set_user_posguide(gazetracker.user_position())
             sleep(ASYNC_POS_DELAY)
 
+    def _async_dwell_watcher(self, gazetracker, hud_keyb_panel):
+        """ Clicks each HUD keyboard btn the eyetracker reports as selected
+            by gaze dwell. Intended to be run as a thread, so clicks are
+            scheduled on the Tk thread rather than invoked from this one.
+        """
+        fd = gazetracker.event_fd()
+
+        while not self._async_stop_dwell:
+            # Block until an event is signaled (or timeout, to check for stop)
+            if not select([fd], [], [], ASYNC_DWELL_TIMEOUT)[0]:
+                continue
+
+            for event in gazetracker.events():
+                if event.type == GAZE_EVENT_KEY_SELECTED:
+                    self.hud.after(
+                        0, hud_keyb_panel.dwell_select, event.key_idx)
+                elif event.type == GAZE_EVENT_RECALIBRATE:
+                    warn('Gaze data quality degraded. Recalibration suggested.')
+
     def _focus_prev_active_win(self):
         """ Sets the previously active window to be the active window.
             Intended to be used when the HUD takes focus via a HUD btn click
@@ -380,8 +410,12 @@ class _HUDState(object):
                 args=(self._async_signal_q_win, self._async_output_q_win))
             self._async_proc_win.start()
 
-            # Start the eyetracker
+            # Start the eyetracker and give it the keyboard layout
             self._gazetracker.open()
+            self._gazetracker.load_keymap(HUD_KEYB_JSON)
+            self._gazetracker.set_dwell(HUD_DWELL_MS,
+                                        HUD_DWELL_HYSTERESIS_PX,
+                                        HUD_DWELL_REFRACTORY_MS)
             self._gazetracker.start()
             
             # Give time to spin up
@@ -393,6 +427,14 @@ class _HUDState(object):
                 args=(self._gazetracker, self.hud.status_panel))
             self._async_proc_pos.start()
 
+            # Start the dwell selection watcher iff dwell enabled
+            if HUD_DWELL_MS > 0:
+                self._async_stop_dwell = False
+                self._async_proc_dwell = Thread(
+                    target=self._async_dwell_watcher,
+                    args=(self._gazetracker, self.hud.keyb_panel))
+                self._async_proc_dwell.start()
+
         return self._async_proc_win
 
     def stop(self) -> mp.Process:
@@ -409,6 +451,10 @@ class _HUDState(object):
         except mp.queues.Full:
             pass
         else:
+            if self._async_proc_dwell is not None:
+                self._async_stop_dwell = True
+                self._async_proc_dwell.join()
+
             self._gazetracker.stop()
             self._gazetracker.close()
 
@@ -471,10 +517,12 @@ class _HUDState(object):
         # Extract kwarg
         payload = kwargs['payload']     # (str)
 
-        # Convert the payload to a KeyCode obj, then do keypress
-        payload = self._keyboard._KeyCode.from_vk(payload)
-        self._keyboard.press(payload)
-        self._keyboard.release(payload)
+        # Send the keystroke natively, falling back to pynput iff that fails.
+        # Modifiers toggled via pynput are held server-side, so still apply.
+        if self._gazetracker.inject_keysym(payload) < 0:
+            payload = self._keyboard._KeyCode.from_vk(payload)
+            self._keyboard.press(payload)
+            self._keyboard.release(payload)
 
         # Clear any modifers (ex: alt, shift, etc.) iff not hold set
         if not self._keyboard_hold_modifiers:
@@ -88,6 +88,19 @@ class HUDKeyboardPanel(HUDPanel):
 
                 self._panel_btns.append(btn)
 
+    def dwell_select(self, key_idx):
+        """ Clicks the button at the given index of the keyboard layout, as
+            selected by gaze dwell. Spacers and out of range indexes are
+            ignored.
+        """
+        try:
+            btn = self._panel_btns[key_idx]
+        except IndexError:
+            return
+
+        if key_idx >= 0 and btn.text != BTN_SPACER_TEXT:
+            btn.widget.invoke()
+
     @property
     def button_widgets(self):
         """ Returns a list of the keyboard's button widgets.
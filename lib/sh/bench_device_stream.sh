@@ -0,0 +1,19 @@
+#! /usr/bin/env bash
+
+# Builds and runs the device reconnect benchmark, against the stubbed stream
+# engine (i.e. no eyetracker device is needed).
+
+
+gcc /opt/app/src/lib/cpp/device_stream_bench.cpp  \
+    -o device_stream_bench  \
+    -lstdc++  \
+    -lboost_chrono  \
+    -lboost_system  \
+    -lboost_thread  \
+    -pthread
+
+./device_stream_bench
+STATUS=$?
+
+rm device_stream_bench
+exit ${STATUS}
@@ -0,0 +1,51 @@
+#! /usr/bin/env bash
+
+# Builds and runs the EyeTrackerGaze microbenchmarks, against the stubbed
+# stream engine (i.e. no eyetracker device is needed), w/ results written as
+# JSON to the given path (default: eyetracker_gaze_bench.json). Built as the
+# lib is. If no X display is set, one is provided by Xvfb. The ML benchmarks
+# run iff model paths are given.
+#
+# Usage: bench_eyetracker_gaze.sh [JSON_PATH [ML_X_PATH ML_Y_PATH]]
+
+JSON_PATH=${1:-eyetracker_gaze_bench.json}
+BENCH_XVFB_DISPLAY=:99
+
+gcc /opt/app/src/lib/cpp/eyetracker_gaze_bench.cpp  \
+    -o eyetracker_gaze_bench  \
+    -I/usr/include/python3.6m -lpython3.6m  \
+    -lstdc++ -lX11 -lXtst  \
+    -lboost_chrono  \
+    -lboost_system  \
+    -lboost_thread  \
+    -pthread
+
+# The stubbed stream engine accepts any license, so provide a placeholder
+# iff none exists (the device is otherwise opened w/ the real one)
+LIC_PATH=/opt/app/src/licenses/fast_aeye_typer_temp_se_license_key
+
+if [ ! -s "${LIC_PATH}" ]; then
+    mkdir -p "$(dirname "${LIC_PATH}")"
+    printf 'stub' > "${LIC_PATH}"
+fi
+
+# Start a virtual display iff needed
+if [ -z "${DISPLAY}" ]; then
+    Xvfb ${BENCH_XVFB_DISPLAY} -screen 0 3840x2160x24 &
+    XVFB_PID=$!
+    export DISPLAY=${BENCH_XVFB_DISPLAY}
+    sleep 1
+fi
+
+# Results are tagged w/ the source revision, if known
+export BENCH_REV="$(git -C /opt/app/src rev-parse --short HEAD 2>/dev/null)"
+
+./eyetracker_gaze_bench "${JSON_PATH}" ${@:2}
+STATUS=$?
+
+if [ -n "${XVFB_PID}" ]; then
+    kill ${XVFB_PID}
+fi
+
+rm eyetracker_gaze_bench
+exit ${STATUS}
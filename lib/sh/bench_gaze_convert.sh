@@ -0,0 +1,17 @@
+#! /usr/bin/env bash
+
+# Builds and runs the gaze sample batch conversion microbenchmark. No
+# eyetracker device is needed. Built as the lib is, i.e. w/o -mavx2, so the
+# AVX2 kernel is exercised by runtime selection.
+
+
+gcc /opt/app/src/lib/cpp/gaze_convert_bench.cpp  \
+    -o gaze_convert_bench  \
+    -O2  \
+    -lstdc++
+
+./gaze_convert_bench
+STATUS=$?
+
+rm gaze_convert_bench
+exit ${STATUS}
@@ -1,7 +1,7 @@
 #! /usr/bin/env bash
 
 # Builds the eyetracker_gaze shared object file and starts the eyetracker
-# service iff needed.
+# service iff needed. Given --build-only, only builds.
 
 
 # Build the .so file
@@ -13,7 +13,7 @@ gcc  -c -fPIC /opt/app/src/lib/cpp/eyetracker_gaze.cpp  \
 
 gcc -shared  \
     -o /opt/app/src/lib/so/eyetracker_gaze.so eyetracker_gaze.o  \
-    -lstdc++ -lX11  \
+    -lstdc++ -lX11 -lXtst  \
     -lboost_chrono  \
     -lboost_system  \
     -lboost_thread  \
@@ -22,6 +22,10 @@ gcc -shared  \
 
 rm eyetracker_gaze.o
 
+if [ "$1" == "--build-only" ]; then
+    exit 0
+fi
+
 # Start the eyetracker runtime service iff not already running
 STATUS="$(systemctl is-active tobii-runtime-IS4LARGE107)"
 
@@ -0,0 +1,28 @@
+#! /usr/bin/env bash
+
+# Builds the eyetracker_gaze shared object file against the stubbed stream
+# engine, i.e. a synthetic backend needing no eyetracker device or service.
+
+
+gcc  -c -fPIC /opt/app/src/lib/cpp/eyetracker_gaze_stub.cpp  \
+    -I/usr/include/python3.6m -lpython3.6m \
+    -o eyetracker_gaze_stub.o
+
+gcc -shared  \
+    -o /opt/app/src/lib/so/eyetracker_gaze_stub.so eyetracker_gaze_stub.o  \
+    -lstdc++ -lX11 -lXtst  \
+    -lboost_chrono  \
+    -lboost_system  \
+    -lboost_thread  \
+    -pthread
+
+rm eyetracker_gaze_stub.o
+
+# The stubbed stream engine accepts any license, so provide a placeholder
+# iff none exists (the device is otherwise opened w/ the real one)
+LIC_PATH=/opt/app/src/licenses/fast_aeye_typer_temp_se_license_key
+
+if [ ! -s "${LIC_PATH}" ]; then
+    mkdir -p "$(dirname "${LIC_PATH}")"
+    printf 'stub' > "${LIC_PATH}"
+fi
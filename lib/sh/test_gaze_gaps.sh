@@ -0,0 +1,18 @@
+#! /usr/bin/env bash
+
+# Builds and runs the gap log tests. No eyetracker device is needed.
+
+
+gcc /opt/app/src/lib/cpp/gaze_gaps_test.cpp  \
+    -o gaze_gaps_test  \
+    -Wall  \
+    -lstdc++  \
+    -lboost_system  \
+    -lboost_thread  \
+    -pthread
+
+./gaze_gaps_test
+STATUS=$?
+
+rm gaze_gaps_test
+exit ${STATUS}
@@ -0,0 +1,16 @@
+#! /usr/bin/env bash
+
+# Builds and runs the HUD keymap tests. No eyetracker device or display is
+# needed.
+
+
+gcc /opt/app/src/lib/cpp/hud_keymap_test.cpp  \
+    -o hud_keymap_test  \
+    -Wall  \
+    -lstdc++
+
+./hud_keymap_test
+STATUS=$?
+
+rm hud_keymap_test
+exit ${STATUS}
@@ -0,0 +1,66 @@
+#! /usr/bin/env python
+""" A utility for converting gaze CSV, as written by EyeTrackerGaze.to_csv(),
+    to the compact binary gaze log (see lib/cpp/gaze_csv.h). Each CSV is
+    written to a log of the same base name, w/ the .glog extension, in the
+    output dir. Rows of the wrong column count (e.g. mouse logs) or w/
+    unparsable values are skipped and reported.
+"""
+
+__author__ = 'Dustin Fast <dustin.fast@outlook.com>'
+
+import os
+import argparse
+
+import pyximport; pyximport.install()
+
+from lib.py.app import info, warn, error
+from lib.py.eyetracker_gaze import EyeTrackerGaze
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    arg_help_str = 'Paths of the CSVs to convert, or dirs of them.'
+    parser.add_argument('csv_paths',
+                        type=str,
+                        nargs='+',
+                        help=arg_help_str)
+    arg_help_str = 'Output dir. Defaults to the current dir.'
+    parser.add_argument('-o', '--out_dir',
+                        type=str,
+                        default='.',
+                        help=arg_help_str)
+    arg_help_str = 'Parsing threads. Defaults to one per core.'
+    parser.add_argument('-j', '--threads',
+                        type=int,
+                        default=0,
+                        help=arg_help_str)
+    args = parser.parse_args()
+
+    # Expand dirs to the CSVs they contain
+    csv_paths = []
+    for path in args.csv_paths:
+        if os.path.isdir(path):
+            csv_paths += sorted(
+                os.path.join(path, f) for f in os.listdir(path)
+                if f.endswith('.csv'))
+        else:
+            csv_paths.append(path)
+
+    os.makedirs(args.out_dir, exist_ok=True)
+    gaze = EyeTrackerGaze(offline=True)
+
+    for csv_path in csv_paths:
+        name = os.path.splitext(os.path.basename(csv_path))[0]
+        log_path = os.path.join(args.out_dir, f'{name}.glog')
+        stats = gaze.csv_to_log(csv_path, log_path, args.threads)
+
+        if stats is None:
+            error(f'Failed to convert {csv_path}')
+            continue
+
+        if stats.n_malformed:
+            warn(f'Skipped {stats.n_malformed} malformed rows of {csv_path}, '
+                 f'the first at line {stats.first_malformed}')
+
+        info(f'Wrote {stats.n_rows} samples to {log_path} '
+             f'({stats.n_bytes / max(stats.elapsed_us, 1):.0f} MB/s)')
@@ -0,0 +1,96 @@
+#! /usr/bin/env python
+""" A utility for replaying archived binary gaze logs through the gaze
+    pipeline offline, e.g. to compare smoothing params or retrained models.
+    Each log's results are written to a CSV of the same base name in the
+    output dir, one row per sample, of its logged columns followed by the
+    pipeline's (see lib/cpp/gaze_replay.h). Logs are sharded by time and
+    replayed in parallel.
+"""
+
+__author__ = 'Dustin Fast <dustin.fast@outlook.com>'
+
+import os
+import argparse
+
+import pyximport; pyximport.install()
+
+from lib.py.app import info, error
+from lib.py.eyetracker_gaze import EyeTrackerGaze, GAZE_SMOOTH_OVER
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    arg_help_str = 'Paths of the logs to replay, or dirs of them.'
+    parser.add_argument('log_paths',
+                        type=str,
+                        nargs='+',
+                        help=arg_help_str)
+    arg_help_str = 'Output dir. Defaults to the current dir.'
+    parser.add_argument('-o', '--out_dir',
+                        type=str,
+                        default='.',
+                        help=arg_help_str)
+    arg_help_str = 'Replay threads. Defaults to one per core.'
+    parser.add_argument('-j', '--threads',
+                        type=int,
+                        default=0,
+                        help=arg_help_str)
+    arg_help_str = 'Shard length, in seconds, or 0 for one shard per log. '
+    arg_help_str += 'Defaults to 600.'
+    parser.add_argument('--shard_s',
+                        type=float,
+                        default=600,
+                        help=arg_help_str)
+    arg_help_str = 'Warm-up replayed before each shard, in seconds. '
+    arg_help_str += 'Defaults to 60.'
+    parser.add_argument('--warmup_s',
+                        type=float,
+                        default=60,
+                        help=arg_help_str)
+    arg_help_str = f'Samples to smooth over. Defaults to {GAZE_SMOOTH_OVER}.'
+    parser.add_argument('--smooth_over',
+                        type=int,
+                        default=GAZE_SMOOTH_OVER,
+                        help=arg_help_str)
+    arg_help_str = 'Path of the x-coord ML model, for ML correction.'
+    parser.add_argument('--ml_x',
+                        type=str,
+                        default=None,
+                        help=arg_help_str)
+    arg_help_str = 'Path of the y-coord ML model, for ML correction.'
+    parser.add_argument('--ml_y',
+                        type=str,
+                        default=None,
+                        help=arg_help_str)
+    args = parser.parse_args()
+
+    if bool(args.ml_x) != bool(args.ml_y):
+        error('Both or neither of --ml_x and --ml_y must be given.')
+        exit()
+
+    # Expand dirs to the files they contain
+    log_paths = []
+    for path in args.log_paths:
+        if os.path.isdir(path):
+            log_paths += sorted(
+                os.path.join(path, f) for f in os.listdir(path)
+                if os.path.isfile(os.path.join(path, f)))
+        else:
+            log_paths.append(path)
+
+    os.makedirs(args.out_dir, exist_ok=True)
+
+    stats = EyeTrackerGaze(args.ml_x, args.ml_y, offline=True).replay_logs(
+        log_paths,
+        args.out_dir,
+        n_threads=args.threads,
+        shard_s=args.shard_s,
+        warmup_s=args.warmup_s,
+        smooth_over=args.smooth_over)
+
+    if stats.n_failed:
+        error(f'{stats.n_failed} of {len(log_paths)} logs failed to replay')
+
+    info(f'Replayed {stats.n_logs} logs ({stats.n_samples} samples, '
+         f'{stats.n_warmup} warm-up) in {stats.n_shards} shards on '
+         f'{stats.n_threads} threads in {stats.elapsed_us / 1e6:.2f}s')
@@ -0,0 +1,37 @@
+#! /usr/bin/env python
+""" A utility for building the HUD's word completion trie from a word list.
+    Each line of the word list is a word, optionally followed by whitespace
+    and its integer frequency. Words given w/out a frequency are ranked by
+    their order in the list, most frequent first.
+"""
+
+__author__ = 'Dustin Fast <dustin.fast@outlook.com>'
+
+import argparse
+
+import pyximport; pyximport.install()
+
+from lib.py.app import info, error
+from lib.py.eyetracker_gaze import EyeTrackerGaze, WORDTRIE_PATH
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    arg_help_str = 'Path of the word list to build from.'
+    parser.add_argument('wordlist_path',
+                        type=str,
+                        help=arg_help_str)
+    arg_help_str = f'Output trie path. Defaults to {WORDTRIE_PATH}.'
+    parser.add_argument('-o', '--output',
+                        type=str,
+                        default=WORDTRIE_PATH,
+                        help=arg_help_str)
+    args = parser.parse_args()
+
+    n_words = EyeTrackerGaze(offline=True).build_completions(
+        args.wordlist_path, args.output)
+
+    if n_words < 0:
+        error(f'Failed to build word trie from {args.wordlist_path}')
+    else:
+        info(f'Wrote {n_words} words to {args.output}')